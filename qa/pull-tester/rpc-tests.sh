@@ -46,6 +46,7 @@ testScripts=(
     'mempool_tx_input_limit.py'
     'mempool_nu_activation.py'
     'mempool_tx_expiry.py'
+    'mempool_limit.py'
     'httpbasics.py'
     'zapwallettxes.py'
     'proxy_test.py'
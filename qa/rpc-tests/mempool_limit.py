@@ -0,0 +1,166 @@
+#!/usr/bin/env python2
+# Copyright (c) 2019 The SuperNET developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test -maxmempool: flood a node with low fee transactions and check that
+# the mempool stays below the limit, that the resident memory of the node
+# stops growing once the pool is full and that evicted transactions are
+# also gone from the mempool address and spent indexes.
+#
+
+import random
+from decimal import Decimal, ROUND_DOWN
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, assert_greater_than, \
+    initialize_chain_clean, start_node, stop_node, connect_nodes, \
+    sync_blocks, bitcoind_processes
+
+MAX_MEMPOOL = 5
+NUM_FUNDING = 60
+NUM_OUTPUTS = 100
+
+def resident_kb(i):
+    with open("/proc/%d/status" % bitcoind_processes[i].pid) as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return 0
+
+class MempoolLimitTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print "Initializing test directory "+self.options.tmpdir
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        # node 0 holds the keys, node 1 is flooded and has no wallet so that
+        # the flood only grows its mempool
+        self.node1_args = ["-debug=mempool", "-disablewallet", "-addressindex", "-spentindex",
+                           "-maxmempool=%d" % MAX_MEMPOOL]
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug=mempool"]))
+        self.nodes.append(start_node(1, self.options.tmpdir, self.node1_args))
+        connect_nodes(self.nodes[1], 0)
+        self.is_network_split = False
+        self.sync_all()
+
+    def spend(self, utxo, address, fee):
+        inputs = [{ "txid" : utxo["txid"], "vout" : utxo["vout"] }]
+        outputs = { address : utxo["amount"] - fee }
+        rawtx = self.nodes[0].createrawtransaction(inputs, outputs)
+        prevtxs = [{ "txid" : utxo["txid"], "vout" : utxo["vout"],
+                     "scriptPubKey" : utxo["scriptPubKey"], "amount" : utxo["amount"] }]
+        signresult = self.nodes[0].signrawtransaction(rawtx, prevtxs)
+        assert_equal(signresult["complete"], True)
+        return signresult["hex"], outputs[address]
+
+    def run_test(self):
+        self.nodes[0].generate(100 + NUM_FUNDING)
+        addresses = [ self.nodes[0].getnewaddress() for i in range(NUM_OUTPUTS) ]
+        scripts = dict((address, self.nodes[0].validateaddress(address)["scriptPubKey"]) for address in addresses)
+
+        # fan the mature coinbases out to many small outputs
+        print "Funding %d outputs..." % (NUM_FUNDING * NUM_OUTPUTS)
+        funding = []
+        for height in range(1, NUM_FUNDING + 1):
+            txid = self.nodes[0].getblock(self.nodes[0].getblockhash(height))["tx"][0]
+            coinbase = self.nodes[0].getrawtransaction(txid, 1)
+            amount = Decimal(coinbase["vout"][0]["value"]) - Decimal("0.001")
+            outputs = dict((address, (amount / NUM_OUTPUTS).quantize(Decimal("0.00000001"), rounding=ROUND_DOWN)) for address in addresses)
+            rawtx = self.nodes[0].createrawtransaction([{ "txid" : txid, "vout" : 0 }], outputs)
+            signresult = self.nodes[0].signrawtransaction(rawtx)
+            assert_equal(signresult["complete"], True)
+            funding.append(self.nodes[0].sendrawtransaction(signresult["hex"]))
+        self.nodes[0].generate(1)
+        self.sync_all()
+
+        utxos = []
+        for txid in funding:
+            tx = self.nodes[0].getrawtransaction(txid, 1)
+            for vout in tx["vout"]:
+                utxos.append({ "txid" : txid, "vout" : vout["n"], "amount" : Decimal(vout["value"]),
+                               "scriptPubKey" : vout["scriptPubKey"]["hex"], "address" : vout["scriptPubKey"]["addresses"][0] })
+        random.shuffle(utxos)
+
+        # isolate node 1 so that the flood is not relayed to the wallet node
+        stop_node(self.nodes[1], 1)
+        self.nodes[1] = start_node(1, self.options.tmpdir, self.node1_args)
+
+        print "Flooding node 1..."
+        sent = {}
+        children = {}
+        rejected = 0
+        rss_full = None
+        for i in range(len(utxos)):
+            utxo = utxos[i]
+            fee = Decimal(random.randint(1, 100)) * Decimal("0.00001")
+            address = addresses[i % len(addresses)]
+            rawtx, amount = self.spend(utxo, address, fee)
+            try:
+                txid = self.nodes[1].sendrawtransaction(rawtx)
+            except JSONRPCException as e:
+                rejected += 1
+                continue
+            sent[txid] = utxo
+            # chain a child onto every tenth transaction so that eviction has descendants to take along
+            if i % 10 == 0:
+                child = { "txid" : txid, "vout" : 0, "amount" : amount, "scriptPubKey" : scripts[address], "address" : address }
+                rawtx, amount = self.spend(child, address, fee * 10)
+                try:
+                    childtxid = self.nodes[1].sendrawtransaction(rawtx)
+                    sent[childtxid] = child
+                    children[childtxid] = txid
+                except JSONRPCException as e:
+                    # until the pool is full nothing may be evicted, so the child must be accepted
+                    assert(rss_full is not None)
+                    rejected += 1
+            if rss_full is None and self.nodes[1].getmempoolinfo()["mempoolminfee"] > 0:
+                rss_full = resident_kb(1)
+                print "Mempool full after %d transactions, resident %d kB" % (len(sent), rss_full)
+
+        mempoolinfo = self.nodes[1].getmempoolinfo()
+        rss_end = resident_kb(1)
+        print "Sent %d (%d children), rejected %d, in mempool %d, usage %d, resident %d kB" % \
+            (len(sent), len(children), rejected, mempoolinfo["size"], mempoolinfo["usage"], rss_end)
+
+        assert(rss_full is not None)
+        assert_equal(mempoolinfo["maxmempool"], MAX_MEMPOOL * 1000000)
+        assert(mempoolinfo["usage"] <= MAX_MEMPOOL * 1000000)
+        assert_greater_than(len(sent), mempoolinfo["size"])
+        assert_greater_than(mempoolinfo["mempoolminfee"], 0)
+        # once the pool is full the node should not grow much further
+        assert(rss_end < rss_full * 1.2)
+
+        # evicted transactions must be gone from the mempool indexes too
+        inpool = set(self.nodes[1].getrawmempool())
+        indexed = set(delta["txid"] for delta in self.nodes[1].getaddressmempool({ "addresses" : addresses }))
+        assert(indexed.issubset(inpool))
+        evicted = [ txid for txid in sent if txid not in inpool ]
+        assert(len(evicted) > 0)
+        for txid in evicted[:50]:
+            utxo = sent[txid]
+            spent = None
+            try:
+                spent = self.nodes[1].getspentinfo({ "txid" : utxo["txid"], "index" : utxo["vout"] })
+            except JSONRPCException as e:
+                pass
+            assert(spent is None or spent["txid"] in inpool)
+
+        # a child never outlives its parent, and some parents were evicted together with their child
+        assert_greater_than(len(children), 0)
+        for childtxid, parenttxid in children.items():
+            assert(parenttxid in inpool or childtxid not in inpool)
+        assert(any(parenttxid not in inpool for parenttxid in children.values()))
+
+        # a new block still connects on top of the trimmed pool
+        connect_nodes(self.nodes[1], 0)
+        self.nodes[0].generate(1)
+        sync_blocks(self.nodes)
+        assert(self.nodes[1].getmempoolinfo()["usage"] <= MAX_MEMPOOL * 1000000)
+
+if __name__ == '__main__':
+    MempoolLimitTest().main()
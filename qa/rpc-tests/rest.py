@@ -211,6 +211,23 @@ class RESTTest (BitcoinTestFramework):
         response = http_post_call(url.hostname, url.port, '/rest/getutxos'+json_request+self.FORMAT_SEPARATOR+'json', '', True)
         assert_equal(response.status, 200) # must be a 500 because we exceeding the limits
 
+        # the batch endpoint takes the binary getutxos request with up to 10000 outpoints
+        binaryRequest = b'\x01\xfd' + struct.pack("<H", 1000)
+        for x in range(0, 1000):
+            binaryRequest += binascii.unhexlify(txid) + struct.pack("i", n)
+        bin_response = http_post_call(url.hostname, url.port, '/rest/getutxosbatch'+self.FORMAT_SEPARATOR+'bin', binaryRequest)
+        output = StringIO.StringIO()
+        output.write(bin_response)
+        output.seek(0)
+        chainHeight = struct.unpack("i", output.read(4))[0]
+        assert_equal(chainHeight, 102)
+
+        binaryRequest = b'\x01\xfd' + struct.pack("<H", 10001)
+        for x in range(0, 10001):
+            binaryRequest += binascii.unhexlify(txid) + struct.pack("i", n)
+        response = http_post_call(url.hostname, url.port, '/rest/getutxosbatch'+self.FORMAT_SEPARATOR+'bin', binaryRequest, True)
+        assert_equal(response.status, 500) # must be a 500 because we exceeding the limits
+
         self.nodes[0].generate(1) # generate block to not affect upcoming tests
         self.sync_all()
 
@@ -0,0 +1,149 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "blockfilepool.h"
+#include "chainparams.h"
+#include "compat.h"
+#include "crypto/common.h"
+#include "main.h"
+
+#ifndef WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockFilePool blockfilepool(DEFAULT_BLOCKFILE_MAPS);
+
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap((void *)data, size);
+#endif
+}
+
+std::shared_ptr<const CMappedBlockFile> CBlockFilePool::Map(int nFile)
+{
+    std::shared_ptr<const CMappedBlockFile> file;
+#ifndef WIN32
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return file;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, st.st_size, MADV_RANDOM);
+            file = std::make_shared<const CMappedBlockFile>((const unsigned char *)data, (size_t)st.st_size);
+        }
+    }
+    close(fd);
+    if (!file)
+        return file;
+
+    LOCK(cs);
+    for (auto it = lru.begin(); it != lru.end(); ++it)
+    {
+        if (it->first == nFile)
+        {
+            lru.erase(it);
+            break;
+        }
+    }
+    lru.push_front(std::make_pair(nFile, file));
+    while (lru.size() > nMaxFiles)
+        lru.pop_back();
+#endif
+    return file;
+}
+
+bool CBlockFilePool::GetBlock(const CDiskBlockPos &pos, CBlockFileSpan &span)
+{
+    std::shared_ptr<const CMappedBlockFile> file;
+    // the block is preceded by the network magic and its size
+    if (pos.IsNull() || pos.nPos < 8)
+        return false;
+    {
+        LOCK(cs);
+        if (nMaxFiles == 0)
+            return false;
+        for (auto it = lru.begin(); it != lru.end(); ++it)
+        {
+            if (it->first == pos.nFile)
+            {
+                lru.splice(lru.begin(), lru, it);
+                file = it->second;
+                break;
+            }
+        }
+    }
+
+    bool fRemapped = false;
+    while (true)
+    {
+        if (!file)
+        {
+            if (fRemapped || !(file = Map(pos.nFile)))
+                return false;
+            fRemapped = true;
+        }
+        if (pos.nPos <= file->size)
+        {
+            const unsigned char *p = file->data + pos.nPos;
+            if (memcmp(p - 8, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+                return false;
+            uint32_t nSize = ReadLE32(p - 4);
+            if ((uint64_t)pos.nPos + nSize <= file->size)
+            {
+                span.file = file;
+                span.begin = (const char *)p;
+                span.end = (const char *)p + nSize;
+                return true;
+            }
+        }
+        // written after the file was mapped
+        file.reset();
+    }
+}
+
+void CBlockFilePool::Invalidate(int nFile)
+{
+    LOCK(cs);
+    for (auto it = lru.begin(); it != lru.end(); ++it)
+    {
+        if (it->first == nFile)
+        {
+            lru.erase(it);
+            break;
+        }
+    }
+}
+
+void CBlockFilePool::Clear()
+{
+    LOCK(cs);
+    lru.clear();
+}
+
+void CBlockFilePool::SetMaxFiles(size_t nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    while (lru.size() > nMaxFiles)
+        lru.pop_back();
+}
@@ -0,0 +1,83 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef BLOCKFILEPOOL_H
+#define BLOCKFILEPOOL_H
+
+#include "chain.h"
+#include "sync.h"
+
+#include <list>
+#include <memory>
+
+/** Default for -blockfilemaps, the number of blk files kept memory mapped */
+static const unsigned int DEFAULT_BLOCKFILE_MAPS = sizeof(void*) >= 8 ? 64 : 0;
+
+/** A read-only memory mapping of a whole blk file, unmapped when the last reference is dropped */
+class CMappedBlockFile
+{
+public:
+    const unsigned char *data;
+    size_t size;
+
+    CMappedBlockFile(const unsigned char *dataIn, size_t sizeIn) : data(dataIn), size(sizeIn) {}
+    ~CMappedBlockFile();
+
+private:
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+};
+
+/** The bytes of one block on disk, valid as long as file is referenced */
+struct CBlockFileSpan
+{
+    std::shared_ptr<const CMappedBlockFile> file;
+    const char *begin;
+    const char *end;
+};
+
+/*
+ * Random reads of blocks and transactions open, seek, read through stdio and close the blk file each time.
+ * The pool keeps the most recently read blk files mapped read-only so that they are deserialized in place.
+ * A file is mapped up to its size at mapping time, a read past the end of the mapping remaps the file since new
+ * blocks are appended to it. Files that are truncated or pruned must be invalidated.
+ * Not available on windows, GetBlock then always fails and the callers read the file with stdio.
+ */
+class CBlockFilePool
+{
+public:
+    CBlockFilePool(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Returns the serialized block stored at pos, pos being the position recorded in the block index */
+    bool GetBlock(const CDiskBlockPos &pos, CBlockFileSpan &span);
+    /** Drops the mapping of a blk file after it was truncated or deleted */
+    void Invalidate(int nFile);
+    void Clear();
+
+    /** Number of files kept mapped, 0 disables the pool */
+    void SetMaxFiles(size_t nMaxFilesIn);
+    size_t GetMaxFiles() const { return nMaxFiles; }
+
+private:
+    CCriticalSection cs;
+    size_t nMaxFiles;
+    std::list<std::pair<int, std::shared_ptr<const CMappedBlockFile> > > lru; // most recently used first
+
+    std::shared_ptr<const CMappedBlockFile> Map(int nFile);
+};
+
+extern CBlockFilePool blockfilepool;
+
+#endif // BLOCKFILEPOOL_H
@@ -37,4 +37,7 @@ UniValue GatewaysExternalAddress(uint256 bindtxid,CPubKey pubkey);
 UniValue GatewaysDumpPrivKey(uint256 bindtxid,CKey privkey);
 UniValue GatewaysList();
 
+void GatewaysConnectBlock(const CBlock &block);
+void GatewaysDisconnectBlock(const CBlock &block);
+
 #endif
@@ -40,6 +40,8 @@ UniValue MarmaraIssue(uint64_t txfee,uint8_t funcid,CPubKey receiverpk,int64_t a
 UniValue MarmaraInfo(CPubKey refpk,int32_t firstheight,int32_t lastheight,int64_t minamount,int64_t maxamount,std::string currency);
 
 bool MarmaraValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn);
+void MarmaraConnectBlock(const CBlock &block);
+void MarmaraDisconnectBlock(const CBlock &block);
 
 // CCcustom
 UniValue MarmaraInfo();
@@ -33,4 +33,7 @@ UniValue PegsAccountInfo(const CPubKey& pk,uint256 pegstxid);
 UniValue PegsWorstAccounts(uint256 pegstxid);
 UniValue PegsInfo(uint256 pegstxid);
 
+void PegsConnectBlock(const CBlock &block);
+void PegsDisconnectBlock(const CBlock &block);
+
 #endif
@@ -59,5 +59,8 @@ UniValue PricesList(uint32_t filter, CPubKey mypk);
 UniValue PricesGetOrderbook();
 UniValue PricesRefillFund(int64_t amount);
 
+void PricesConnectBlock(int32_t height);
+void PricesDisconnectBlock(int32_t height);
+
 
 #endif
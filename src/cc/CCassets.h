@@ -25,6 +25,18 @@
 
 #include "CCinclude.h"
 
+/// decoded assets order (bid, ask or swap) kept in the order book index
+struct CAssetOrder
+{
+    uint8_t funcid;
+    uint256 assetid, assetid2;
+    int64_t price;                      // total price from the opret
+    int64_t nValue;                     // remaining order amount in the indexed vout
+    int64_t nValue0;                    // vout0 amount
+    std::vector<uint8_t> origpubkey;
+};
+typedef std::pair<uint256, double> AssetOrderKey;  // tokenid, unit price
+
 // CCcustom
 bool AssetsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn);
 
@@ -42,6 +54,9 @@ bool SetSwapFillamounts(int64_t &paid,int64_t &remaining_price,int64_t orig_nVal
 int64_t AssetValidateBuyvin(struct CCcontract_info *cp,Eval* eval,int64_t &tmpprice,std::vector<uint8_t> &tmporigpubkey,char *CCaddr,char *origaddr,const CTransaction &tx,uint256 refassetid);
 int64_t AssetValidateSellvin(struct CCcontract_info *cp,Eval* eval,int64_t &tmpprice,std::vector<uint8_t> &tmporigpubkey,char *CCaddr,char *origaddr,const CTransaction &tx,uint256 assetid);
 bool AssetCalcAmounts(struct CCcontract_info *cpAssets, int64_t &inputs, int64_t &outputs, Eval* eval, const CTransaction &tx, uint256 assetid);
+void AssetsGetOrders(char *ccaddr, uint256 refassetid, std::vector<std::pair<COutPoint, CAssetOrder> > &orders);
+void AssetsConnectBlock(const CBlock &block);
+void AssetsDisconnectBlock(const CBlock &block);
 
 // CCassetstx
 //int64_t GetAssetBalance(CPubKey pk,uint256 tokenid); // --> GetTokenBalance()
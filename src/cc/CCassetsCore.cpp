@@ -14,6 +14,9 @@
  ******************************************************************************/
 
 #include "CCassets.h"
+#include "CCindex.h"
+
+#include <limits>
 
 /*
  The SetAssetFillamounts() and ValidateAssetRemainder() work in tandem to calculate the vouts for a fill and to validate the vouts, respectively.
@@ -648,3 +651,49 @@ bool AssetCalcAmounts(struct CCcontract_info *cpAssets, int64_t &inputs, int64_t
 		it's now done in Tokens  */
 	return(true);
 }
+
+// order book index: open orders on the assets global cc addresses, sorted by tokenid and unit price
+static bool DecodeAssetOrder(const CTransaction &tx, int32_t vout, AssetOrderKey &key, CAssetOrder &order)
+{
+    uint8_t evalCode;
+
+    if (tx.vout.size() == 0 || vout >= tx.vout.size() - 1 || tx.vout[vout].nValue == 0)
+        return false;
+    if ((order.funcid = DecodeAssetTokenOpRet(tx.vout.back().scriptPubKey, evalCode, order.assetid, order.assetid2, order.price, order.origpubkey)) == 0)
+        return false;
+    order.nValue = tx.vout[vout].nValue;
+    order.nValue0 = tx.vout[0].nValue;
+
+    double unitprice = 0.;
+    if (order.price > 0 && order.nValue0 > 0)
+    {
+        if (order.funcid == 's' || order.funcid == 'S' || order.funcid == 'e' || order.funcid == 'E')
+            unitprice = (double)order.price / order.nValue0;
+        else
+            unitprice = (double)order.nValue0 / order.price;
+    }
+    key = std::make_pair(order.assetid, unitprice);
+    return true;
+}
+
+static CCUnspentsIndex<AssetOrderKey, CAssetOrder> assetOrdersIndex(DecodeAssetOrder);
+
+// returns open orders on the cc address, for all tokens if refassetid is zeroid. Orders created in the mempool are
+// included and orders filled or cancelled in the mempool are left out
+void AssetsGetOrders(char *ccaddr, uint256 refassetid, std::vector<std::pair<COutPoint, CAssetOrder> > &orders)
+{
+    if (refassetid == zeroid)
+        assetOrdersIndex.Get(ccaddr, orders, true);
+    else
+        assetOrdersIndex.GetRange(ccaddr, std::make_pair(refassetid, -1.), std::make_pair(refassetid, std::numeric_limits<double>::infinity()), orders, true);
+}
+
+void AssetsConnectBlock(const CBlock &block)
+{
+    assetOrdersIndex.ConnectBlock(block);
+}
+
+void AssetsDisconnectBlock(const CBlock &block)
+{
+    assetOrdersIndex.DisconnectBlock(block);
+}
@@ -27,94 +27,78 @@ UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
     cpAssets = CCinit(&assetsC, EVAL_ASSETS);
     cpTokens = CCinit(&tokensC, EVAL_TOKENS);
 
-	auto addOrders = [&](struct CCcontract_info *cp, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it)
+	auto addOrders = [&](struct CCcontract_info *cp, const std::pair<COutPoint, CAssetOrder> &order)
 	{
-		uint256 txid, hashBlock, assetid, assetid2;
-		int64_t price;
-		std::vector<uint8_t> origpubkey;
-		CTransaction ordertx;
-		uint8_t funcid, evalCode;
+		uint256 txid = order.first.hash;
+		uint8_t funcid = order.second.funcid;
+		int64_t price = order.second.price;
 		char numstr[32], funcidstr[16], origaddr[64], origtokenaddr[64];
 
-        txid = it->first.txhash;
-        LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking txid=" << txid.GetHex() << std::endl);
-        if ( myGetTransaction(txid, ordertx, hashBlock) != 0 )
+        LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking txid=" << txid.GetHex() << " funcid=" << (char)(funcid ? funcid : ' ') << " assetid=" << order.second.assetid.GetHex() << std::endl);
+
+        if (pk == CPubKey() && (refassetid == zeroid || order.second.assetid == refassetid)  // tokenorders
+            || pk != CPubKey() && pk == pubkey2pk(order.second.origpubkey) && (funcid == 'S' || funcid == 's'))  // mytokenorders, returns only asks (is this correct?)
         {
-			// for logging: funcid = DecodeAssetOpRet(vintx.vout[vintx.vout.size() - 1].scriptPubKey, evalCode, assetid, assetid2, price, origpubkey);
-            if (ordertx.vout.size() > 0 && (funcid = DecodeAssetTokenOpRet(ordertx.vout[ordertx.vout.size()-1].scriptPubKey, evalCode, assetid, assetid2, price, origpubkey)) != 0)
+            UniValue item(UniValue::VOBJ);
+
+            funcidstr[0] = funcid;
+            funcidstr[1] = 0;
+            item.push_back(Pair("funcid", funcidstr));
+            item.push_back(Pair("txid", txid.GetHex()));
+            item.push_back(Pair("vout", (int64_t)order.first.n));
+            if (funcid == 'b' || funcid == 'B')
             {
-                LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking ordertx.vout.size()=" << ordertx.vout.size() << " funcid=" << (char)(funcid ? funcid : ' ') << " assetid=" << assetid.GetHex() << std::endl);
-
-                if (pk == CPubKey() && (refassetid == zeroid || assetid == refassetid)  // tokenorders
-                    || pk != CPubKey() && pk == pubkey2pk(origpubkey) && (funcid == 'S' || funcid == 's'))  // mytokenorders, returns only asks (is this correct?)
+                sprintf(numstr, "%.8f", (double)order.second.nValue / COIN);
+                item.push_back(Pair("amount", numstr));
+                sprintf(numstr, "%.8f", (double)order.second.nValue0 / COIN);
+                item.push_back(Pair("bidamount", numstr));
+            }
+            else
+            {
+                sprintf(numstr, "%llu", (long long)order.second.nValue);
+                item.push_back(Pair("amount", numstr));
+                sprintf(numstr, "%llu", (long long)order.second.nValue0);
+                item.push_back(Pair("askamount", numstr));
+            }
+            if (order.second.origpubkey.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE)
+            {
+                GetCCaddress(cp, origaddr, pubkey2pk(order.second.origpubkey));  
+                item.push_back(Pair("origaddress", origaddr));
+                GetTokensCCaddress(cpTokens, origtokenaddr, pubkey2pk(order.second.origpubkey));
+                item.push_back(Pair("origtokenaddress", origtokenaddr));
+            }
+            if (order.second.assetid != zeroid)
+                item.push_back(Pair("tokenid", order.second.assetid.GetHex()));
+            if (order.second.assetid2 != zeroid)
+                item.push_back(Pair("otherid", order.second.assetid2.GetHex()));
+            if (price > 0)
+            {
+                if (funcid == 's' || funcid == 'S' || funcid == 'e' || funcid == 'E')
                 {
-
-                    LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() it->first.index=" << it->first.index << " ordertx.vout[it->first.index].nValue=" << ordertx.vout[it->first.index].nValue << std::endl);
-                    if (ordertx.vout[it->first.index].nValue == 0) {
-                        LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() order with value=0 skipped" << std::endl);
-                        return;
-                    }
-
-                    UniValue item(UniValue::VOBJ);
-
-                    funcidstr[0] = funcid;
-                    funcidstr[1] = 0;
-                    item.push_back(Pair("funcid", funcidstr));
-                    item.push_back(Pair("txid", txid.GetHex()));
-                    item.push_back(Pair("vout", (int64_t)it->first.index));
-                    if (funcid == 'b' || funcid == 'B')
-                    {
-                        sprintf(numstr, "%.8f", (double)ordertx.vout[it->first.index].nValue / COIN);
-                        item.push_back(Pair("amount", numstr));
-                        sprintf(numstr, "%.8f", (double)ordertx.vout[0].nValue / COIN);
-                        item.push_back(Pair("bidamount", numstr));
-                    }
-                    else
-                    {
-                        sprintf(numstr, "%llu", (long long)ordertx.vout[it->first.index].nValue);
-                        item.push_back(Pair("amount", numstr));
-                        sprintf(numstr, "%llu", (long long)ordertx.vout[0].nValue);
-                        item.push_back(Pair("askamount", numstr));
-                    }
-                    if (origpubkey.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE)
-                    {
-                        GetCCaddress(cp, origaddr, pubkey2pk(origpubkey));  
-                        item.push_back(Pair("origaddress", origaddr));
-                        GetTokensCCaddress(cpTokens, origtokenaddr, pubkey2pk(origpubkey));
-                        item.push_back(Pair("origtokenaddress", origtokenaddr));
-                    }
-                    if (assetid != zeroid)
-                        item.push_back(Pair("tokenid", assetid.GetHex()));
-                    if (assetid2 != zeroid)
-                        item.push_back(Pair("otherid", assetid2.GetHex()));
-                    if (price > 0)
-                    {
-                        if (funcid == 's' || funcid == 'S' || funcid == 'e' || funcid == 'e')
-                        {
-                            sprintf(numstr, "%.8f", (double)price / COIN);
-                            item.push_back(Pair("totalrequired", numstr));
-                            sprintf(numstr, "%.8f", (double)price / (COIN * ordertx.vout[0].nValue));
-                            item.push_back(Pair("price", numstr));
-                        }
-                        else
-                        {
-                            item.push_back(Pair("totalrequired", (int64_t)price));
-                            sprintf(numstr, "%.8f", (double)ordertx.vout[0].nValue / (price * COIN));
-                            item.push_back(Pair("price", numstr));
-                        }
-                    }
-                    result.push_back(item);
-                    LOGSTREAM("ccassets", CCLOG_DEBUG1, stream << "addOrders() added order funcId=" << (char)(funcid ? funcid : ' ') << " it->first.index=" << it->first.index << " ordertx.vout[it->first.index].nValue=" << ordertx.vout[it->first.index].nValue << " tokenid=" << assetid.GetHex() << std::endl);
+                    sprintf(numstr, "%.8f", (double)price / COIN);
+                    item.push_back(Pair("totalrequired", numstr));
+                    sprintf(numstr, "%.8f", (double)price / (COIN * order.second.nValue0));
+                    item.push_back(Pair("price", numstr));
+                }
+                else
+                {
+                    item.push_back(Pair("totalrequired", (int64_t)price));
+                    sprintf(numstr, "%.8f", (double)order.second.nValue0 / (price * COIN));
+                    item.push_back(Pair("price", numstr));
                 }
             }
+            result.push_back(item);
+            LOGSTREAM("ccassets", CCLOG_DEBUG1, stream << "addOrders() added order funcId=" << (char)(funcid ? funcid : ' ') << " vout=" << order.first.n << " nValue=" << order.second.nValue << " tokenid=" << order.second.assetid.GetHex() << std::endl);
         }
 	};
 
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputsTokens, unspentOutputsDualEvalTokens, unspentOutputsCoins;
+    // orders come from the order book index (see AssetsGetOrders), sorted by tokenid and price
+    std::vector<std::pair<COutPoint, CAssetOrder> > ordersTokens, ordersDualEvalTokens, ordersCoins;
+    uint256 filterassetid = (pk == CPubKey()) ? refassetid : zeroid;
 
 	char assetsUnspendableAddr[64];
 	GetCCaddress(cpAssets, assetsUnspendableAddr, GetUnspendable(cpAssets, NULL));
-	SetCCunspents(unspentOutputsCoins, assetsUnspendableAddr,true);
+	AssetsGetOrders(assetsUnspendableAddr, filterassetid, ordersCoins);
 
 	char assetsTokensUnspendableAddr[64];
     std::vector<uint8_t> vopretNonfungible;
@@ -124,19 +108,15 @@ UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
             cpAssets->additionalTokensEvalcode2 = vopretNonfungible.begin()[0];
     }
 	GetTokensCCaddress(cpAssets, assetsTokensUnspendableAddr, GetUnspendable(cpAssets, NULL));
-	SetCCunspents(unspentOutputsTokens, assetsTokensUnspendableAddr,true);
+	AssetsGetOrders(assetsTokensUnspendableAddr, filterassetid, ordersTokens);
 
     // tokenbids:
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator itCoins = unspentOutputsCoins.begin();
-        itCoins != unspentOutputsCoins.end();
-        itCoins++)
-        addOrders(cpAssets, itCoins);
+    for (const auto &order : ordersCoins)
+        addOrders(cpAssets, order);
     
     // tokenasks:
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator itTokens = unspentOutputsTokens.begin();
-		itTokens != unspentOutputsTokens.end();
-		itTokens++)
-		addOrders(cpAssets, itTokens);
+    for (const auto &order : ordersTokens)
+		addOrders(cpAssets, order);
 
     if (additionalEvalCode != 0) {  //this would be mytokenorders
         char assetsDualEvalTokensUnspendableAddr[64];
@@ -144,12 +124,10 @@ UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
         // try also dual eval tokenasks (and we do not need bids):
         cpAssets->additionalTokensEvalcode2 = additionalEvalCode;
         GetTokensCCaddress(cpAssets, assetsDualEvalTokensUnspendableAddr, GetUnspendable(cpAssets, NULL));
-        SetCCunspents(unspentOutputsDualEvalTokens, assetsDualEvalTokensUnspendableAddr,true);
+        AssetsGetOrders(assetsDualEvalTokensUnspendableAddr, zeroid, ordersDualEvalTokens);
 
-        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator itDualEvalTokens = unspentOutputsDualEvalTokens.begin();
-            itDualEvalTokens != unspentOutputsDualEvalTokens.end();
-            itDualEvalTokens++)
-            addOrders(cpAssets, itDualEvalTokens);
+        for (const auto &order : ordersDualEvalTokens)
+            addOrders(cpAssets, order);
     }
     return(result);
 }
@@ -32,6 +32,7 @@
 #include "CCGateways.h"
 #include "CCtokens.h"
 #include "CCImportGateway.h"
+#include "CCindex.h"
 
 /*
  CCcustom has most of the functions that need to be extended to create a new CC contract.
@@ -47,6 +48,7 @@
  4. make helper functions to create rawtx for RPC functions
  5. add rpc calls to rpcserver.cpp and rpcserver.h and in one of the rpc.cpp files
  6. add the new .cpp files to src/Makefile.am
+ 7. if the contract keeps caches or indexes derived from the chain, update them from CCConnectBlock and CCDisconnectBlock below
  
  IMPORTANT: make sure that all CC inputs and CC outputs are properly accounted for and reconcile to the satoshi. The built in utxo management will enforce overall vin/vout constraints but it wont know anything about the CC constraints. That is what your Validate function needs to do.
  
@@ -451,3 +453,50 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
     return(cp);
 }
 
+
+// called from ConnectTip/DisconnectTip with cs_main held, after/before the block becomes part of the active chain
+void CCConnectBlock(const CBlock &block,int32_t height)
+{
+    AssetsConnectBlock(block);
+    PricesConnectBlock(height);
+    PegsConnectBlock(block);
+    GatewaysConnectBlock(block);
+    DiceConnectBlock(block);
+    MarmaraConnectBlock(block);
+    CClib_connectblock(block,height);
+}
+
+void CCDisconnectBlock(const CBlock &block,int32_t height)
+{
+    TokensDisconnectBlock(block);
+    AssetsDisconnectBlock(block);
+    PricesDisconnectBlock(height);
+    PegsDisconnectBlock(block);
+    GatewaysDisconnectBlock(block);
+    DiceDisconnectBlock(block);
+    MarmaraDisconnectBlock(block);
+    CClib_disconnectblock(block,height);
+}
+
+// called from CTxMemPool with its cs held, keeps the mempool outputs of the cc indexes
+void CCMempoolAdd(const CTransaction &tx)
+{
+    if ( ASSETCHAINS_CC == 0 )
+        return;
+    for (CCUnspentsIndexBase *pindex : CCUnspentsIndexBase::Registry())
+        pindex->MempoolAdd(tx);
+}
+
+void CCMempoolRemove(const CTransaction &tx)
+{
+    if ( ASSETCHAINS_CC == 0 )
+        return;
+    for (CCUnspentsIndexBase *pindex : CCUnspentsIndexBase::Registry())
+        pindex->MempoolRemove(tx);
+}
+
+void CCMempoolClear()
+{
+    for (CCUnspentsIndexBase *pindex : CCUnspentsIndexBase::Registry())
+        pindex->MempoolClear();
+}
@@ -32,4 +32,7 @@ UniValue DiceInfo(uint256 diceid);
 UniValue DiceList();
 int64_t DicePlanFunds(uint64_t &entropyval,uint256 &entropytxid,uint64_t refsbits,struct CCcontract_info *cp,CPubKey dicepk,uint256 reffundingtxid, int32_t &entropytxs,bool random);
 
+void DiceConnectBlock(const CBlock &block);
+void DiceDisconnectBlock(const CBlock &block);
+
 #endif
@@ -222,6 +222,29 @@ struct CCcontract_info
 /// @returns pointer to the passed CCcontract_info structure, it must not be freed
 struct CCcontract_info *CCinit(struct CCcontract_info *cp,uint8_t evalcode);
 
+/// updates the chain-derived caches and indexes kept by cc modules when a block is connected to the active chain.
+/// Called from ConnectTip with cs_main held
+/// @param block connected block
+/// @param height height of the connected block
+void CCConnectBlock(const CBlock &block,int32_t height);
+
+/// updates the chain-derived caches and indexes kept by cc modules when a block is disconnected from the active chain.
+/// Called from DisconnectTip with cs_main held
+/// @param block disconnected block
+/// @param height height of the disconnected block
+void CCDisconnectBlock(const CBlock &block,int32_t height);
+
+/// updates the mempool outputs of the cc indexes when a transaction is added to the mempool.
+/// Called from CTxMemPool::addUnchecked with mempool.cs held
+void CCMempoolAdd(const CTransaction &tx);
+
+/// updates the mempool outputs of the cc indexes when a transaction is removed from the mempool.
+/// Called from CTxMemPool::remove with mempool.cs held
+void CCMempoolRemove(const CTransaction &tx);
+
+/// drops the mempool outputs of the cc indexes, called from CTxMemPool::clear
+void CCMempoolClear();
+
 /// \cond INTERNAL
 struct oracleprice_info
 {
@@ -683,6 +706,11 @@ void CCaddrTokens1of2set(struct CCcontract_info *cp, CPubKey pk1, CPubKey pk2, u
 /// @private
 int32_t CClib_initcp(struct CCcontract_info *cp,uint8_t evalcode);
 
+/// @private
+/// CCConnectBlock and CCDisconnectBlock hooks of the modules in the cc library
+void CClib_connectblock(const CBlock &block,int32_t height);
+void CClib_disconnectblock(const CBlock &block,int32_t height);
+
 /// IsCCInput checks if scriptSig object contains a cryptocondition 
 /// @param scriptSig scriptSig object with a cryptocondition
 /// @returns true if the scriptSig object contains a cryptocondition
@@ -0,0 +1,377 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+/*! \file CCindex.h
+ \brief In-memory index of decoded cc outputs on cc addresses
+
+ Many cc modules keep their state (orders, accounts, funding plans, markers) as unspent outputs on a global cc address.
+ Enumerating them with SetCCunspents and then loading and decoding every transaction with myGetTransaction costs
+ time linear in the whole history of the address on each rpc call or validation.
+
+ CCUnspentsIndex keeps the decoded records of such outputs in memory, sorted by a module defined key:
+ - an address is loaded from the address index on first use, after that it is updated incrementally from CCConnectBlock
+ - CCConnectBlock keeps the indexed outputs spent by the block for the last CC_INDEX_MAXUNDO blocks, CCDisconnectBlock
+   removes the outputs the block created and puts them back. Addresses loaded after the block was connected are dropped
+   (their outputs were read with the block applied), as is everything if the block is not in the undo records. Dropped
+   addresses are reloaded on the next query
+ - the mempool may be overlaid on a query: outputs spent in the mempool are skipped and mempool outputs are merged in
+   by key. The decoded mempool outputs are kept per address from the CTxMemPool add and remove hooks (CCMempoolAdd,
+   CCMempoolRemove), so a query does not scan the mempool
+ In nSPV superlite mode the block hooks are not called so each query falls back to a full scan.
+*/
+
+#ifndef CC_INDEX_H
+#define CC_INDEX_H
+
+#include "CCinclude.h"
+#include "main.h"
+#include "txmempool.h"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define CC_INDEX_MAXUNDO 100
+
+/// mempool side of the indexes, every index registers itself so the mempool hooks reach all of them
+class CCUnspentsIndexBase
+{
+public:
+    /// called from CTxMemPool with its cs held
+    virtual void MempoolAdd(const CTransaction &tx) = 0;
+    virtual void MempoolRemove(const CTransaction &tx) = 0;
+    virtual void MempoolClear() = 0;
+
+    static std::vector<CCUnspentsIndexBase *> &Registry()
+    {
+        static std::vector<CCUnspentsIndexBase *> indexes;
+        return indexes;
+    }
+
+protected:
+    CCUnspentsIndexBase() { Registry().push_back(this); }
+    virtual ~CCUnspentsIndexBase() {}
+};
+
+template <class Key, class Record>
+class CCUnspentsIndex : public CCUnspentsIndexBase
+{
+public:
+    /// decodes a cc output into the index key and record, returns false if the output should not be indexed
+    typedef bool (*DecodeFn)(const CTransaction &tx, int32_t vout, Key &key, Record &record);
+    typedef std::vector<std::pair<COutPoint, Record> > Outputs;
+
+    CCUnspentsIndex(DecodeFn decodeIn) : decode(decodeIn) {}
+
+    /// returns the decoded unspent outputs of the cc address ordered by key
+    /// @param coinaddr cc address
+    /// @param outputs vector to which the outputs are appended
+    /// @param fMempool if true outputs spent in the mempool are skipped and outputs created in the mempool are appended
+    void Get(const char *coinaddr, Outputs &outputs, bool fMempool = false)
+    {
+        GetImpl(coinaddr, NULL, NULL, outputs, fMempool);
+    }
+
+    /// returns the decoded unspent outputs of the cc address with keys in [lower, upper) ordered by key
+    void GetRange(const char *coinaddr, const Key &lower, const Key &upper, Outputs &outputs, bool fMempool = false)
+    {
+        GetImpl(coinaddr, &lower, &upper, outputs, fMempool);
+    }
+
+    /// returns the number of confirmed unspent outputs of the cc address, without copying them
+    size_t Count(const char *coinaddr)
+    {
+        Book tmpbook;
+        LOCK2(cs_main, cs);
+        return GetBook(coinaddr, tmpbook)->keys.size();
+    }
+
+    /// called from CCConnectBlock
+    void ConnectBlock(const CBlock &block)
+    {
+        char destaddr[64];
+        LOCK(cs);
+        nConnectSeq++;
+        if (mapBooks.empty())
+            return;
+        if (vUndo.size() >= CC_INDEX_MAXUNDO)
+            vUndo.pop_front();
+        vUndo.push_back(BlockUndo());
+        BlockUndo &undo = vUndo.back();
+        undo.hashBlock = block.GetHash();
+        undo.seq = nConnectSeq;
+        for (const CTransaction &tx : block.vtx)
+        {
+            for (const CTxIn &txin : tx.vin)
+            {
+                std::map<COutPoint, std::string>::iterator it = mapOutpointAddress.find(txin.prevout);
+                if (it != mapOutpointAddress.end())
+                {
+                    Book &book = mapBooks[it->second];
+                    typename std::map<COutPoint, Key>::iterator itkey = book.keys.find(txin.prevout);
+                    if (itkey != book.keys.end())
+                    {
+                        RecordIterator itrecord = book.records.find(std::make_pair(itkey->second, txin.prevout));
+                        if (itrecord != book.records.end())
+                        {
+                            undo.spent.push_back(std::make_pair(it->second, *itrecord));
+                            book.records.erase(itrecord);
+                        }
+                        book.keys.erase(itkey);
+                    }
+                    mapOutpointAddress.erase(it);
+                }
+            }
+            for (int32_t v = 0; v < tx.vout.size(); v++)
+            {
+                if (!tx.vout[v].scriptPubKey.IsPayToCryptoCondition() || !Getscriptaddress(destaddr, tx.vout[v].scriptPubKey))
+                    continue;
+                typename std::map<std::string, Book>::iterator itbook = mapBooks.find(destaddr);
+                Key key; Record record;
+                if (itbook != mapBooks.end() && (*decode)(tx, v, key, record))
+                {
+                    COutPoint outpoint(tx.GetHash(), v);
+                    itbook->second.records[std::make_pair(key, outpoint)] = record;
+                    itbook->second.keys[outpoint] = key;
+                    mapOutpointAddress[outpoint] = itbook->first;
+                }
+            }
+        }
+    }
+
+    /// called from CCDisconnectBlock
+    void DisconnectBlock(const CBlock &block)
+    {
+        LOCK(cs);
+        if (mapBooks.empty() || vUndo.empty() || vUndo.back().hashBlock != block.GetHash())
+        {
+            mapBooks.clear();
+            mapOutpointAddress.clear();
+            vUndo.clear();
+            return;
+        }
+        const BlockUndo &undo = vUndo.back();
+        for (typename std::map<std::string, Book>::iterator itbook = mapBooks.begin(); itbook != mapBooks.end(); )
+        {
+            if (itbook->second.loadseq >= undo.seq)
+            {
+                for (typename std::map<COutPoint, Key>::const_iterator it = itbook->second.keys.begin(); it != itbook->second.keys.end(); it++)
+                    mapOutpointAddress.erase(it->first);
+                itbook = mapBooks.erase(itbook);
+            }
+            else
+                itbook++;
+        }
+        // put back the spent outputs first, an output both created and spent in the block is removed below
+        for (typename std::vector<std::pair<std::string, std::pair<std::pair<Key, COutPoint>, Record> > >::const_iterator it = undo.spent.begin(); it != undo.spent.end(); it++)
+        {
+            typename std::map<std::string, Book>::iterator itbook = mapBooks.find(it->first);
+            if (itbook == mapBooks.end())
+                continue;
+            itbook->second.records[it->second.first] = it->second.second;
+            itbook->second.keys[it->second.first.second] = it->second.first.first;
+            mapOutpointAddress[it->second.first.second] = it->first;
+        }
+        for (const CTransaction &tx : block.vtx)
+        {
+            for (int32_t v = 0; v < tx.vout.size(); v++)
+            {
+                std::map<COutPoint, std::string>::iterator it = mapOutpointAddress.find(COutPoint(tx.GetHash(), v));
+                if (it == mapOutpointAddress.end())
+                    continue;
+                Book &book = mapBooks[it->second];
+                typename std::map<COutPoint, Key>::iterator itkey = book.keys.find(it->first);
+                if (itkey != book.keys.end())
+                {
+                    book.records.erase(std::make_pair(itkey->second, it->first));
+                    book.keys.erase(itkey);
+                }
+                mapOutpointAddress.erase(it);
+            }
+        }
+        vUndo.pop_back();
+    }
+
+    void MempoolAdd(const CTransaction &tx)
+    {
+        char destaddr[64];
+        LOCK(csMempool);
+        for (int32_t v = 0; v < tx.vout.size(); v++)
+        {
+            Key key; Record record;
+            if (tx.vout[v].scriptPubKey.IsPayToCryptoCondition() && Getscriptaddress(destaddr, tx.vout[v].scriptPubKey) && (*decode)(tx, v, key, record))
+            {
+                COutPoint outpoint(tx.GetHash(), v);
+                Book &book = mapMempoolBooks[destaddr];
+                book.records[std::make_pair(key, outpoint)] = record;
+                book.keys[outpoint] = key;
+                mapMempoolOutpointAddress[outpoint] = destaddr;
+            }
+        }
+    }
+
+    void MempoolRemove(const CTransaction &tx)
+    {
+        LOCK(csMempool);
+        if (mapMempoolOutpointAddress.empty())
+            return;
+        for (int32_t v = 0; v < tx.vout.size(); v++)
+        {
+            std::map<COutPoint, std::string>::iterator it = mapMempoolOutpointAddress.find(COutPoint(tx.GetHash(), v));
+            if (it == mapMempoolOutpointAddress.end())
+                continue;
+            typename std::map<std::string, Book>::iterator itbook = mapMempoolBooks.find(it->second);
+            if (itbook != mapMempoolBooks.end())
+            {
+                typename std::map<COutPoint, Key>::iterator itkey = itbook->second.keys.find(it->first);
+                if (itkey != itbook->second.keys.end())
+                {
+                    itbook->second.records.erase(std::make_pair(itkey->second, it->first));
+                    itbook->second.keys.erase(itkey);
+                }
+                if (itbook->second.keys.empty())
+                    mapMempoolBooks.erase(itbook);
+            }
+            mapMempoolOutpointAddress.erase(it);
+        }
+    }
+
+    void MempoolClear()
+    {
+        LOCK(csMempool);
+        mapMempoolBooks.clear();
+        mapMempoolOutpointAddress.clear();
+    }
+
+private:
+    struct Book
+    {
+        std::map<std::pair<Key, COutPoint>, Record> records;
+        std::map<COutPoint, Key> keys;
+        uint64_t loadseq;   // nConnectSeq when the book was loaded
+
+        Book() : loadseq(0) {}
+    };
+
+    // the indexed outputs spent by a connected block, with the address of each
+    struct BlockUndo
+    {
+        uint256 hashBlock;
+        uint64_t seq;
+        std::vector<std::pair<std::string, std::pair<std::pair<Key, COutPoint>, Record> > > spent;
+    };
+
+    typedef typename std::map<std::pair<Key, COutPoint>, Record>::const_iterator RecordIterator;
+
+    CCriticalSection cs;
+    DecodeFn decode;
+    std::map<std::string, Book> mapBooks;
+    std::map<COutPoint, std::string> mapOutpointAddress;
+    uint64_t nConnectSeq = 0;       // number of blocks connected
+    std::deque<BlockUndo> vUndo;    // of the last connected blocks, oldest first
+
+    // outputs created in the mempool, taken after mempool.cs as the hooks are called with it held
+    CCriticalSection csMempool;
+    std::map<std::string, Book> mapMempoolBooks;
+    std::map<COutPoint, std::string> mapMempoolOutpointAddress;
+
+    // loads unspent outputs of the address from the address index
+    void Load(const char *coinaddr, Book &book)
+    {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+        CTransaction tx; uint256 txid, hashBlock;
+
+        SetCCunspents(unspentOutputs, (char *)coinaddr, true);
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++)
+        {
+            if (it->first.txhash != txid)
+            {
+                txid = it->first.txhash;
+                if (myGetTransaction(txid, tx, hashBlock) == 0)
+                {
+                    tx = CTransaction();
+                    continue;
+                }
+            }
+            Key key; Record record;
+            if (tx.vout.size() > it->first.index && (*decode)(tx, (int32_t)it->first.index, key, record))
+            {
+                COutPoint outpoint(txid, (uint32_t)it->first.index);
+                book.records[std::make_pair(key, outpoint)] = record;
+                book.keys[outpoint] = key;
+            }
+        }
+    }
+
+    // returns the book of the address, loading it on first use, or tmpbook loaded with a full scan in superlite mode
+    // caller holds cs_main and cs
+    Book *GetBook(const char *coinaddr, Book &tmpbook)
+    {
+        if (KOMODO_NSPV_SUPERLITE)
+        {
+            Load(coinaddr, tmpbook);
+            return &tmpbook;
+        }
+        typename std::map<std::string, Book>::iterator itbook = mapBooks.find(coinaddr);
+        if (itbook == mapBooks.end())
+        {
+            itbook = mapBooks.insert(std::make_pair(std::string(coinaddr), Book())).first;
+            itbook->second.loadseq = nConnectSeq;
+            Load(coinaddr, itbook->second);
+            for (typename std::map<COutPoint, Key>::const_iterator it = itbook->second.keys.begin(); it != itbook->second.keys.end(); it++)
+                mapOutpointAddress[it->first] = itbook->first;
+        }
+        return &itbook->second;
+    }
+
+    // the records of the book with keys in [*plower, *pupper), an absent bound is open
+    static void Range(const Book &book, const Key *plower, const Key *pupper, RecordIterator &begin, RecordIterator &end)
+    {
+        begin = plower != NULL ? book.records.lower_bound(std::make_pair(*plower, COutPoint())) : book.records.begin();
+        end = pupper != NULL ? book.records.lower_bound(std::make_pair(*pupper, COutPoint())) : book.records.end();
+    }
+
+    void GetImpl(const char *coinaddr, const Key *plower, const Key *pupper, Outputs &outputs, bool fMempool)
+    {
+        Book tmpbook, emptybook, *pbook;
+        RecordIterator it, end, itmempool, endmempool;
+        LOCK2(cs_main, cs);
+        pbook = GetBook(coinaddr, tmpbook);
+        Range(*pbook, plower, pupper, it, end);
+        if (!fMempool || KOMODO_NSPV_SUPERLITE)
+        {
+            for (; it != end; it++)
+                outputs.push_back(std::make_pair(it->first.second, it->second));
+            return;
+        }
+
+        {
+            LOCK2(mempool.cs, csMempool);
+            typename std::map<std::string, Book>::const_iterator itbook = mapMempoolBooks.find(coinaddr);
+            Range(itbook != mapMempoolBooks.end() ? itbook->second : emptybook, plower, pupper, itmempool, endmempool);
+            // merge the confirmed and the mempool runs by key, skipping outputs spent in the mempool
+            while (it != end || itmempool != endmempool)
+            {
+                RecordIterator itnext = (itmempool == endmempool || (it != end && !(itmempool->first < it->first))) ? it++ : itmempool++;
+                if (mempool.mapNextTx.count(itnext->first.second) == 0)
+                    outputs.push_back(std::make_pair(itnext->first.second, itnext->second));
+            }
+        }
+    }
+};
+
+#endif // CC_INDEX_H
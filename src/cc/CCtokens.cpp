@@ -16,6 +16,9 @@
 #include "CCtokens.h"
 #include "importcoin.h"
 
+#include <list>
+#include <tuple>
+
 /* TODO: correct this:
 -----------------------------
  The SetTokenFillamounts() and ValidateTokenRemainder() work in tandem to calculate the vouts for a fill and to validate the vouts, respectively.
@@ -267,12 +270,53 @@ void FilterOutNonCCOprets(const std::vector<std::pair<uint8_t, vscript_t>>  &opr
     }
 }
 
-// Checks if the vout is a really Tokens CC vout
-// also checks tokenid in opret or txid if this is 'c' tx
-// goDeeper is true: the func also validates amounts of the passed transaction: 
-// it should be either sum(cc vins) == sum(cc vouts) or the transaction is the 'tokenbase' ('c') tx
-// checkPubkeys is true: validates if the vout is token vout1 or token vout1of2. Should always be true!
-int64_t IsTokensvout(bool goDeeper, bool checkPubkeys /*<--not used, always true*/, struct CCcontract_info *cp, Eval* eval, const CTransaction& tx, int32_t v, uint256 reftokenid)
+// cache of token amounts for vouts which passed the full IsTokensvout(goDeeper=true) check.
+// The check result depends only on the content of the tx and its ancestors which is committed by txids,
+// so the entries never become wrong; they are dropped when their tx is disconnected to keep the cache on the active chain
+typedef std::tuple<uint256, int32_t, uint256> TokenVoutKey;  // txid, vout, tokenid
+static const size_t TOKENS_VOUTCACHE_MAXSIZE = 100000;
+static CCriticalSection cs_tokenVoutCache;
+static std::list<TokenVoutKey> listTokenVoutCache;  // least recently used first, for eviction
+static std::map<TokenVoutKey, std::pair<int64_t, std::list<TokenVoutKey>::iterator> > mapTokenVoutCache;
+
+static bool TokenVoutCacheGet(const TokenVoutKey &key, int64_t &amount)
+{
+    LOCK(cs_tokenVoutCache);
+    std::map<TokenVoutKey, std::pair<int64_t, std::list<TokenVoutKey>::iterator> >::const_iterator it = mapTokenVoutCache.find(key);
+    if (it == mapTokenVoutCache.end())
+        return false;
+    listTokenVoutCache.splice(listTokenVoutCache.end(), listTokenVoutCache, it->second.second);
+    amount = it->second.first;
+    return true;
+}
+
+static void TokenVoutCachePut(const TokenVoutKey &key, int64_t amount)
+{
+    LOCK(cs_tokenVoutCache);
+    if (mapTokenVoutCache.count(key) != 0)
+        return;
+    listTokenVoutCache.push_back(key);
+    mapTokenVoutCache.insert(std::make_pair(key, std::make_pair(amount, std::prev(listTokenVoutCache.end()))));
+    while (mapTokenVoutCache.size() > TOKENS_VOUTCACHE_MAXSIZE) {
+        mapTokenVoutCache.erase(listTokenVoutCache.front());
+        listTokenVoutCache.pop_front();
+    }
+}
+
+// drops cached token vouts of the disconnected block txns
+void TokensDisconnectBlock(const CBlock &block)
+{
+    LOCK(cs_tokenVoutCache);
+    for (const CTransaction &tx : block.vtx) {
+        std::map<TokenVoutKey, std::pair<int64_t, std::list<TokenVoutKey>::iterator> >::iterator it = mapTokenVoutCache.lower_bound(std::make_tuple(tx.GetHash(), (int32_t)0, zeroid));
+        while (it != mapTokenVoutCache.end() && std::get<0>(it->first) == tx.GetHash()) {
+            listTokenVoutCache.erase(it->second.second);
+            it = mapTokenVoutCache.erase(it);
+        }
+    }
+}
+
+static int64_t IsTokensvoutUncached(bool goDeeper, bool checkPubkeys, struct CCcontract_info *cp, Eval* eval, const CTransaction& tx, int32_t v, uint256 reftokenid)
 {
 
 	// this is just for log messages indentation fur debugging recursive calls:
@@ -501,6 +545,30 @@ int64_t IsTokensvout(bool goDeeper, bool checkPubkeys /*<--not used, always true
 	return(0);
 }
 
+// Checks if the vout is a really Tokens CC vout
+// also checks tokenid in opret or txid if this is 'c' tx
+// goDeeper is true: the func also validates amounts of the passed transaction: 
+// it should be either sum(cc vins) == sum(cc vouts) or the transaction is the 'tokenbase' ('c') tx
+// the results of the goDeeper check are cached so that long token histories are not re-validated on each transfer or balance query
+// checkPubkeys is true: validates if the vout is token vout1 or token vout1of2. Should always be true!
+int64_t IsTokensvout(bool goDeeper, bool checkPubkeys /*<--not used, always true*/, struct CCcontract_info *cp, Eval* eval, const CTransaction& tx, int32_t v, uint256 reftokenid)
+{
+    if (!goDeeper)
+        return IsTokensvoutUncached(goDeeper, checkPubkeys, cp, eval, tx, v, reftokenid);
+
+    TokenVoutKey key(tx.GetHash(), v, reftokenid);
+    int64_t amount;
+    if (TokenVoutCacheGet(key, amount)) {
+        LOGSTREAM((char *)"cctokens", CCLOG_DEBUG2, stream << "IsTokensvout() cached amount=" << amount << " for txid=" << tx.GetHash().GetHex() << " v=" << v << " for tokenid=" << reftokenid.GetHex() << std::endl);
+        return amount;
+    }
+    amount = IsTokensvoutUncached(goDeeper, checkPubkeys, cp, eval, tx, v, reftokenid);
+    // cache only vouts proven valid, a negative result might be caused by a not yet available vintx
+    if (amount > 0 && (eval == NULL || eval->state.IsValid()))
+        TokenVoutCachePut(key, amount);
+    return amount;
+}
+
 bool IsTokenMarkerVout(CTxOut vout) {
     struct CCcontract_info *cpTokens, CCtokens_info;
     cpTokens = CCinit(&CCtokens_info, EVAL_TOKENS);
@@ -114,6 +114,8 @@ std::string CClib_rawtxgen(struct CCcontract_info *cp,uint8_t funcid,cJSON *para
 #ifdef BUILD_ROGUE
 int32_t rogue_replay(uint64_t seed,int32_t sleepmillis);
 bool rogue_validate(struct CCcontract_info *cp,int32_t height,Eval *eval,const CTransaction tx);
+void rogue_connectblock(const CBlock &block);
+void rogue_disconnectblock(const CBlock &block);
 
 UniValue rogue_newgame(uint64_t txfee,struct CCcontract_info *cp,cJSON *params);
 UniValue rogue_pending(uint64_t txfee,struct CCcontract_info *cp,cJSON *params);
@@ -348,6 +350,20 @@ UniValue CClib_info(struct CCcontract_info *cp)
     return(result);
 }
 
+void CClib_connectblock(const CBlock &block,int32_t height)
+{
+#ifdef BUILD_ROGUE
+    rogue_connectblock(block);
+#endif
+}
+
+void CClib_disconnectblock(const CBlock &block,int32_t height)
+{
+#ifdef BUILD_ROGUE
+    rogue_disconnectblock(block);
+#endif
+}
+
 UniValue CClib(struct CCcontract_info *cp,char *method,char *jsonstr)
 {
     UniValue result(UniValue::VOBJ); int32_t i; std::string rawtx; cJSON *params;
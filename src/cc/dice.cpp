@@ -14,6 +14,7 @@
  ******************************************************************************/
 
 #include "CCdice.h"
+#include "CCindex.h"
 
 // timeout
 
@@ -1098,10 +1099,80 @@ uint64_t AddDiceInputs(struct CCcontract_info *cp,CMutableTransaction &mtx,CPubK
     return(totalinputs);
 }
 
+// index of the dice outputs on the dice global address by funding plan, sorted by txid within a plan.
+// DicePlanFunds runs for every bet and bet finish, it used to load every unspent tx of the house (and the vin0 tx of the
+// entropy candidates) on each call. The entropy candidates are now checked once when they are created
+typedef std::pair<uint256,uint64_t> DicePlanKey; // fundingtxid, sbits
+
+struct CDiceUnspent
+{
+    uint8_t funcid;
+    int64_t nValue;
+    CScript fundingScript;      // vout1 of the tx
+    uint256 vin0txid;
+    int32_t vin0status;         // entropy txs: 0 vin0 tx is usable, -1 vin0 tx not found (yet), -2 vin0 tx is a coinbase or strange
+    CScript vin0fundingScript;  // entropy txs: vout1 of the vin0 tx
+};
+
+// looks up the vin0 tx of an entropy tx. A missing vin0 tx is not final, it is looked up again on use
+static void DiceResolveVin0(CDiceUnspent &unspent)
+{
+    CTransaction vinTx; uint256 hashBlock;
+
+    unspent.vin0fundingScript = CScript();
+    if (myGetTransaction(unspent.vin0txid,vinTx,hashBlock) == 0)
+        unspent.vin0status = -1;
+    else if (vinTx.vin.size() == 0 || (int32_t)vinTx.vin[0].prevout.n < 0 || vinTx.vout.size() < 2)
+        unspent.vin0status = -2;
+    else
+    {
+        unspent.vin0status = 0;
+        unspent.vin0fundingScript = vinTx.vout[1].scriptPubKey;
+    }
+}
+
+static bool DecodeDiceUnspent(const CTransaction &tx, int32_t vout, DicePlanKey &key, CDiceUnspent &unspent)
+{
+    std::vector<uint8_t> vopret; uint256 hash,proof;
+
+    if (vout != 0 || tx.vout.size() < 2 || tx.vin.size() == 0)
+        return false;
+    // the mempool hooks pass the cc outputs of every module, only decode dice oprets (DecodeDiceOpRet logs the others)
+    GetOpReturnData(tx.vout[tx.vout.size()-1].scriptPubKey,vopret);
+    if (vopret.size() <= 2 || vopret[0] != EVAL_DICE)
+        return false;
+    if ((unspent.funcid= DecodeDiceOpRet(tx.GetHash(),tx.vout[tx.vout.size()-1].scriptPubKey,key.second,key.first,hash,proof)) == 0)
+        return false;
+    unspent.nValue = tx.vout[0].nValue;
+    unspent.fundingScript = tx.vout[1].scriptPubKey;
+    unspent.vin0txid = tx.vin[0].prevout.hash;
+    unspent.vin0status = 0;
+    unspent.vin0fundingScript = CScript();
+    if (unspent.funcid == 'E' || unspent.funcid == 'W' || unspent.funcid == 'L')
+    {
+        if ((int32_t)tx.vin[0].prevout.n < 0)
+            unspent.vin0status = -2;
+        else DiceResolveVin0(unspent);
+    }
+    return true;
+}
+
+static CCUnspentsIndex<DicePlanKey,CDiceUnspent> diceUnspentsIndex(DecodeDiceUnspent);
+
+void DiceConnectBlock(const CBlock &block)
+{
+    diceUnspentsIndex.ConnectBlock(block);
+}
+
+void DiceDisconnectBlock(const CBlock &block)
+{
+    diceUnspentsIndex.DisconnectBlock(block);
+}
+
 int64_t DicePlanFunds(uint64_t &entropyval,uint256 &entropytxid,uint64_t refsbits,struct CCcontract_info *cp,CPubKey dicepk,uint256 reffundingtxid, int32_t &entropytxs,bool random)
 {
-    char coinaddr[64],str[65]; uint64_t sbits; int64_t nValue,sum,totalinputs = 0; uint256 hash,txid,proof,hashBlock,fundingtxid; CScript fundingPubKey; CTransaction tx,vinTx; int32_t vout,first=0,n=0,i=0,pendingbets=0; uint8_t funcid;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    char coinaddr[64],str[65],addr0[64],addr1[64]; int64_t totalinputs = 0; uint256 txid,hashBlock; CScript fundingPubKey; CTransaction tx; int32_t first=0,n=0,pendingbets=0; uint8_t funcid;
+    std::vector<std::pair<COutPoint,CDiceUnspent> > unspents;
     entropyval = 0;
     entropytxid = zeroid;
     if ( myGetTransaction(reffundingtxid,tx,hashBlock) != 0 && tx.vout.size() > 1 && ConstrainVout(tx.vout[0],1,cp->unspendableCCaddr,0) != 0 )
@@ -1109,18 +1180,15 @@ int64_t DicePlanFunds(uint64_t &entropyval,uint256 &entropytxid,uint64_t refsbit
         fundingPubKey = tx.vout[1].scriptPubKey;
     } else return(0);
     GetCCaddress(cp,coinaddr,dicepk);
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    entropyval = 0;
+    diceUnspentsIndex.GetRange(coinaddr,std::make_pair(reffundingtxid,refsbits),std::make_pair(reffundingtxid,refsbits+1),unspents);
     int loops = 0;
-    int numtxs = unspentOutputs.size()/2;
+    int numtxs = unspents.size();
     int startfrom = rand() % (numtxs+1);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    for (std::vector<std::pair<COutPoint,CDiceUnspent> >::const_iterator it=unspents.begin(); it!=unspents.end(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        if ( vout != 0 )
-            continue;
-        sum += it->second.satoshis;
+        CDiceUnspent unspent = it->second;
+        txid = it->first.hash;
+        funcid = unspent.funcid;
         loops++;
         if (random) {
             if ( loops < startfrom )
@@ -1128,86 +1196,55 @@ int64_t DicePlanFunds(uint64_t &entropyval,uint256 &entropytxid,uint64_t refsbit
             if ( (rand() % 100) < 90 )
                 continue;
         }
-        if ( myGetTransaction(txid,tx,hashBlock) != 0 && tx.vout[vout].scriptPubKey.IsPayToCryptoCondition() != 0 )
+        if ( funcid == 'B' )
         {
-            if ( (funcid= DecodeDiceOpRet(txid,tx.vout[tx.vout.size()-1].scriptPubKey,sbits,fundingtxid,hash,proof)) != 0 && sbits == refsbits )
+            pendingbets++;
+            fprintf(stderr,"%d: %s/v0 (%c %.8f) %.8f\n",n,uint256_str(str,txid),funcid,(double)unspent.nValue/COIN,(double)totalinputs/COIN);
+        }
+        if ( unspent.nValue < 10000 || (funcid != 'R' && funcid != 'F' && funcid != 'E' && funcid != 'W' && funcid != 'L' && funcid != 'T') )
+            continue;
+        if ( funcid == 'L' || funcid == 'W' || funcid == 'E' )
+            n++;
+        totalinputs += unspent.nValue;
+        if ( first != 0 || (funcid != 'E' && funcid != 'W' && funcid != 'L') )
+            continue;
+        if ( fundingPubKey != unspent.fundingScript )
+        {
+            fprintf(stderr,"%s script vs %s (%c) tx vin0 fundingPubKey mismatch %s\n",HexStr(unspent.fundingScript.begin(),unspent.fundingScript.end()).c_str(),HexStr(fundingPubKey.begin(),fundingPubKey.end()).c_str(),funcid,uint256_str(str,unspent.vin0txid));
+            continue;
+        }
+        if ( unspent.vin0status == -1 )
+            DiceResolveVin0(unspent);
+        if ( unspent.vin0status == -1 )
+        {
+            fprintf(stderr,"cant find entropy vin0 %s\n",uint256_str(str,unspent.vin0txid));
+            continue;
+        }
+        if ( unspent.vin0status != 0 )
+        {
+            fprintf(stderr,"skip coinbase or strange entropy tx\n");
+            continue;
+        }
+        if ( reffundingtxid != unspent.vin0txid && unspent.vin0fundingScript != fundingPubKey )
+        {
+            Getscriptaddress(addr0,unspent.vin0fundingScript);
+            Getscriptaddress(addr1,fundingPubKey);
+            if ( strcmp(addr0,addr1) != 0 )
             {
-                if ( funcid == 'B' )
-                {
-                    pendingbets++;
-                    fprintf(stderr,"%d: %s/v%d (%c %.8f) %.8f %.8f\n",n,uint256_str(str,txid),vout,funcid,(double)it->second.satoshis/COIN,(double)totalinputs/COIN,(double)sum/COIN);
-                }
-                if ( (funcid == 'F' && reffundingtxid == txid) || reffundingtxid == fundingtxid )
-                {
-                    //fprintf(stderr,"%d: %s/v%d (%c %.8f) %.8f %.8f\n",n,uint256_str(str,txid),vout,funcid,(double)it->second.satoshis/COIN,(double)totalinputs/COIN,(double)sum/COIN);
-                    if ( (nValue= IsDicevout(cp,tx,vout,refsbits,reffundingtxid)) >= 10000 && (funcid == 'R' || funcid == 'F' || funcid == 'E' || funcid == 'W' || funcid == 'L' || funcid == 'T')  )
-                    {
-                        if ( funcid == 'L' || funcid == 'W' || funcid == 'E' )
-                            n++;
-                        totalinputs += nValue;
-                        if ( first == 0 && (funcid == 'E' || funcid == 'W' || funcid == 'L') )
-                        {
-                            //fprintf(stderr,"check first\n");
-                            if ( tx.vout.size() > 1 && fundingPubKey == tx.vout[1].scriptPubKey )
-                            {
-                                if ( myGetTransaction(tx.vin[0].prevout.hash,vinTx,hashBlock) == 0 || (int32_t)tx.vin[0].prevout.n < 0 )
-                                {
-                                    fprintf(stderr,"cant find entropy vin0 %s or vin0prev %d vouts[%d], iscoinbase.%d\n",uint256_str(str,tx.vin[0].prevout.hash),(int32_t)tx.vin[0].prevout.n,(int32_t)vinTx.vout.size(),(int32_t)vinTx.vin.size());
-                                    continue;
-                                }
-                                if ( (int32_t)vinTx.vin[0].prevout.n < 0 || vinTx.vout.size() < 2 )
-                                {
-                                    fprintf(stderr,"skip coinbase or strange entropy tx\n");
-                                    continue;
-                                }
-                                //if ( fundingtxid != tx.vin[0].prevout.hash && vinTx.vout[tx.vin[0].prevout.n].scriptPubKey != fundingPubKey )
-                                if ( fundingtxid != tx.vin[0].prevout.hash && vinTx.vout[1].scriptPubKey != fundingPubKey )
-                                {
-                                    uint8_t *ptr0,*ptr1; int32_t i; char str[65],addr0[64],addr1[64];
-                                    Getscriptaddress(addr0,vinTx.vout[1].scriptPubKey);
-                                    Getscriptaddress(addr1,fundingPubKey);
-                                    if ( strcmp(addr0,addr1) != 0 )
-                                    {
-                                        ptr0 = (uint8_t *)&vinTx.vout[1].scriptPubKey[0];
-                                        ptr1 = (uint8_t *)&fundingPubKey[0];
-                                        for (i=0; i<vinTx.vout[1].scriptPubKey.size(); i++)
-                                            fprintf(stderr,"%02x",ptr0[i]);
-                                        fprintf(stderr," script vs ");
-                                        for (i=0; i<fundingPubKey.size(); i++)
-                                            fprintf(stderr,"%02x",ptr1[i]);
-                                        fprintf(stderr," (%c) entropy vin.%d fundingPubKey mismatch %s %s vs %s\n",funcid,1,uint256_str(str,tx.vin[0].prevout.hash),addr0,addr1);
-                                        continue;
-                                    }
-                                }
-                                if ( myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0 )
-                                {
-                                    entropytxid = txid;
-                                    entropyval = tx.vout[0].nValue;
-                                    //fprintf(stderr,"funcid.%c first.%d entropytxid.%s val %.8f\n",funcid,first,txid.GetHex().c_str(),(double)entropyval/COIN);
-                                    first = 1;
-                                    if (random) {
-                                        fprintf(stderr, "chosen entropy on loop: %d\n",loops);
-                                    }
-                                }
-                            }
-                            else
-                            {
-                                uint8_t *ptr0,*ptr1; int32_t i; char str[65];
-                                const CScript &s0 = tx.vout[1].scriptPubKey;
-                                for (i=0; i<tx.vout[1].scriptPubKey.size(); i++)
-                                    fprintf(stderr,"%02x",s0[i]);
-                                fprintf(stderr," script vs ");
-                                for (i=0; i<fundingPubKey.size(); i++)
-                                    fprintf(stderr,"%02x",fundingPubKey[i]);
-                                fprintf(stderr," (%c) tx vin.%d fundingPubKey mismatch %s\n",funcid,tx.vin[0].prevout.n,uint256_str(str,tx.vin[0].prevout.hash));
-                            }
-                        }
-                    }
-                    else if ( 0 && funcid != 'B' )
-                        fprintf(stderr,"%s %c refsbits.%llx sbits.%llx nValue %.8f\n",uint256_str(str,txid),funcid,(long long)refsbits,(long long)sbits,(double)nValue/COIN);
-                } //else fprintf(stderr,"else case funcid (%c) %d %s vs %s\n",funcid,funcid,uint256_str(str,reffundingtxid),uint256_str(str2,fundingtxid));
-            } //else fprintf(stderr,"funcid.%d %c skipped %.8f\n",funcid,funcid,(double)tx.vout[vout].nValue/COIN);
-        } i = i + 1;
+                fprintf(stderr,"%s script vs %s (%c) entropy vin.1 fundingPubKey mismatch %s %s vs %s\n",HexStr(unspent.vin0fundingScript.begin(),unspent.vin0fundingScript.end()).c_str(),HexStr(fundingPubKey.begin(),fundingPubKey.end()).c_str(),funcid,uint256_str(str,unspent.vin0txid),addr0,addr1);
+                continue;
+            }
+        }
+        if ( myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,0) == 0 )
+        {
+            entropytxid = txid;
+            entropyval = unspent.nValue;
+            //fprintf(stderr,"funcid.%c first.%d entropytxid.%s val %.8f\n",funcid,first,txid.GetHex().c_str(),(double)entropyval/COIN);
+            first = 1;
+            if (random) {
+                fprintf(stderr, "chosen entropy on loop: %d\n",loops);
+            }
+        }
     }
     if (!random) {
         fprintf(stderr,"pendingbets.%d numentropy tx %d: %.8f\n",pendingbets,n,(double)totalinputs/COIN);
@@ -1216,9 +1253,6 @@ int64_t DicePlanFunds(uint64_t &entropyval,uint256 &entropytxid,uint64_t refsbit
     } else {
         return(0);
     }
-    //fprintf(stderr,"numentropy tx %d: %.8f\n",n,(double)totalinputs/COIN);
-    entropytxs = n;
-    return(totalinputs);
 }
 
 bool DicePlanExists(CScript &fundingPubKey,uint256 &fundingtxid,struct CCcontract_info *cp,uint64_t refsbits,CPubKey dicepk,int64_t &minbet,int64_t &maxbet,int64_t &maxodds,int64_t &timeoutblocks)
@@ -1773,16 +1807,17 @@ double DiceStatus(uint64_t txfee,char *planstr,uint256 fundingtxid,uint256 bettx
             fprintf(stderr,"%s\n", CCerror.c_str() );
             return(0.);
         }
-        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-        SetCCunspents(unspentOutputs,coinaddr,true);
-        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+        // only the pending bets are loaded
+        std::vector<std::pair<COutPoint,CDiceUnspent> > unspents;
+        diceUnspentsIndex.Get(coinaddr,unspents);
+        for (std::vector<std::pair<COutPoint,CDiceUnspent> >::const_iterator it=unspents.begin(); it!=unspents.end(); it++)
         {
-            txid = it->first.txhash;
-            vout = (int32_t)it->first.index;
-            if ( vout != 0 )
+            txid = it->first.hash;
+            vout = 0;
+            sum += it->second.nValue;
+            if ( it->second.funcid != 'B' )
                 continue;
-            sum += it->second.satoshis;
-            if ( myGetTransaction(txid,betTx,hashBlock) != 0 && betTx.vout.size() >= 4 && betTx.vout[vout].scriptPubKey.IsPayToCryptoCondition() != 0 )
+            if ( myGetTransaction(txid,betTx,hashBlock) != 0 && betTx.vout.size() >= 4 )
             {
                 if ( DecodeDiceOpRet(txid,betTx.vout[betTx.vout.size()-1].scriptPubKey,sbits,fundingtxid,hash,proof) == 'B' && sbits == refsbits )
                 {
@@ -1804,7 +1839,7 @@ double DiceStatus(uint64_t txfee,char *planstr,uint256 fundingtxid,uint256 bettx
                         }
                         if ( scriptPubKey != fundingPubKey )
                         {
-                            fprintf(stderr,"serialized bettxid %d: iswin.%d W.%d L.%d %s/v%d (%c %.8f) %.8f\n",n,iswin,win,loss,txid.GetHex().c_str(),vout,funcid,(double)it->second.satoshis/COIN,(double)sum/COIN);
+                            fprintf(stderr,"serialized bettxid %d: iswin.%d W.%d L.%d %s/v%d (%c %.8f) %.8f\n",n,iswin,win,loss,txid.GetHex().c_str(),vout,funcid,(double)it->second.nValue/COIN,(double)sum/COIN);
                             res = DiceBetFinish(funcid,entropyused,entropyvout,&result,txfee,planstr,fundingtxid,txid,scriptPubKey == fundingPubKey,zeroid,-1);
                             if ( result > 0 )
                             {
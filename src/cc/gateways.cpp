@@ -14,6 +14,7 @@
  ******************************************************************************/
 
 #include "CCGateways.h"
+#include "CCindex.h"
 #include "key_io.h"
 
 /*
@@ -1217,14 +1218,109 @@ UniValue GatewaysMarkDone(const CPubKey& pk, uint64_t txfee,uint256 completetxid
     CCERR_RESULT("gatewayscc",CCLOG_INFO, stream << "error adding funds for markdone");
 }
 
+// Indexes of the unspent gateways markers, sorted by bind and coin. The pending and processed lists are polled by the
+// gateway operators, the markers are decoded once when they are created instead of on every poll
+typedef std::pair<uint256,std::string> GatewaysMarkerKey; // bindtxid, coin
+
+// deposit markers on the gateways address of the depositor, spent by the claim
+struct CGatewaysDeposit
+{
+    uint256 cointxid;
+    CPubKey destpub;
+    int64_t amount;
+};
+
+static bool DecodeGatewaysDeposit(const CTransaction &tx, int32_t vout, GatewaysMarkerKey &key, CGatewaysDeposit &deposit)
+{
+    std::vector<CPubKey> publishers; std::vector<uint256> txids; std::vector<uint8_t> proof; std::string hex; int32_t height,claimvout,numvouts=tx.vout.size();
+
+    if (vout!=0 || numvouts<=0 || tx.vout[vout].nValue!=CC_MARKER_VALUE)
+        return false;
+    return (DecodeGatewaysDepositOpRet(tx.vout[numvouts-1].scriptPubKey,key.first,key.second,publishers,txids,height,deposit.cointxid,claimvout,hex,proof,deposit.destpub,deposit.amount)=='D');
+}
+
+// withdraw and partial signing markers on the gateways global address, spent by the next signing
+struct CGatewaysWithdraw
+{
+    uint256 withdrawtxid,tokenid;
+    CPubKey withdrawpub;
+    std::string destaddr;   // address of the withdrawn tokens
+    int64_t value;          // withdrawn tokens
+    uint8_t K;              // number of signatures
+    std::string hex;        // partially signed tx
+};
+
+static bool DecodeGatewaysWithdraw(const CTransaction &tx, int32_t vout, GatewaysMarkerKey &key, CGatewaysWithdraw &withdraw)
+{
+    CTransaction withdrawtx; uint256 hashBlock,withdrawtxid; CPubKey signerpk; std::string coin; int64_t amount; char funcid,destaddr[65]; int32_t numvouts=tx.vout.size();
+
+    if (vout!=0 || numvouts<=0 || tx.vout[vout].nValue!=CC_MARKER_VALUE)
+        return false;
+    withdraw.K=0;
+    withdraw.hex.clear();
+    if ((funcid=DecodeGatewaysOpRet(tx.vout[numvouts-1].scriptPubKey))=='W')
+        withdrawtx=tx;
+    else if (funcid!='P' || DecodeGatewaysPartialOpRet(tx.vout[numvouts-1].scriptPubKey,withdrawtxid,coin,withdraw.K,signerpk,withdraw.hex)!='P' ||
+        myGetTransaction(withdrawtxid,withdrawtx,hashBlock)==0)
+        return false;
+    if ((numvouts=withdrawtx.vout.size())<=1 ||
+        DecodeGatewaysWithdrawOpRet(withdrawtx.vout[numvouts-1].scriptPubKey,withdraw.tokenid,key.first,key.second,withdraw.withdrawpub,amount)!='W')
+        return false;
+    withdraw.withdrawtxid=withdrawtx.GetHash();
+    Getscriptaddress(destaddr,withdrawtx.vout[1].scriptPubKey);
+    withdraw.destaddr=destaddr;
+    withdraw.value=withdrawtx.vout[1].nValue;
+    return true;
+}
+
+// complete signing markers on the gateways global address, spent by markdone
+struct CGatewaysProcessed
+{
+    uint256 withdrawtxid;
+    CPubKey withdrawpub;
+    int64_t value;          // withdrawn tokens
+    std::string hex;        // signed tx
+};
+
+static bool DecodeGatewaysProcessed(const CTransaction &tx, int32_t vout, GatewaysMarkerKey &key, CGatewaysProcessed &processed)
+{
+    CTransaction withdrawtx; uint256 hashBlock,tokenid; std::string coin; int64_t amount; uint8_t K; int32_t numvouts=tx.vout.size();
+
+    if (vout!=0 || numvouts<=0 || tx.vout[vout].nValue!=CC_MARKER_VALUE ||
+        DecodeGatewaysCompleteSigningOpRet(tx.vout[numvouts-1].scriptPubKey,processed.withdrawtxid,key.second,K,processed.hex)!='S' ||
+        myGetTransaction(processed.withdrawtxid,withdrawtx,hashBlock)==0 || (numvouts=withdrawtx.vout.size())<=1 ||
+        DecodeGatewaysWithdrawOpRet(withdrawtx.vout[numvouts-1].scriptPubKey,tokenid,key.first,coin,processed.withdrawpub,amount)!='W')
+        return false;
+    processed.value=withdrawtx.vout[1].nValue;
+    return true;
+}
+
+static CCUnspentsIndex<GatewaysMarkerKey,CGatewaysDeposit> gatewaysDepositsIndex(DecodeGatewaysDeposit);
+static CCUnspentsIndex<GatewaysMarkerKey,CGatewaysWithdraw> gatewaysWithdrawsIndex(DecodeGatewaysWithdraw);
+static CCUnspentsIndex<GatewaysMarkerKey,CGatewaysProcessed> gatewaysProcessedIndex(DecodeGatewaysProcessed);
+
+void GatewaysConnectBlock(const CBlock &block)
+{
+    gatewaysDepositsIndex.ConnectBlock(block);
+    gatewaysWithdrawsIndex.ConnectBlock(block);
+    gatewaysProcessedIndex.ConnectBlock(block);
+}
+
+void GatewaysDisconnectBlock(const CBlock &block)
+{
+    gatewaysDepositsIndex.DisconnectBlock(block);
+    gatewaysWithdrawsIndex.DisconnectBlock(block);
+    gatewaysProcessedIndex.DisconnectBlock(block);
+}
+
 UniValue GatewaysPendingDeposits(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
 {
-    UniValue result(UniValue::VOBJ),pending(UniValue::VARR); CTransaction tx; std::string coin,hex,pub; 
-    CPubKey mypk,gatewayspk,destpub; std::vector<CPubKey> pubkeys,publishers; std::vector<uint256> txids;
-    uint256 tmpbindtxid,hashBlock,txid,tokenid,oracletxid,cointxid; uint8_t M,N,taddr,prefix,prefix2,wiftype;
-    char depositaddr[65],coinaddr[65],str[65],destaddr[65],txidaddr[65]; std::vector<uint8_t> proof;
-    int32_t numvouts,vout,claimvout,height; int64_t totalsupply,nValue,amount; struct CCcontract_info *cp,C;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    UniValue result(UniValue::VOBJ),pending(UniValue::VARR); CTransaction tx; std::string coin,pub;
+    CPubKey mypk,gatewayspk; std::vector<CPubKey> pubkeys;
+    uint256 hashBlock,txid,tokenid,oracletxid; uint8_t M,N,taddr,prefix,prefix2,wiftype;
+    char depositaddr[65],coinaddr[65],str[65],destaddr[65],txidaddr[65];
+    int32_t numvouts; int64_t totalsupply; struct CCcontract_info *cp,C;
+    std::vector<std::pair<COutPoint,CGatewaysDeposit> > deposits;
 
     cp = CCinit(&C,EVAL_GATEWAYS);
     mypk = pk.IsValid()?pk:pubkey2pk(Mypubkey());
@@ -1242,30 +1338,23 @@ UniValue GatewaysPendingDeposits(const CPubKey& pk, uint256 bindtxid,std::string
         result.push_back(Pair("error",strprintf("invalid bindtxid %s coin.%s",uint256_str(str,bindtxid),coin.c_str())));     
         return(result);
     }  
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    gatewaysDepositsIndex.GetRange(coinaddr,std::make_pair(bindtxid,refcoin),std::make_pair(bindtxid,refcoin+'\0'),deposits,true);
+    for (std::vector<std::pair<COutPoint,CGatewaysDeposit> >::const_iterator it=deposits.begin(); it!=deposits.end(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        nValue = (int64_t)it->second.satoshis;
-        if ( vout == 0 && nValue == CC_MARKER_VALUE && myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts=tx.vout.size())>0 &&
-            DecodeGatewaysDepositOpRet(tx.vout[numvouts-1].scriptPubKey,tmpbindtxid,coin,publishers,txids,height,cointxid,claimvout,hex,proof,destpub,amount) == 'D'
-            && tmpbindtxid==bindtxid && refcoin == coin && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0)
-        {   
-            UniValue obj(UniValue::VOBJ);
-            obj.push_back(Pair("cointxid",uint256_str(str,cointxid)));
-            obj.push_back(Pair("deposittxid",uint256_str(str,txid)));  
-            CCtxidaddr(txidaddr,txid);
-            obj.push_back(Pair("deposittxidaddr",txidaddr));              
-            _GetCCaddress(destaddr,EVAL_TOKENS,destpub);
-            obj.push_back(Pair("depositaddr",depositaddr));
-            obj.push_back(Pair("tokens_destination_address",destaddr));
-            pub=HexStr(destpub);
-            obj.push_back(Pair("claim_pubkey",pub));
-            obj.push_back(Pair("amount",(double)amount/COIN));
-            obj.push_back(Pair("confirmed_or_notarized",komodo_txnotarizedconfirmed(txid)));        
-            pending.push_back(obj);
-        }
+        txid = it->first.hash;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("cointxid",uint256_str(str,it->second.cointxid)));
+        obj.push_back(Pair("deposittxid",uint256_str(str,txid)));
+        CCtxidaddr(txidaddr,txid);
+        obj.push_back(Pair("deposittxidaddr",txidaddr));
+        _GetCCaddress(destaddr,EVAL_TOKENS,it->second.destpub);
+        obj.push_back(Pair("depositaddr",depositaddr));
+        obj.push_back(Pair("tokens_destination_address",destaddr));
+        pub=HexStr(it->second.destpub);
+        obj.push_back(Pair("claim_pubkey",pub));
+        obj.push_back(Pair("amount",(double)it->second.amount/COIN));
+        obj.push_back(Pair("confirmed_or_notarized",komodo_txnotarizedconfirmed(txid)));
+        pending.push_back(obj);
     }
     result.push_back(Pair("coin",refcoin));
     result.push_back(Pair("pending",pending));
@@ -1274,11 +1363,11 @@ UniValue GatewaysPendingDeposits(const CPubKey& pk, uint256 bindtxid,std::string
 
 UniValue GatewaysPendingWithdraws(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
 {
-    UniValue result(UniValue::VOBJ),pending(UniValue::VARR); CTransaction tx; std::string coin,hex; CPubKey mypk,gatewayspk,withdrawpub,signerpk;
-    std::vector<CPubKey> msigpubkeys; uint256 hashBlock,tokenid,txid,tmpbindtxid,tmptokenid,oracletxid,withdrawtxid; uint8_t K,M,N,taddr,prefix,prefix2,wiftype;
-    char funcid,depositaddr[65],coinaddr[65],tokensaddr[65],destaddr[65],str[65],withaddr[65],numstr[32],signeraddr[65],txidaddr[65];
-    int32_t i,n,numvouts,vout,queueflag; int64_t totalsupply,amount,nValue; struct CCcontract_info *cp,C;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    UniValue result(UniValue::VOBJ),pending(UniValue::VARR); CTransaction tx; std::string coin; CPubKey mypk,gatewayspk;
+    std::vector<CPubKey> msigpubkeys; uint256 hashBlock,tokenid,oracletxid; uint8_t M,N,taddr,prefix,prefix2,wiftype;
+    char depositaddr[65],coinaddr[65],tokensaddr[65],str[65],withaddr[65],numstr[32],signeraddr[65],txidaddr[65];
+    int32_t i,n,numvouts,queueflag; int64_t totalsupply; struct CCcontract_info *cp,C;
+    std::vector<std::pair<COutPoint,CGatewaysWithdraw> > withdraws;
 
     cp = CCinit(&C,EVAL_GATEWAYS);
     mypk = pk.IsValid()?pk:pubkey2pk(Mypubkey());
@@ -1305,54 +1394,34 @@ UniValue GatewaysPendingWithdraws(const CPubKey& pk, uint256 bindtxid,std::strin
             queueflag = 1;
             break;
         }    
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    gatewaysWithdrawsIndex.GetRange(coinaddr,std::make_pair(bindtxid,refcoin),std::make_pair(bindtxid,refcoin+'\0'),withdraws,true);
+    for (std::vector<std::pair<COutPoint,CGatewaysWithdraw> >::const_iterator it=withdraws.begin(); it!=withdraws.end(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        nValue = (int64_t)it->second.satoshis;
-        K=0;
-        if ( vout == 0 && nValue == CC_MARKER_VALUE && myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts= tx.vout.size())>0 &&
-            (funcid=DecodeGatewaysOpRet(tx.vout[numvouts-1].scriptPubKey))!=0 && (funcid=='W' || funcid=='P') && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0)
+        const CGatewaysWithdraw &withdraw = it->second;
+        if (withdraw.tokenid!=tokenid || withdraw.destaddr!=tokensaddr)
+            continue;
+        GetCustomscriptaddress(withaddr,CScript() << ParseHex(HexStr(withdraw.withdrawpub)) << OP_CHECKSIG,taddr,prefix,prefix2);
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("withdrawtxid",uint256_str(str,withdraw.withdrawtxid)));
+        CCCustomtxidaddr(txidaddr,withdraw.withdrawtxid,taddr,prefix,prefix2);
+        obj.push_back(Pair("withdrawtxidaddr",txidaddr));
+        obj.push_back(Pair("withdrawaddr",withaddr));
+        sprintf(numstr,"%.8f",(double)withdraw.value/COIN);
+        obj.push_back(Pair("amount",numstr));
+        obj.push_back(Pair("confirmed_or_notarized",komodo_txnotarizedconfirmed(withdraw.withdrawtxid)));
+        if ( queueflag != 0 )
         {
-            if (funcid=='W')
-            {
-                if (DecodeGatewaysWithdrawOpRet(tx.vout[numvouts-1].scriptPubKey,tmptokenid,tmpbindtxid,coin,withdrawpub,amount)==0 || refcoin!=coin || tmptokenid!=tokenid || tmpbindtxid!=bindtxid) continue;
-            }
-            else if (funcid=='P')
-            {
-                if (DecodeGatewaysPartialOpRet(tx.vout[numvouts-1].scriptPubKey,withdrawtxid,coin,K,signerpk,hex)!='P' || myGetTransaction(withdrawtxid,tx,hashBlock)==0
-                    || (numvouts=tx.vout.size())<=0 || DecodeGatewaysWithdrawOpRet(tx.vout[numvouts-1].scriptPubKey,tmptokenid,tmpbindtxid,coin,withdrawpub,amount)!='W'
-                    || refcoin!=coin || tmptokenid!=tokenid || tmpbindtxid!=bindtxid)
-                    continue;                    
-            }      
-            Getscriptaddress(destaddr,tx.vout[1].scriptPubKey);
-            GetCustomscriptaddress(withaddr,CScript() << ParseHex(HexStr(withdrawpub)) << OP_CHECKSIG,taddr,prefix,prefix2);
-            if ( strcmp(destaddr,tokensaddr) == 0 )
-            {
-                UniValue obj(UniValue::VOBJ);
-                obj.push_back(Pair("withdrawtxid",uint256_str(str,tx.GetHash())));
-                CCCustomtxidaddr(txidaddr,tx.GetHash(),taddr,prefix,prefix2);
-                obj.push_back(Pair("withdrawtxidaddr",txidaddr));
-                obj.push_back(Pair("withdrawaddr",withaddr));
-                sprintf(numstr,"%.8f",(double)tx.vout[1].nValue/COIN);
-                obj.push_back(Pair("amount",numstr));                
-                obj.push_back(Pair("confirmed_or_notarized",komodo_txnotarizedconfirmed(tx.GetHash())));
-                if ( queueflag != 0 )
-                {
-                    obj.push_back(Pair("depositaddr",depositaddr));
-                    GetCustomscriptaddress(signeraddr,CScript() << ParseHex(HexStr(mypk)) << OP_CHECKSIG,taddr,prefix,prefix2);
-                    obj.push_back(Pair("signeraddr",signeraddr));
-                }
-                if (N>1)
-                {
-                    obj.push_back(Pair("number_of_signs",K));
-                    obj.push_back(Pair("last_txid",uint256_str(str,txid)));
-                    if (K>0) obj.push_back(Pair("hex",hex));
-                }
-                pending.push_back(obj);
-            }
+            obj.push_back(Pair("depositaddr",depositaddr));
+            GetCustomscriptaddress(signeraddr,CScript() << ParseHex(HexStr(mypk)) << OP_CHECKSIG,taddr,prefix,prefix2);
+            obj.push_back(Pair("signeraddr",signeraddr));
+        }
+        if (N>1)
+        {
+            obj.push_back(Pair("number_of_signs",withdraw.K));
+            obj.push_back(Pair("last_txid",uint256_str(str,it->first.hash)));
+            if (withdraw.K>0) obj.push_back(Pair("hex",withdraw.hex));
         }
+        pending.push_back(obj);
     }
     result.push_back(Pair("coin",refcoin));
     result.push_back(Pair("pending",pending));
@@ -1362,12 +1431,12 @@ UniValue GatewaysPendingWithdraws(const CPubKey& pk, uint256 bindtxid,std::strin
 
 UniValue GatewaysProcessedWithdraws(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
 {
-    UniValue result(UniValue::VOBJ),processed(UniValue::VARR); CTransaction tx; std::string coin,hex; 
-    CPubKey mypk,gatewayspk,withdrawpub; std::vector<CPubKey> msigpubkeys;
-    uint256 withdrawtxid,hashBlock,txid,tokenid,tmptokenid,oracletxid; uint8_t K,M,N,taddr,prefix,prefix2,wiftype;
+    UniValue result(UniValue::VOBJ),processed(UniValue::VARR); CTransaction tx; std::string coin;
+    CPubKey mypk,gatewayspk; std::vector<CPubKey> msigpubkeys;
+    uint256 hashBlock,txid,tokenid,oracletxid; uint8_t M,N,taddr,prefix,prefix2,wiftype;
     char depositaddr[65],coinaddr[65],str[65],numstr[32],withaddr[65],txidaddr[65];
-    int32_t i,n,numvouts,vout,queueflag; int64_t totalsupply,nValue,amount; struct CCcontract_info *cp,C;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    int32_t i,n,numvouts,queueflag; int64_t totalsupply; struct CCcontract_info *cp,C;
+    std::vector<std::pair<COutPoint,CGatewaysProcessed> > completed;
 
     cp = CCinit(&C,EVAL_GATEWAYS);
     mypk = pk.IsValid()?pk:pubkey2pk(Mypubkey());
@@ -1393,32 +1462,22 @@ UniValue GatewaysProcessedWithdraws(const CPubKey& pk, uint256 bindtxid,std::str
             queueflag = 1;
             break;
         }    
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    gatewaysProcessedIndex.GetRange(coinaddr,std::make_pair(bindtxid,refcoin),std::make_pair(bindtxid,refcoin+'\0'),completed,true);
+    for (std::vector<std::pair<COutPoint,CGatewaysProcessed> >::const_iterator it=completed.begin(); it!=completed.end(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        nValue = (int64_t)it->second.satoshis;
-        if ( vout == 0 && nValue == CC_MARKER_VALUE && myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts= tx.vout.size())>0 &&
-            DecodeGatewaysCompleteSigningOpRet(tx.vout[numvouts-1].scriptPubKey,withdrawtxid,coin,K,hex) == 'S' && refcoin == coin && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0)
-        {   
-            if (myGetTransaction(withdrawtxid,tx,hashBlock) != 0 && (numvouts= tx.vout.size())>0
-                && DecodeGatewaysWithdrawOpRet(tx.vout[numvouts-1].scriptPubKey,tmptokenid,bindtxid,coin,withdrawpub,amount) == 'W' || refcoin!=coin || tmptokenid!=tokenid)          
-            {
-                UniValue obj(UniValue::VOBJ);
-                obj.push_back(Pair("completesigningtxid",uint256_str(str,txid)));
-                obj.push_back(Pair("withdrawtxid",uint256_str(str,withdrawtxid)));  
-                CCCustomtxidaddr(txidaddr,withdrawtxid,taddr,prefix,prefix2);
-                obj.push_back(Pair("withdrawtxidaddr",txidaddr));              
-                GetCustomscriptaddress(withaddr,CScript() << ParseHex(HexStr(withdrawpub)) << OP_CHECKSIG,taddr,prefix,prefix2);
-                obj.push_back(Pair("withdrawaddr",withaddr));
-                obj.push_back(Pair("confirmed_or_notarized",komodo_txnotarizedconfirmed(txid)));
-                sprintf(numstr,"%.8f",(double)tx.vout[1].nValue/COIN);
-                obj.push_back(Pair("amount",numstr));
-                obj.push_back(Pair("hex",hex));                
-                processed.push_back(obj);            
-            }
-        }
+        txid = it->first.hash;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("completesigningtxid",uint256_str(str,txid)));
+        obj.push_back(Pair("withdrawtxid",uint256_str(str,it->second.withdrawtxid)));
+        CCCustomtxidaddr(txidaddr,it->second.withdrawtxid,taddr,prefix,prefix2);
+        obj.push_back(Pair("withdrawtxidaddr",txidaddr));
+        GetCustomscriptaddress(withaddr,CScript() << ParseHex(HexStr(it->second.withdrawpub)) << OP_CHECKSIG,taddr,prefix,prefix2);
+        obj.push_back(Pair("withdrawaddr",withaddr));
+        obj.push_back(Pair("confirmed_or_notarized",komodo_txnotarizedconfirmed(txid)));
+        sprintf(numstr,"%.8f",(double)it->second.value/COIN);
+        obj.push_back(Pair("amount",numstr));
+        obj.push_back(Pair("hex",it->second.hex));
+        processed.push_back(obj);
     }
     result.push_back(Pair("coin",refcoin));
     result.push_back(Pair("processed",processed));
@@ -14,6 +14,7 @@
  ******************************************************************************/
 
 #include "CCMarmara.h"
+#include "CCindex.h"
 
 /*
  Marmara CC is for the MARMARA project
@@ -154,13 +155,54 @@ int32_t MarmaraGetcreatetxid(uint256 &createtxid,uint256 txid)
     return(-1);
 }
 
+// credit loop index: the confirmed hops of the loops queried so far, createtxid -> [createtxid, hop1, ..., last hop]
+// loops are extended from MarmaraConnectBlock with the spends of the last hop's baton and dropped on disconnect,
+// or all at once when MARMARA_MAX_CACHED_LOOPS were queried
+#define MARMARA_MAX_CACHED_LOOPS 10000
+static CCriticalSection cs_marmaraloops;
+static std::map<uint256,std::vector<uint256> > mapMarmaraLoops;
+static std::map<uint256,uint256> mapMarmaraLoopTails; // last hop -> createtxid
+
+static void MarmaraGetLoopHops(uint256 createtxid,std::vector<uint256> &hops)
+{
+    uint256 txid,spenttxid; int32_t vini,height;
+    LOCK2(cs_main,cs_marmaraloops);
+    std::map<uint256,std::vector<uint256> >::const_iterator it = mapMarmaraLoops.find(createtxid);
+    if ( it != mapMarmaraLoops.end() )
+    {
+        hops = it->second;
+        return;
+    }
+    hops.push_back(createtxid);
+    txid = createtxid;
+    while ( CCgetspenttxid(spenttxid,vini,height,txid,0) == 0 && height > 0 ) // mempool spends have no height
+    {
+        hops.push_back(spenttxid);
+        txid = spenttxid;
+    }
+    if ( !KOMODO_NSPV_SUPERLITE )
+    {
+        if ( mapMarmaraLoops.size() >= MARMARA_MAX_CACHED_LOOPS )
+        {
+            mapMarmaraLoops.clear();
+            mapMarmaraLoopTails.clear();
+        }
+        mapMarmaraLoops[createtxid] = hops;
+        mapMarmaraLoopTails[hops.back()] = createtxid;
+    }
+}
+
 int32_t MarmaraGetbatontxid(std::vector<uint256> &creditloop,uint256 &batontxid,uint256 txid)
 {
-    uint256 createtxid,spenttxid; int64_t value; int32_t vini,height,n=0,vout = 0;
+    uint256 createtxid,spenttxid; std::vector<uint256> hops; int64_t value; int32_t vini,height,n=0,vout = 0;
     memset(&batontxid,0,sizeof(batontxid));
     if ( MarmaraGetcreatetxid(createtxid,txid) == 0 )
     {
-        txid = createtxid;
+        // resume from the hop before the last confirmed one, so the baton is checked and mempool spends followed as before
+        MarmaraGetLoopHops(createtxid,hops);
+        n = hops.size() > 1 ? (int32_t)hops.size() - 2 : 0;
+        creditloop.insert(creditloop.end(),hops.begin(),hops.begin() + n);
+        txid = hops[n];
         //fprintf(stderr,"txid.%s -> createtxid %s\n",txid.GetHex().c_str(),createtxid.GetHex().c_str());
         while ( CCgetspenttxid(spenttxid,vini,height,txid,vout) == 0 )
         {
@@ -661,37 +703,74 @@ UniValue MarmaraSettlement(uint64_t txfee,uint256 refbatontxid)
     return(result);
 }
 
+// open issuances index: unspent 'I' markers on the Marmara global address, sorted by currency and maturity
+struct CMarmaraIssuance
+{
+    CPubKey senderpk;
+    int64_t amount;
+};
+
+static bool DecodeMarmaraIssuance(const CTransaction &tx,int32_t vout,std::pair<std::string,int32_t> &key,CMarmaraIssuance &issuance)
+{
+    uint256 createtxid; int32_t numvouts;
+    if ( vout != 1 || tx.IsCoinBase() != 0 || (numvouts= tx.vout.size()) <= 2 || tx.vout[numvouts - 1].nValue != 0 )
+        return(false);
+    return(MarmaraDecodeLoopOpret(tx.vout[numvouts-1].scriptPubKey,createtxid,issuance.senderpk,issuance.amount,key.second,key.first) == 'I');
+}
+
+static CCUnspentsIndex<std::pair<std::string,int32_t>,CMarmaraIssuance> marmaraIssuancesIndex(DecodeMarmaraIssuance);
+
 int32_t MarmaraGetCreditloops(int64_t &totalamount,std::vector<uint256> &issuances,int64_t &totalclosed,std::vector<uint256> &closed,struct CCcontract_info *cp,int32_t firstheight,int32_t lastheight,int64_t minamount,int64_t maxamount,CPubKey refpk,std::string refcurrency)
 {
-    char coinaddr[64]; CPubKey Marmarapk,senderpk; int64_t amount; uint256 createtxid,txid,hashBlock; CTransaction tx; int32_t numvouts,vout,matures,n=0; std::string currency;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    char coinaddr[64]; CPubKey Marmarapk; std::vector<std::pair<COutPoint,CMarmaraIssuance> > matching;
     Marmarapk = GetUnspendable(cp,0);
     GetCCaddress(cp,coinaddr,Marmarapk);
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    // do all txid, conditional on spent/unspent
-    //fprintf(stderr,"check coinaddr.(%s)\n",coinaddr);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    if ( firstheight <= lastheight )
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        //fprintf(stderr,"txid.%s/v%d\n",txid.GetHex().c_str(),vout);
-        if ( vout == 1 && myGetTransaction(txid,tx,hashBlock) != 0 )
+        // the range is half open, past INT32_MAX the first key of the next currency (same string with a trailing nul) is the upper bound
+        std::pair<std::string,int32_t> upper = lastheight < INT32_MAX ? std::make_pair(refcurrency,lastheight+1) : std::make_pair(refcurrency+std::string(1,'\0'),(int32_t)INT32_MIN);
+        marmaraIssuancesIndex.GetRange(coinaddr,std::make_pair(refcurrency,firstheight),upper,matching);
+    }
+    for (std::vector<std::pair<COutPoint,CMarmaraIssuance> >::const_iterator it=matching.begin(); it!=matching.end(); it++)
+    {
+        if ( it->second.amount >= minamount && it->second.amount <= maxamount && (refpk.size() == 0 || it->second.senderpk == refpk) )
+        {
+            issuances.push_back(it->first.hash);
+            totalamount += it->second.amount;
+        }
+    }
+    return((int32_t)marmaraIssuancesIndex.Count(coinaddr));
+}
+
+void MarmaraConnectBlock(const CBlock &block)
+{
+    marmaraIssuancesIndex.ConnectBlock(block);
+    LOCK(cs_marmaraloops);
+    if ( mapMarmaraLoopTails.empty() )
+        return;
+    for (const CTransaction &tx : block.vtx)
+    {
+        for (const CTxIn &txin : tx.vin)
         {
-            if ( tx.IsCoinBase() == 0 && (numvouts= tx.vout.size()) > 2 && tx.vout[numvouts - 1].nValue == 0 )
+            std::map<uint256,uint256>::iterator it;
+            if ( txin.prevout.n == 0 && (it= mapMarmaraLoopTails.find(txin.prevout.hash)) != mapMarmaraLoopTails.end() )
             {
-                if ( MarmaraDecodeLoopOpret(tx.vout[numvouts-1].scriptPubKey,createtxid,senderpk,amount,matures,currency) == 'I' )
-                {
-                    n++;
-                    if ( currency == refcurrency && matures >= firstheight && matures <= lastheight && amount >= minamount && amount <= maxamount && (refpk.size() == 0 || senderpk == refpk) )
-                    {
-                        issuances.push_back(txid);
-                        totalamount += amount;
-                    }
-                }
+                uint256 createtxid = it->second;
+                mapMarmaraLoopTails.erase(it);
+                mapMarmaraLoops[createtxid].push_back(tx.GetHash());
+                mapMarmaraLoopTails[tx.GetHash()] = createtxid;
+                break;
             }
-        } else fprintf(stderr,"error getting tx\n");
+        }
     }
-    return(n);
+}
+
+void MarmaraDisconnectBlock(const CBlock &block)
+{
+    marmaraIssuancesIndex.DisconnectBlock(block);
+    LOCK(cs_marmaraloops);
+    mapMarmaraLoops.clear();
+    mapMarmaraLoopTails.clear();
 }
 
 UniValue MarmaraReceive(uint64_t txfee,CPubKey senderpk,int64_t amount,std::string currency,int32_t matures,uint256 batontxid,bool automaticflag)
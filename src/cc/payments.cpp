@@ -278,18 +278,15 @@ bool payments_lockedblocks(uint256 blockhash,int32_t lockedblocks,int32_t &block
 int32_t payments_getallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations)
 {
     mpz_t mpzAllocation; int32_t i =0;
+    std::set<CScript> excluded;
+    for ( auto skipkey : excludeScriptPubKeys ) 
+        excluded.insert(CScript(skipkey.begin(), skipkey.end()));
     for (int32_t j = bottom; j < vAddressSnapshot.size(); j++)
     {
         auto &address = vAddressSnapshot[j];
         CScript scriptPubKey = GetScriptForDestination(address.second); 
-        bool skip = false;
         // skip excluded addresses. 
-        for ( auto skipkey : excludeScriptPubKeys ) 
-        {
-            if ( scriptPubKey == CScript(skipkey.begin(), skipkey.end()) )
-                skip = true;
-        }
-        if ( !skip )
+        if ( excluded.count(scriptPubKey) == 0 )
         {
             mpz_init(mpzAllocation); 
             i++;
@@ -16,7 +16,11 @@
 #include "CCPegs.h"
 #include "../importcoin.h"
 #include "key_io.h"
+#include "CCindex.h"
 #include <gmp.h>
+#include <limits>
+#include <set>
+#include <tuple>
 
 
 /*
@@ -589,44 +593,141 @@ double PegsGetAccountRatio(uint256 pegstxid,uint256 tokenid,uint256 accounttxid)
     return (0);
 }
 
-double PegsGetGlobalRatio(uint256 pegstxid)
+// account index: unspent account markers on the pegs global address, sorted by pegs, token and (debt+1) per deposited token
+// for a given token the account ratio grows with debt per deposit, so the accounts with the worst ratio are at the end of the range.
+// the +1 covers the floor of the deposit value in PegsGetRatio, see PegsRatioLowerBound
+typedef std::tuple<uint256,uint256,double> PegsAccountKey;
+
+struct CPegsAccount
 {
-    char coinaddr[64]; int64_t nValue,amount,globaldebt=0; uint256 txid,accounttxid,hashBlock,tmppegstxid,tokenid;
-    CTransaction tx; int32_t numvouts,vout; char funcid; CPubKey mypk,pegspk,pk;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs; std::pair<int64_t,int64_t> account;
-    std::map<uint256,std::pair<int64_t,int64_t>> globalaccounts;
-    struct CCcontract_info *cp,C;
+    char funcid;
+    uint256 tokenid;
+    std::pair<int64_t,int64_t> account;
+};
+
+static bool DecodePegsAccount(const CTransaction &tx, int32_t vout, PegsAccountKey &key, CPegsAccount &acc)
+{
+    uint256 pegstxid; CPubKey pk; int64_t amount;
+
+    if (vout != 0 || tx.vout.size() < 2 || tx.vout[vout].nValue != CC_MARKER_VALUE)
+        return false;
+    if ((acc.funcid=DecodePegsOpRet(tx,pegstxid,acc.tokenid))==0)
+        return false;
+    PegsDecodeAccountTx(tx,pk,amount,acc.account);
+    key = std::make_tuple(pegstxid,acc.tokenid,acc.account.first>0?(double)(acc.account.second+1)/acc.account.first:std::numeric_limits<double>::infinity());
+    return true;
+}
+
+// token deposits index: tokens locked on the pegs tokens address, sorted by pegs and token, the record is (tokenid, amount)
+static bool DecodePegsDeposit(const CTransaction &tx, int32_t vout, std::pair<uint256,uint256> &key, std::pair<uint256,int64_t> &deposit)
+{
+    if (tx.vout.size() < 2 || vout >= tx.vout.size()-1 || DecodePegsOpRet(tx,key.first,key.second)==0)
+        return false;
+    deposit = std::make_pair(key.second,tx.vout[vout].nValue);
+    return true;
+}
+
+static CCUnspentsIndex<PegsAccountKey,CPegsAccount> pegsAccountsIndex(DecodePegsAccount);
+static CCUnspentsIndex<std::pair<uint256,uint256>,std::pair<uint256,int64_t>> pegsDepositsIndex(DecodePegsDeposit);
+
+// global (deposit, debt) totals per token, calculated once per block
+// the generation is bumped on every connect/disconnect so totals calculated across a block change are not stored
+static CCriticalSection cs_pegstotals;
+static std::map<uint256,std::map<uint256,std::pair<int64_t,int64_t>>> mapPegsTotals;
+static uint64_t nPegsTotalsGeneration = 0;
+
+static void PegsGetAccounts(uint256 pegstxid,uint256 tokenid,double lower,double upper,std::vector<std::pair<COutPoint,CPegsAccount>> &accounts)
+{
+    char coinaddr[64]; struct CCcontract_info *cp,C; CPubKey pegspk;
 
     cp = CCinit(&C,EVAL_PEGS);
     pegspk = GetUnspendable(cp,0);
     GetCCaddress1of2(cp,coinaddr,pegspk,pegspk);
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    pegsAccountsIndex.GetRange(coinaddr,std::make_tuple(pegstxid,tokenid,lower),std::make_tuple(pegstxid,tokenid,upper),accounts);
+}
+
+static void PegsGetAllAccounts(uint256 pegstxid,std::vector<std::pair<COutPoint,CPegsAccount>> &accounts)
+{
+    char coinaddr[64]; struct CCcontract_info *cp,C; CPubKey pegspk;
+    uint256 maxtokenid = uint256S(std::string(64,'f'));
+
+    cp = CCinit(&C,EVAL_PEGS);
+    pegspk = GetUnspendable(cp,0);
+    GetCCaddress1of2(cp,coinaddr,pegspk,pegspk);
+    pegsAccountsIndex.GetRange(coinaddr,std::make_tuple(pegstxid,zeroid,-1.),std::make_tuple(pegstxid,maxtokenid,std::numeric_limits<double>::infinity()),accounts);
+}
+
+// lower bound of the account key for the accounts with the ratio above the threshold
+// PegsGetRatio divides by floor(deposit*price/COIN) > deposit*price/COIN-1, so ratio > R implies
+// 100*debt > R*(deposit*price/COIN-1), and for R <= 100 that gives (debt+1)/deposit > R*price/(100*COIN).
+// a higher threshold only narrows the accounts, so it is clamped to 100, the small margin covers the double rounding
+static double PegsRatioLowerBound(uint256 tokenid,double ratio)
+{
+    int64_t price;
+
+    if ((price=PegsGetTokenPrice(tokenid))<=0)
+        return std::numeric_limits<double>::infinity();
+    return (std::min(ratio,100.)*price/(100.*COIN)*(1-1e-9));
+}
+
+static std::map<uint256,std::pair<int64_t,int64_t>> PegsGetGlobalTotals(uint256 pegstxid)
+{
+    char coinaddr[64]; struct CCcontract_info *cp,C; CPubKey pegspk;
+    std::vector<std::pair<COutPoint,CPegsAccount>> accounts; std::vector<std::pair<COutPoint,std::pair<uint256,int64_t>>> deposits;
+    uint256 maxtokenid = uint256S(std::string(64,'f'));
+    std::map<uint256,std::pair<int64_t,int64_t>> globalaccounts; uint64_t generation;
+
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        nValue = (int64_t)it->second.satoshis;
-        if (vout == 0 && nValue == CC_MARKER_VALUE && myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts=tx.vout.size())>0 &&
-            (funcid=DecodePegsOpRet(tx,tmppegstxid,tokenid))!=0 && pegstxid==tmppegstxid && (funcid=='F' || funcid=='G' || funcid=='E'))
-        {              
-            PegsDecodeAccountTx(tx,pk,amount,account);
-            globalaccounts[tokenid].first+=account.first;
-            globalaccounts[tokenid].second+=account.second;
-        }
+        LOCK(cs_pegstotals);
+        std::map<uint256,std::map<uint256,std::pair<int64_t,int64_t>>>::const_iterator it=mapPegsTotals.find(pegstxid);
+        if (it!=mapPegsTotals.end())
+            return (it->second);
+        generation=nPegsTotalsGeneration;
     }
-    unspentOutputs.clear();
-    GetTokensCCaddress(cp,coinaddr,pegspk);
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    PegsGetAllAccounts(pegstxid,accounts);
+    for (std::vector<std::pair<COutPoint,CPegsAccount>>::const_iterator it=accounts.begin(); it!=accounts.end(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        nValue = (int64_t)it->second.satoshis;
-        if (myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts=tx.vout.size())>0 && DecodePegsOpRet(tx,tmppegstxid,tokenid)!=0 && pegstxid==tmppegstxid)
+        if (it->second.funcid=='F' || it->second.funcid=='G' || it->second.funcid=='E')
         {
-            globalaccounts[tokenid].first+=nValue;
+            globalaccounts[it->second.tokenid].first+=it->second.account.first;
+            globalaccounts[it->second.tokenid].second+=it->second.account.second;
         }
     }
+    cp = CCinit(&C,EVAL_PEGS);
+    pegspk = GetUnspendable(cp,0);
+    GetTokensCCaddress(cp,coinaddr,pegspk);
+    pegsDepositsIndex.GetRange(coinaddr,std::make_pair(pegstxid,zeroid),std::make_pair(pegstxid,maxtokenid),deposits);
+    for (std::vector<std::pair<COutPoint,std::pair<uint256,int64_t>>>::const_iterator it=deposits.begin(); it!=deposits.end(); it++)
+        globalaccounts[it->second.first].first+=it->second.second;
+    LOCK(cs_pegstotals);
+    if (generation==nPegsTotalsGeneration)
+        mapPegsTotals[pegstxid]=globalaccounts;
+    return (globalaccounts);
+}
+
+void PegsConnectBlock(const CBlock &block)
+{
+    pegsAccountsIndex.ConnectBlock(block);
+    pegsDepositsIndex.ConnectBlock(block);
+    LOCK(cs_pegstotals);
+    nPegsTotalsGeneration++;
+    mapPegsTotals.clear();
+}
+
+void PegsDisconnectBlock(const CBlock &block)
+{
+    pegsAccountsIndex.DisconnectBlock(block);
+    pegsDepositsIndex.DisconnectBlock(block);
+    LOCK(cs_pegstotals);
+    nPegsTotalsGeneration++;
+    mapPegsTotals.clear();
+}
+
+double PegsGetGlobalRatio(uint256 pegstxid)
+{
+    int64_t globaldebt=0; std::map<uint256,std::pair<int64_t,int64_t>> globalaccounts;
+
+    globalaccounts=PegsGetGlobalTotals(pegstxid);
     mpz_t res,globaldeposit,a,b;
     mpz_init(res);
     mpz_init(globaldeposit);
@@ -655,38 +756,28 @@ double PegsGetGlobalRatio(uint256 pegstxid)
 
 std::string PegsFindBestAccount(struct CCcontract_info *cp,uint256 pegstxid, uint256 tokenid, int64_t tokenamount,uint256 &accounttxid, std::pair<int64_t,int64_t> &account)
 {
-    char coinaddr[64]; int64_t nValue,tmpamount; uint256 txid,hashBlock,tmptokenid,tmppegstxid;
-    CTransaction tx,acctx; int32_t numvouts,vout; char funcid,f; CPubKey pegspk,tmppk;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    ImportProof proof; CTransaction burntx; std::vector<CTxOut> payouts; double ratio,maxratio=0;
-    std::pair<int64_t,int64_t> tmpaccount;
+    int64_t tmpamount; uint256 hashBlock; CTransaction tx,acctx; CPubKey tmppk; double ratio,minratio,maxratio=0;
+    std::vector<std::pair<COutPoint,CPegsAccount>> accounts;
 
     accounttxid=zeroid;
-    pegspk = GetUnspendable(cp,0);
-    GetCCaddress1of2(cp,coinaddr,pegspk,pegspk);
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    minratio=ASSETCHAINS_PEGSCCPARAMS[2]?ASSETCHAINS_PEGSCCPARAMS[2]:PEGS_ACCOUNT_YELLOW_ZONE;
+    PegsGetAccounts(pegstxid,tokenid,PegsRatioLowerBound(tokenid,minratio),std::numeric_limits<double>::infinity(),accounts);
+    // the key only approximates the ratio order, so the highest ratio is picked from the whole range above the bound
+    for (std::vector<std::pair<COutPoint,CPegsAccount>>::reverse_iterator it=accounts.rbegin(); it!=accounts.rend(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        nValue = (int64_t)it->second.satoshis;
-        LOGSTREAM("pegscc",CCLOG_DEBUG2, stream << "txid=" << txid.GetHex() << ", vout=" << vout << ", nValue=" << nValue << std::endl);
-        if (vout == 0 && nValue == CC_MARKER_VALUE && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,0) == 0 &&
-            (ratio=PegsGetAccountRatio(pegstxid,tokenid,txid))>(ASSETCHAINS_PEGSCCPARAMS[2]?ASSETCHAINS_PEGSCCPARAMS[2]:PEGS_ACCOUNT_YELLOW_ZONE) && ratio>maxratio)
-        {   
-            if (myGetTransaction(txid,tx,hashBlock)!=0 && !PegsDecodeAccountTx(tx,tmppk,tmpamount,tmpaccount).empty() && tmpaccount.first>=tokenamount)
-            {
-                accounttxid=txid;
-                acctx=tx;
-                maxratio=ratio;
-            }
+        LOGSTREAM("pegscc",CCLOG_DEBUG2, stream << "txid=" << it->first.hash.GetHex() << ", vout=" << it->first.n << std::endl);
+        if (it->second.account.first<tokenamount || (ratio=PegsGetRatio(tokenid,it->second.account))<=minratio || ratio<=maxratio)
+            continue;
+        if (myIsutxo_spentinmempool(ignoretxid,ignorevin,it->first.hash,0) == 0 && myGetTransaction(it->first.hash,tx,hashBlock)!=0)
+        {
+            accounttxid=it->first.hash;
+            acctx=tx;
+            maxratio=ratio;
         }
     }
     if (accounttxid!=zeroid)
-    {
         return(PegsDecodeAccountTx(acctx,tmppk,tmpamount,account));
-    }
-    else return("");
+    return("");
 }
 
 UniValue PegsCreate(const CPubKey& pk,uint64_t txfee,int64_t amount, std::vector<uint256> bindtxids)
@@ -1172,55 +1263,54 @@ UniValue PegsAccountInfo(const CPubKey& pk,uint256 pegstxid)
 
 UniValue PegsWorstAccounts(uint256 pegstxid)
 {
-    char coinaddr[64]; int64_t nValue,amount; uint256 txid,accounttxid,hashBlock,tmppegstxid,tokenid,prev;
-    CTransaction tx; int32_t numvouts,vout; char funcid; CPubKey pegspk,pk; double ratio; std::vector<uint256> bindtxids;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs; std::pair<int64_t,int64_t> account;
-    UniValue result(UniValue::VOBJ),acc(UniValue::VARR); struct CCcontract_info *cp,C; std::multimap<uint256,UniValue> map;
+    int32_t numvouts; uint256 hashBlock,tokenid,oracletxid; CTransaction tx; double ratio; std::vector<uint256> bindtxids;
+    std::vector<std::pair<COutPoint,CPegsAccount>> accounts; std::set<uint256> tokenids; char depositaddr[64]; std::string coin;
+    int64_t totalsupply; uint8_t M,N,taddr,prefix,prefix2,wiftype; std::vector<CPubKey> pubkeys;
+    std::map<uint256,std::multimap<double,std::pair<COutPoint,CPegsAccount>>> worst; UniValue result(UniValue::VOBJ);
 
     if (myGetTransaction(pegstxid,tx,hashBlock)==0 || (numvouts=tx.vout.size())<=0)
         CCERR_RESULT("pegscc",CCLOG_INFO, stream << "cant find pegstxid " << pegstxid.GetHex());
     if (DecodePegsCreateOpRet(tx.vout[numvouts-1].scriptPubKey,bindtxids)!='C')
         CCERR_RESULT("pegscc",CCLOG_INFO, stream << "invalid pegstxid " << pegstxid.GetHex());
+    // accounts are funded only with the tokens of the gateways bindings of the pegs
+    for(auto txid : bindtxids)
+    {
+        if (myGetTransaction(txid,tx,hashBlock)!=0 && (numvouts=tx.vout.size())>0 &&
+            DecodeGatewaysBindOpRet(depositaddr,tx.vout[numvouts-1].scriptPubKey,tokenid,coin,totalsupply,oracletxid,M,N,pubkeys,taddr,prefix,prefix2,wiftype)=='B')
+            tokenids.insert(tokenid);
+    }
     result.push_back(Pair("result","success"));
     result.push_back(Pair("name","pegsworstaccounts"));
-    cp = CCinit(&C,EVAL_PEGS);
-    pegspk = GetUnspendable(cp,0);
-    GetCCaddress1of2(cp,coinaddr,pegspk,pegspk);
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    // only the top of the index range of each token is read: the accounts above the lower bound of the red zone.
+    // The bound is infinite for the tokens without a price, the accounts without deposit have an infinite key and
+    // the ones without debt are below any bound, so none of them is read
+    for (std::set<uint256>::const_iterator itt=tokenids.begin(); itt!=tokenids.end(); itt++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        nValue = (int64_t)it->second.satoshis;
-        if (vout == 0 && nValue == CC_MARKER_VALUE && myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts=tx.vout.size())>0 &&
-            (funcid=DecodePegsOpRet(tx,tmppegstxid,tokenid))!=0 && pegstxid==tmppegstxid)
-        {               
-            PegsDecodeAccountTx(tx,pk,amount,account);
-            if (account.first==0 || account.second==0 || PegsGetTokenPrice(tokenid)<=0) ratio=0;
-            else ratio=PegsGetRatio(tokenid,account);
-            if (ratio>PEGS_ACCOUNT_RED_ZONE)
-            {
-                UniValue obj(UniValue::VOBJ);
-                obj.push_back(Pair("accounttxid",txid.GetHex()));
-                obj.push_back(Pair("deposit",account.first));
-                obj.push_back(Pair("debt",account.second));
-                obj.push_back(Pair("ratio",strprintf("%.2f%%",ratio)));                
-                map.insert(std::pair<uint256,UniValue>(tokenid,obj));
-            }
+        accounts.clear();
+        PegsGetAccounts(pegstxid,*itt,PegsRatioLowerBound(*itt,PEGS_ACCOUNT_RED_ZONE),std::numeric_limits<double>::infinity(),accounts);
+        for (std::vector<std::pair<COutPoint,CPegsAccount>>::const_iterator it=accounts.begin(); it!=accounts.end(); it++)
+        {
+            if (it->second.account.first==0 || it->second.account.second==0 || (ratio=PegsGetRatio(*itt,it->second.account))<=PEGS_ACCOUNT_RED_ZONE)
+                continue;
+            worst[*itt].insert(std::make_pair(ratio,*it));
         }
     }
-    std::multimap<uint256,UniValue>::iterator it = map.begin();
-    for (prev=it->first; it != map.end(); ++it)
+    for (std::map<uint256,std::multimap<double,std::pair<COutPoint,CPegsAccount>>>::const_iterator it=worst.begin(); it!=worst.end(); it++)
     {
-        if (it->first!=prev)
+        UniValue acc(UniValue::VARR);
+
+        // from the worst one
+        for (std::multimap<double,std::pair<COutPoint,CPegsAccount>>::const_reverse_iterator ita=it->second.rbegin(); ita!=it->second.rend(); ita++)
         {
-            result.push_back(Pair(PegsGetTokenName(prev),acc));
-            acc.clear();
-            prev=it->first;
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("accounttxid",ita->second.first.hash.GetHex()));
+            obj.push_back(Pair("deposit",ita->second.second.account.first));
+            obj.push_back(Pair("debt",ita->second.second.account.second));
+            obj.push_back(Pair("ratio",strprintf("%.2f%%",ita->first)));
+            acc.push_back(obj);
         }
-        acc.push_back(it->second);
+        result.push_back(Pair(PegsGetTokenName(it->first),acc));
     }
-    result.push_back(Pair(PegsGetTokenName(prev),acc));
     return(result);
 }
 
@@ -74,6 +74,8 @@ GetKomodoEarlytxidScriptPub is on line #2080 of komodo_bitcoind.h
 
 #include <cstdlib>
 #include <gmp.h>
+#include <list>
+#include <set>
 
 #define IS_CHARINSTR(c, str) (std::string(str).find((char)(c)) != std::string::npos)
 
@@ -132,6 +134,26 @@ typedef struct TotalFund {
 
 } TotalFund;
 
+// Synthetic prices and bet scan results are cached: they depend only on the price data up to the computed height,
+// which is rewritten only when a block at or below that height is connected or disconnected (see PricesConnectBlock)
+// so each new price block extends the cached positions instead of rescanning them from the first bet height.
+// Bet scans are bounded by dropping the least recently used one and are indexed by endheight for the invalidation
+typedef struct PricesScanState {
+    std::vector<OneBetData> bets;
+    int64_t lastprice;
+    int32_t endheight;
+    bool isrekt;
+    std::list<uint256>::iterator lru;   // position in pricesScanLRU
+} PricesScanState;
+
+#define PRICES_SYNTHETICCACHE_MAXSIZE 100000
+#define PRICES_SCANCACHE_MAXSIZE 10000
+static CCriticalSection cs_pricescache;
+static std::map<std::pair<int32_t, std::vector<uint16_t> >, int64_t> pricesSyntheticCache;     // (height, synthetic) -> price
+static std::map<uint256, PricesScanState> pricesScanCache;                                      // bettxid -> scan state
+static std::list<uint256> pricesScanLRU;                                                        // bettxids, most recently used first
+static std::set<std::pair<int32_t, uint256> > pricesScanHeights;                                // (endheight, bettxid)
+
 int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, std::vector<uint16_t> vec, int64_t positionsize, int64_t &profits, int64_t &outprice);
 static bool prices_isacceptableamount(const std::vector<uint16_t> &vecparsed, int64_t amount, int16_t leverage);
 
@@ -966,7 +988,7 @@ int32_t prices_syntheticvec(std::vector<uint16_t> &vec, std::vector<std::string>
 }
 
 // calculates price for synthetic expression
-int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t minmax, int16_t leverage)
+static int64_t prices_syntheticprice_calc(const std::vector<uint16_t> &vec, int32_t height)
 {
     int32_t i, value, errcode, depth, retval = -1;
     uint16_t opcode;
@@ -1232,6 +1254,68 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
     return priceIndex;
 }
 
+// minmax and leverage are not used for the price calculation any more so the result is cached by synthetic and height
+int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t minmax, int16_t leverage)
+{
+    int64_t price;
+    std::pair<int32_t, std::vector<uint16_t> > key(height, vec);
+    {
+        LOCK(cs_pricescache);
+        std::map<std::pair<int32_t, std::vector<uint16_t> >, int64_t>::const_iterator it = pricesSyntheticCache.find(key);
+        if (it != pricesSyntheticCache.end())
+            return it->second;
+    }
+    if ((price = prices_syntheticprice_calc(vec, height)) >= 0)     // do not cache errors, the price data might be not available yet
+    {
+        LOCK(cs_pricescache);
+        if (pricesSyntheticCache.size() >= PRICES_SYNTHETICCACHE_MAXSIZE)
+            pricesSyntheticCache.erase(pricesSyntheticCache.begin());   // drop the lowest height
+        pricesSyntheticCache[key] = price;
+    }
+    return price;
+}
+
+// removes a bet scan from the cache and its indexes, cs_pricescache is held
+static void prices_scancache_erase(std::map<uint256, PricesScanState>::iterator it)
+{
+    pricesScanLRU.erase(it->second.lru);
+    pricesScanHeights.erase(std::make_pair(it->second.endheight, it->first));
+    pricesScanCache.erase(it);
+}
+
+// stores a bet scan as the most recently used one, cs_pricescache is held
+static void prices_scancache_put(uint256 bettxid, const PricesScanState &state)
+{
+    std::map<uint256, PricesScanState>::iterator it = pricesScanCache.find(bettxid);
+    if (it != pricesScanCache.end())
+        prices_scancache_erase(it);
+    else if (pricesScanCache.size() >= PRICES_SCANCACHE_MAXSIZE)
+        prices_scancache_erase(pricesScanCache.find(pricesScanLRU.back()));
+    it = pricesScanCache.insert(std::make_pair(bettxid, state)).first;
+    pricesScanLRU.push_front(bettxid);
+    it->second.lru = pricesScanLRU.begin();
+    pricesScanHeights.insert(std::make_pair(state.endheight, bettxid));
+}
+
+// drops cached prices and bet scans which used price data at or above the height
+static void prices_invalidatecache(int32_t height)
+{
+    LOCK(cs_pricescache);
+    pricesSyntheticCache.erase(pricesSyntheticCache.lower_bound(std::make_pair(height, std::vector<uint16_t>())), pricesSyntheticCache.end());
+    while (!pricesScanHeights.empty() && pricesScanHeights.rbegin()->first >= height)
+        prices_scancache_erase(pricesScanCache.find(pricesScanHeights.rbegin()->second));
+}
+
+void PricesConnectBlock(int32_t height)
+{
+    prices_invalidatecache(height);
+}
+
+void PricesDisconnectBlock(int32_t height)
+{
+    prices_invalidatecache(height);
+}
+
 // calculates costbasis and profit/loss for the bet
 int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, std::vector<uint16_t> vec, int64_t positionsize,  int64_t &profits, int64_t &outprice)
 {
@@ -1599,14 +1683,15 @@ UniValue PricesAddFunding(int64_t txfee, uint256 bettxid, int64_t amount)
     return(result);
 }
 
-// scan chain from the initial bet's first position upto the chain tip and calculate bet's costbasises and profits, breaks if rekt detected 
-int32_t prices_scanchain(std::vector<OneBetData> &bets, int16_t leverage, std::vector<uint16_t> vec, int64_t &lastprice, int32_t &endheight) {
+// scan chain from the startheight upto the chain tip and calculate bet's costbasises and profits, breaks if rekt detected (isrekt is set)
+static int32_t prices_scanchainfrom(int32_t startheight, std::vector<OneBetData> &bets, int16_t leverage, const std::vector<uint16_t> &vec, int64_t &lastprice, int32_t &endheight, bool &isrekt) {
 
     if (bets.size() == 0)
         return -1;
 
     bool stop = false;
-    for (int32_t height = bets[0].firstheight+1; ; height++)   // the last datum for 24h is the costbasis value
+    isrekt = false;
+    for (int32_t height = startheight; ; height++)
     {
         int64_t totalposition = 0;
         int64_t totalprofits = 0;
@@ -1634,6 +1719,7 @@ int32_t prices_scanchain(std::vector<OneBetData> &bets, int16_t leverage, std::v
         int64_t equity = totalposition + totalprofits;
         if (equity <= (int64_t)((double)totalposition * prices_minmarginpercent(leverage)))
         {   // we are in loss
+            isrekt = true;
             break;
         }
     }
@@ -1641,6 +1727,54 @@ int32_t prices_scanchain(std::vector<OneBetData> &bets, int16_t leverage, std::v
     return 0;
 }
 
+// scan chain from the initial bet's first position upto the chain tip and calculate bet's costbasises and profits, breaks if rekt detected 
+int32_t prices_scanchain(std::vector<OneBetData> &bets, int16_t leverage, std::vector<uint16_t> vec, int64_t &lastprice, int32_t &endheight) {
+    bool isrekt;
+
+    if (bets.size() == 0)
+        return -1;
+    return prices_scanchainfrom(bets[0].firstheight+1, bets, leverage, vec, lastprice, endheight, isrekt);   // the last datum for 24h is the costbasis value
+}
+
+// same as prices_scanchain but resumes the scan of the bet from where the previous call stopped
+static int32_t prices_scanchaincached(uint256 bettxid, std::vector<OneBetData> &bets, int16_t leverage, std::vector<uint16_t> vec, int64_t &lastprice, int32_t &endheight)
+{
+    PricesScanState state;
+    int32_t startheight;
+    bool isrekt;
+
+    if (bets.size() == 0)
+        return -1;
+    startheight = bets[0].firstheight+1;
+    {
+        LOCK(cs_pricescache);
+        std::map<uint256, PricesScanState>::iterator it = pricesScanCache.find(bettxid);
+        if (it != pricesScanCache.end() && it->second.bets.size() == bets.size() &&
+            std::equal(bets.begin(), bets.end(), it->second.bets.begin(), [](const OneBetData &a, const OneBetData &b) { return a.firstheight == b.firstheight && a.positionsize == b.positionsize; }))
+        {
+            pricesScanLRU.splice(pricesScanLRU.begin(), pricesScanLRU, it->second.lru);
+            bets = it->second.bets;
+            lastprice = it->second.lastprice;
+            endheight = it->second.endheight;
+            if (it->second.isrekt)
+                return 0;
+            startheight = endheight + 1;
+        }
+    }
+    if (prices_scanchainfrom(startheight, bets, leverage, vec, lastprice, endheight, isrekt) < 0)
+        return -1;
+    if (endheight >= bets[0].firstheight+1)   // cache only if at least one height is scanned
+    {
+        state.bets = bets;
+        state.lastprice = lastprice;
+        state.endheight = endheight;
+        state.isrekt = isrekt;
+        LOCK(cs_pricescache);
+        prices_scancache_put(bettxid, state);
+    }
+    return 0;
+}
+
 // pricescostbasis rpc impl: set cost basis (open price) for the bet (deprecated)
 UniValue PricesSetcostbasis(int64_t txfee, uint256 bettxid)
 {
@@ -1796,7 +1930,7 @@ int32_t prices_getbetinfo(uint256 bettxid, BetInfo &betinfo)
             }
 
 
-            if (prices_scanchain(betinfo.bets, betinfo.leverage, betinfo.vecparsed, betinfo.lastprice, betinfo.lastheight) < 0) {
+            if (prices_scanchaincached(bettxid, betinfo.bets, betinfo.leverage, betinfo.vecparsed, betinfo.lastprice, betinfo.lastheight) < 0) {
                 return -4;
             }
 
@@ -16,6 +16,11 @@
 
 #include "cJSON.h"
 #include "CCinclude.h"
+#include "txdb.h"
+
+#include <deque>
+#include <list>
+#include <tuple>
 
 #define ROGUE_REGISTRATION 5
 #define ROGUE_REGISTRATIONSIZE (100 * 10000)
@@ -23,6 +28,7 @@
 #define ROGUE_MAXKEYSTROKESGAP 60
 #define ROGUE_MAXITERATIONS 777
 #define ROGUE_MAXCASHOUT (777 * COIN)
+#define ROGUE_MAXINDEXEDGAMES 1000
 
 #include "rogue/rogue_player.h"
 
@@ -262,14 +268,167 @@ void rogue_univalue(UniValue &result,const char *method,int64_t maxplayers,int64
     }
 }
 
+// Index of the spend chains of games: for every registration slot of a game the confirmed register tx spending
+// gametxid/v1+regslot and then, in order, the txs spending vout0 of the previous one (the keystrokes batons, the
+// highlander/bailout and the transfers of the player). Listing games, player lookups and validation used to rebuild
+// the chains with a spent index read and a tx load per hop, now only the unconfirmed tail past the index is walked.
+// A game is loaded from the spent index on first use, after that it is extended from CClib_connectblock. At most
+// ROGUE_MAXINDEXEDGAMES games are kept, the least recently used is dropped. On a disconnect only the games with a
+// hop (or the game tx) in the block are dropped, they are reloaded on next use
+struct RogueHop
+{
+    uint256 txid;
+    int32_t vini;           // vin spending the previous hop
+    std::string destaddr;   // address of vout0
+    int64_t value;          // value of vout0
+    bool fKeystrokes;       // has a keystrokes opret
+    std::vector<uint8_t> keystrokes;
+};
+typedef std::map<int32_t, std::vector<RogueHop> > RogueChains;  // regslot -> hops
+
+struct RogueGame
+{
+    RogueChains chains;
+    std::list<uint256>::iterator lru;   // position in listRogueGames
+};
+
+static CCriticalSection cs_rogueindex;
+static std::map<uint256, RogueGame> mapRogueGames;
+static std::list<uint256> listRogueGames;                                 // gametxids, most recently used first
+static std::map<COutPoint, std::pair<uint256, int32_t> > mapRogueTails;  // end of a chain -> gametxid, regslot
+
+static bool rogue_makehop(RogueHop &hop,const CTransaction &tx,int32_t vini)
+{
+    uint256 g,b; CPubKey p; char destaddr[64];
+    if ( tx.vout.size() == 0 )
+        return(false);
+    hop.txid = tx.GetHash();
+    hop.vini = vini;
+    destaddr[0] = 0;
+    Getscriptaddress(destaddr,tx.vout[0].scriptPubKey);
+    hop.destaddr = destaddr;
+    hop.value = tx.vout[0].nValue;
+    hop.keystrokes.clear();
+    hop.fKeystrokes = (tx.vout.size() >= 2 && rogue_keystrokesopretdecode(g,b,p,hop.keystrokes,tx.vout[tx.vout.size()-1].scriptPubKey) == 'K');
+    return(true);
+}
+
+// follows the confirmed spends of gametxid/v1+regslot
+static void rogue_loadchain(std::vector<RogueHop> &hops,uint256 gametxid,int32_t regslot)
+{
+    CSpentIndexKey key(gametxid,1+regslot); CSpentIndexValue value; CTransaction tx; uint256 hashBlock; RogueHop hop;
+    while ( pblocktree->ReadSpentIndex(key,value) != 0 && hops.size() < ROGUE_MAXITERATIONS )
+    {
+        if ( myGetTransaction(value.txid,tx,hashBlock) == 0 || rogue_makehop(hop,tx,value.inputIndex) == false )
+            break;
+        hops.push_back(hop);
+        key = CSpentIndexKey(hop.txid,0);
+    }
+    mapRogueTails[COutPoint(key.txid,key.outputIndex)] = std::make_pair(gametxid,regslot);
+}
+
+// removes the game and the tails of its chains from the index, cs_rogueindex is held
+static void rogue_dropgame(std::map<uint256, RogueGame>::iterator it)
+{
+    std::map<COutPoint, std::pair<uint256, int32_t> >::iterator ittail;
+    for (RogueChains::const_iterator itchain=it->second.chains.begin(); itchain!=it->second.chains.end(); itchain++)
+    {
+        COutPoint tail = itchain->second.empty() ? COutPoint(it->first,1+itchain->first) : COutPoint(itchain->second.back().txid,0);
+        if ( (ittail= mapRogueTails.find(tail)) != mapRogueTails.end() && ittail->second == std::make_pair(it->first,itchain->first) )
+            mapRogueTails.erase(ittail);
+    }
+    listRogueGames.erase(it->second.lru);
+    mapRogueGames.erase(it);
+}
+
+// copies the confirmed chains of the registration slots of the game
+void rogue_gamechains(RogueChains &chains,uint256 gametxid,int32_t maxplayers)
+{
+    int32_t i;
+    chains.clear();
+    if ( KOMODO_NSPV_SUPERLITE || maxplayers <= 0 || maxplayers > ROGUE_MAXPLAYERS )
+        return;
+    LOCK2(cs_main,cs_rogueindex);
+    std::map<uint256, RogueGame>::iterator it = mapRogueGames.find(gametxid);
+    if ( it == mapRogueGames.end() )
+    {
+        if ( mapRogueGames.size() >= ROGUE_MAXINDEXEDGAMES )
+            rogue_dropgame(mapRogueGames.find(listRogueGames.back()));
+        it = mapRogueGames.insert(std::make_pair(gametxid,RogueGame())).first;
+        listRogueGames.push_front(gametxid);
+        it->second.lru = listRogueGames.begin();
+        for (i=0; i<maxplayers; i++)
+            rogue_loadchain(it->second.chains[i],gametxid,i);
+    }
+    else listRogueGames.splice(listRogueGames.begin(),listRogueGames,it->second.lru);
+    for (i=0; i<maxplayers; i++)
+        chains[i] = it->second.chains[i];
+}
+
+void rogue_connectblock(const CBlock &block)
+{
+    RogueHop hop; int32_t vini;
+    LOCK(cs_rogueindex);
+    if ( mapRogueTails.empty() )
+        return;
+    for (const CTransaction &tx : block.vtx)
+    {
+        for (vini=0; vini<tx.vin.size(); vini++)
+        {
+            std::map<COutPoint, std::pair<uint256, int32_t> >::iterator it = mapRogueTails.find(tx.vin[vini].prevout);
+            if ( it == mapRogueTails.end() )
+                continue;
+            std::map<uint256, RogueGame>::iterator itgame = mapRogueGames.find(it->second.first);
+            if ( itgame == mapRogueGames.end() )
+            {
+                mapRogueTails.erase(it);
+                continue;
+            }
+            std::vector<RogueHop> &hops = itgame->second.chains[it->second.second];
+            if ( hops.size() >= ROGUE_MAXITERATIONS )
+                continue;   // a full chain keeps its tail at the last hop so that a disconnect of the hop finds it
+            if ( rogue_makehop(hop,tx,vini) != 0 )
+            {
+                hops.push_back(hop);
+                mapRogueTails[COutPoint(hop.txid,0)] = it->second;
+            }
+            mapRogueTails.erase(it);
+        }
+    }
+}
+
+// the blocks above were disconnected first, so a chain with a hop in the block ends in the block: its tail is an
+// output of a tx of the block (the game tx itself for a chain without hops)
+void rogue_disconnectblock(const CBlock &block)
+{
+    int32_t v; std::map<COutPoint, std::pair<uint256, int32_t> >::iterator ittail; std::map<uint256, RogueGame>::iterator it;
+    LOCK(cs_rogueindex);
+    if ( mapRogueTails.empty() )
+        return;
+    for (const CTransaction &tx : block.vtx)
+    {
+        for (v=0; v<tx.vout.size(); v++)
+        {
+            if ( (ittail= mapRogueTails.find(COutPoint(tx.GetHash(),v))) != mapRogueTails.end() && (it= mapRogueGames.find(ittail->second.first)) != mapRogueGames.end() )
+                rogue_dropgame(it);
+        }
+    }
+}
+
 int32_t rogue_iamregistered(int32_t maxplayers,uint256 gametxid,CTransaction tx,char *myrogueaddr)
 {
-    int32_t i,vout; uint256 spenttxid,hashBlock; CTransaction spenttx; char destaddr[64];
+    int32_t i,vout; uint256 spenttxid,hashBlock; CTransaction spenttx; char destaddr[64]; RogueChains chains;
+    rogue_gamechains(chains,gametxid,maxplayers);
     for (i=0; i<maxplayers; i++)
     {
         destaddr[0] = 0;
         vout = i+1;
-        if ( myIsutxo_spent(spenttxid,gametxid,vout) >= 0 )
+        if ( chains[i].size() > 0 )
+        {
+            if ( strcmp(myrogueaddr,chains[i][0].destaddr.c_str()) == 0 )
+                return(1);
+        }
+        else if ( myIsutxo_spent(spenttxid,gametxid,vout) >= 0 )
         {
             if ( myGetTransaction(spenttxid,spenttx,hashBlock) != 0 && spenttx.vout.size() > 0 )
             {
@@ -285,11 +444,17 @@ int32_t rogue_iamregistered(int32_t maxplayers,uint256 gametxid,CTransaction tx,
 
 int64_t rogue_buyins(uint256 gametxid,int32_t maxplayers)
 {
-    int32_t i,vout; uint256 spenttxid,hashBlock; CTransaction spenttx; int64_t buyins = 0;
+    int32_t i,vout; uint256 spenttxid,hashBlock; CTransaction spenttx; int64_t buyins = 0; RogueChains chains;
+    rogue_gamechains(chains,gametxid,maxplayers);
     for (i=0; i<maxplayers; i++)
     {
         vout = i+1;
-        if ( myIsutxo_spent(spenttxid,gametxid,vout) >= 0 )
+        if ( chains[i].size() > 0 )
+        {
+            if ( chains[i][0].value > ROGUE_REGISTRATIONSIZE )
+                buyins += (chains[i][0].value - ROGUE_REGISTRATIONSIZE);
+        }
+        else if ( myIsutxo_spent(spenttxid,gametxid,vout) >= 0 )
         {
             if ( myGetTransaction(spenttxid,spenttx,hashBlock) != 0 && spenttx.vout.size() > 0 )
             {
@@ -433,14 +598,32 @@ UniValue rogue_playerobj(std::vector<uint8_t> playerdata,uint256 playertxid,uint
     return(obj);
 }
 
-int32_t rogue_iterateplayer(uint256 &registertxid,uint256 firsttxid,int32_t firstvout,uint256 lasttxid)     // retrace playertxid vins to reach highlander <- this verifies player is valid and rogue_playerdataspend makes sure it can only be used once
+int32_t rogue_iterateplayer(uint256 &registertxid,uint256 firsttxid,int32_t firstvout,uint256 lasttxid,int32_t maxplayers)     // retrace playertxid vins to reach highlander <- this verifies player is valid and rogue_playerdataspend makes sure it can only be used once
 {
-    uint256 spenttxid,txid = firsttxid; int32_t spentvini,n,vout = firstvout;
+    uint256 spenttxid,txid = firsttxid; int32_t i,spentvini,n,vout = firstvout; RogueChains chains;
     registertxid = zeroid;
     if ( vout < 0 )
         return(-1);
     n = 0;
-    while ( (spentvini= myIsutxo_spent(spenttxid,txid,vout)) == 0 )
+    spentvini = 0;
+    rogue_gamechains(chains,firsttxid,maxplayers);
+    if ( vout >= 1 && vout <= maxplayers )
+    {
+        const std::vector<RogueHop> &hops = chains[vout-1];
+        for (i=0; i<hops.size() && (spentvini= hops[i].vini) == 0; i++)
+        {
+            txid = hops[i].txid;
+            vout = 0;
+            if ( registertxid == zeroid )
+                registertxid = txid;
+            if ( ++n >= ROGUE_MAXITERATIONS )
+            {
+                fprintf(stderr,"rogue_iterateplayer n.%d, seems something is wrong\n",n);
+                return(-2);
+            }
+        }
+    }
+    while ( spentvini == 0 && (spentvini= myIsutxo_spent(spenttxid,txid,vout)) == 0 )
     {
         txid = spenttxid;
         vout = spentvini;
@@ -487,7 +670,7 @@ int32_t rogue_playerdata(struct CCcontract_info *cp,uint256 &origplayergame,uint
             if ( rogue_isvalidgame(cp,gameheight,gametx,buyin,maxplayers,gametxid,0) == 0 )
             {
                 //fprintf(stderr,"playertxid.%s got vin.%s/v%d gametxid.%s iterate.%d\n",playertxid.ToString().c_str(),playertx.vin[1].prevout.hash.ToString().c_str(),(int32_t)playertx.vin[1].prevout.n-maxplayers,gametxid.ToString().c_str(),rogue_iterateplayer(registertxid,gametxid,playertx.vin[1].prevout.n-maxplayers,playertxid));
-                if ( (tokenid != zeroid || playertx.vin[1].prevout.hash == gametxid) && rogue_iterateplayer(registertxid,gametxid,playertx.vin[1].prevout.n-maxplayers,playertxid) == 0 )
+                if ( (tokenid != zeroid || playertx.vin[1].prevout.hash == gametxid) && rogue_iterateplayer(registertxid,gametxid,playertx.vin[1].prevout.n-maxplayers,playertxid,maxplayers) == 0 )
                 {
                     // if registertxid has vin from pk, it can be used
                     return(0);
@@ -523,15 +706,25 @@ int32_t rogue_playerdataspend(CMutableTransaction &mtx,uint256 playertxid,int32_
 
 int32_t rogue_findbaton(struct CCcontract_info *cp,uint256 &playertxid,char **keystrokesp,int32_t &numkeys,int32_t &regslot,std::vector<uint8_t> &playerdata,uint256 &batontxid,int32_t &batonvout,int64_t &batonvalue,int32_t &batonht,uint256 gametxid,CTransaction gametx,int32_t maxplayers,char *destaddr,int32_t &numplayers,std::string &symbol,std::string &pname)
 {
-    int32_t i,numvouts,spentvini,n,matches = 0; CPubKey pk; uint256 tid,active,spenttxid,tokenid,hashBlock,txid,origplayergame; CTransaction spenttx,matchtx,batontx; std::vector<uint8_t> checkdata; CBlockIndex *pindex; char ccaddr[64],*keystrokes=0;
+    int32_t i,numvouts,spentvini,n,matches = 0; CPubKey pk; uint256 tid,active,spenttxid,tokenid,hashBlock,txid,origplayergame; CTransaction spenttx,matchtx,batontx; std::vector<uint8_t> checkdata; CBlockIndex *pindex; char ccaddr[64],*keystrokes=0; RogueChains chains; int32_t j,confirmedslot = -1;
     batonvalue = numkeys = numplayers = batonht = 0;
     playertxid = batontxid = zeroid;
     if ( keystrokesp != 0 )
         *keystrokesp = 0;
+    rogue_gamechains(chains,gametxid,maxplayers);
     for (i=0; i<maxplayers; i++)
     {
         //fprintf(stderr,"findbaton.%d of %d\n",i,maxplayers);
-        if ( myIsutxo_spent(spenttxid,gametxid,i+1) >= 0 )
+        if ( chains[i].size() > 0 )
+        {
+            numplayers++;
+            if ( strcmp(destaddr,chains[i][0].destaddr.c_str()) == 0 )
+            {
+                matches++;
+                regslot = confirmedslot = i;
+            }
+        }
+        else if ( myIsutxo_spent(spenttxid,gametxid,i+1) >= 0 )
         {
             if ( myGetTransaction(spenttxid,spenttx,hashBlock) != 0 && spenttx.vout.size() > 0 )
             {
@@ -542,10 +735,13 @@ int32_t rogue_findbaton(struct CCcontract_info *cp,uint256 &playertxid,char **ke
                     matches++;
                     regslot = i;
                     matchtx = spenttx;
+                    confirmedslot = -1;
                 } //else fprintf(stderr,"%d+1 doesnt match %s vs %s\n",i,ccaddr,destaddr);
             } //else fprintf(stderr,"%d+1 couldnt find spenttx.%s\n",i,spenttxid.GetHex().c_str());
         } //else fprintf(stderr,"%d+1 unspent\n",i);
     }
+    if ( matches == 1 && confirmedslot >= 0 && myGetTransaction(chains[confirmedslot][0].txid,matchtx,hashBlock) == 0 )
+        return(-1);
     if ( matches == 1 )
     {
         numvouts = matchtx.vout.size();
@@ -561,6 +757,30 @@ int32_t rogue_findbaton(struct CCcontract_info *cp,uint256 &playertxid,char **ke
                 txid = matchtx.GetHash();
                 //fprintf(stderr,"scan forward active.%s spenttxid.%s\n",active.GetHex().c_str(),txid.GetHex().c_str());
                 n = 0;
+                if ( confirmedslot >= 0 )
+                {
+                    // the confirmed keystrokes batons come from the index, the mempool tail is walked below
+                    const std::vector<RogueHop> &hops = chains[confirmedslot];
+                    for (j=1; j<hops.size(); j++)
+                    {
+                        txid = hops[j].txid;
+                        if ( hops[j].vini != 0 ) // game is over?
+                            return(0);
+                        if ( keystrokesp != 0 && hops[j].fKeystrokes )
+                        {
+                            keystrokes = (char *)realloc(keystrokes,numkeys + (int32_t)hops[j].keystrokes.size());
+                            for (i=0; i<hops[j].keystrokes.size(); i++)
+                                keystrokes[numkeys+i] = (char)hops[j].keystrokes[i];
+                            numkeys += (int32_t)hops[j].keystrokes.size();
+                            (*keystrokesp) = keystrokes;
+                        }
+                        if ( ++n >= ROGUE_MAXITERATIONS )
+                        {
+                            fprintf(stderr,"rogue_findbaton n.%d, seems something is wrong\n",n);
+                            return(-5);
+                        }
+                    }
+                }
                 while ( CCgettxout(txid,0,1,0) < 0 )
                 {
                     spenttxid = zeroid;
@@ -625,8 +845,9 @@ int32_t rogue_findbaton(struct CCcontract_info *cp,uint256 &playertxid,char **ke
 
 int32_t rogue_playersalive(int32_t &openslots,int32_t &numplayers,uint256 gametxid,int32_t maxplayers,int32_t gameht,CTransaction gametx)
 {
-    int32_t i,n,vout,spentvini,registration_open = 0,alive = 0; CTransaction tx; uint256 txid,spenttxid,hashBlock; CBlockIndex *pindex; uint64_t txfee = 10000;
+    int32_t i,j,n,vout,spentvini,registration_open = 0,alive = 0; CTransaction tx; uint256 txid,spenttxid,hashBlock; CBlockIndex *pindex; uint64_t txfee = 10000; RogueChains chains;
     numplayers = openslots = 0;
+    rogue_gamechains(chains,gametxid,maxplayers);
     if ( komodo_nextheight() <= gameht+ROGUE_MAXKEYSTROKESGAP )
         registration_open = 1;
     for (i=0; i<maxplayers; i++)
@@ -642,7 +863,15 @@ int32_t rogue_playersalive(int32_t &openslots,int32_t &numplayers,uint256 gametx
                 vout = 1+i;
                 //fprintf(stderr,"rogue_playersalive scan forward active.%s spenttxid.%s\n",gametxid.GetHex().c_str(),txid.GetHex().c_str());
                 n = 0;
-                while ( CCgettxout(txid,vout,1,0) < 0 )
+                spentvini = 0;
+                for (j=0; j<chains[i].size() && spentvini == 0; j++)
+                {
+                    txid = chains[i][j].txid;
+                    vout = 0;
+                    if ( (spentvini= chains[i][j].vini) == 0 && n++ > ROGUE_MAXITERATIONS )
+                        spentvini = -1;
+                }
+                while ( spentvini == 0 && CCgettxout(txid,vout,1,0) < 0 )
                 {
                     spenttxid = zeroid;
                     spentvini = -1;
@@ -971,6 +1200,44 @@ UniValue rogue_keystrokes(uint64_t txfee,struct CCcontract_info *cp,cJSON *param
     } else return(cclib_error(result,"couldnt reparse params"));
 }
 
+// Memoization of full replays, by the keystrokes baton they end at. The keystrokes txs are a chain of spends of the baton
+// vout, so the baton txid commits to all keystrokes before it and to the registration with the starting playerdata, and
+// the seed covers the blockhash the game was started from. The same game is replayed for the rpc, for mempool acceptance
+// and again for block validation of the highlander/bailout tx, only the first one runs the engine.
+// This is not an incremental replay: a miss still replays the game from the seed. The engine keeps the game in globals
+// and on the call stack of playit(), and when the keystrokes run out readchar() feeds 'y'/ESCAPE to wind the game down,
+// so there is no state at a baton boundary that could be snapshotted and resumed. Resuming from checkpoints needs the
+// engine moved to a per call context first, which is left to a follow-up. Replays are serialized by cs_roguereplay.
+typedef std::tuple<uint256, uint256, uint64_t> RogueReplayKey;  // gametxid, batontxid, seed
+#define ROGUE_REPLAYCACHE_MAXSIZE 1000
+static CCriticalSection cs_roguereplay;
+static std::map<RogueReplayKey, std::vector<uint8_t> > mapRogueReplays;
+static std::deque<RogueReplayKey> dequeRogueReplays;  // insertion order, for eviction
+
+int32_t rogue_replaycached(uint8_t *newdata,uint256 gametxid,uint256 batontxid,uint64_t seed,char *keystrokes,int32_t numkeys,struct rogue_player *player)
+{
+    RogueReplayKey key = std::make_tuple(gametxid,batontxid,seed); int32_t num;
+    LOCK(cs_roguereplay);
+    std::map<RogueReplayKey, std::vector<uint8_t> >::const_iterator it = mapRogueReplays.find(key);
+    if ( it != mapRogueReplays.end() )
+    {
+        if ( it->second.size() > 0 )
+            memcpy(newdata,&it->second[0],it->second.size());
+        return((int32_t)it->second.size());
+    }
+    num = rogue_replay2(newdata,seed,keystrokes,numkeys,player,0);
+    if ( num < 0 )
+        return(num);
+    mapRogueReplays[key] = std::vector<uint8_t>(newdata,newdata+num);
+    dequeRogueReplays.push_back(key);
+    while ( mapRogueReplays.size() > ROGUE_REPLAYCACHE_MAXSIZE && dequeRogueReplays.size() > 0 )
+    {
+        mapRogueReplays.erase(dequeRogueReplays.front());
+        dequeRogueReplays.pop_front();
+    }
+    return(num);
+}
+
 char *rogue_extractgame(int32_t makefiles,char *str,int32_t *numkeysp,std::vector<uint8_t> &newdata,uint64_t &seed,uint256 &playertxid,struct CCcontract_info *cp,uint256 gametxid,char *rogueaddr)
 {
     CPubKey roguepk; int32_t i,num,retval,maxplayers,gameheight,batonht,batonvout,numplayers,regslot,numkeys,err; std::string symbol,pname; CTransaction gametx; int64_t buyin,batonvalue; char fname[64],*keystrokes = 0; std::vector<uint8_t> playerdata; uint256 batontxid; FILE *fp; uint8_t newplayer[10000]; struct rogue_player P,endP;
@@ -1013,7 +1280,7 @@ char *rogue_extractgame(int32_t makefiles,char *str,int32_t *numkeysp,std::vecto
                     }
                 }
                 //fprintf(stderr,"call replay2\n");
-                num = rogue_replay2(newplayer,seed,keystrokes,numkeys,playerdata.size()==0?0:&P,0);
+                num = rogue_replaycached(newplayer,gametxid,batontxid,seed,keystrokes,numkeys,playerdata.size()==0?0:&P);
                 newdata.resize(num);
                 for (i=0; i<num; i++)
                 {
@@ -1257,7 +1524,7 @@ UniValue rogue_finishgame(uint64_t txfee,struct CCcontract_info *cp,cJSON *param
                     }
                     if ( keystrokes != 0 )
                     {
-                        num = rogue_replay2(player,seed,keystrokes,numkeys,playerdata.size()==0?0:&P,0);
+                        num = rogue_replaycached(player,gametxid,batontxid,seed,keystrokes,numkeys,playerdata.size()==0?0:&P);
                         if ( keystrokes != 0 )
                             free(keystrokes), keystrokes = 0;
                     } else num = 0;
@@ -19,9 +19,28 @@
  ******************************************************************************/
 
 #include "chain.h"
+#include "main.h"
+#include "txdb.h"
 
 using namespace std;
 
+bool CBlockIndex::GetSolution(std::vector<unsigned char>& solution) const
+{
+    std::shared_ptr<const std::vector<unsigned char> > psolution = std::atomic_load(&pSolution);
+    if (psolution) {
+        solution = *psolution;
+        return true;
+    }
+    solution.clear();
+    CDiskBlockIndex dbindex;
+    if (phashBlock == NULL || pblocktree == NULL || !pblocktree->ReadDiskBlockIndex(GetBlockHash(), dbindex)) {
+        LogPrintf("%s: cannot read the index entry of block %s\n", __func__, phashBlock ? GetBlockHash().ToString() : "null");
+        return false;
+    }
+    solution.swap(dbindex.nSolution);
+    return true;
+}
+
 /**
  * CChain implementation
  */
@@ -29,6 +29,7 @@ class CChainPower;
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <memory>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -305,8 +306,14 @@ public:
     unsigned int nTime;
     unsigned int nBits;
     uint256 nNonce;
-    std::vector<unsigned char> nSolution;
 
+protected:
+    //! Equihash solution, more than a kB per header. Dropped from memory once the entry is written to the
+    //! block tree db (see TrimSolution) and read back by GetSolution when the header is served or checked.
+    //! Readers may not hold cs_main, it is only accessed through std::atomic_load and std::atomic_store
+    std::shared_ptr<const std::vector<unsigned char> > pSolution;
+
+public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
     
@@ -340,7 +347,7 @@ public:
         nTime          = 0;
         nBits          = 0;
         nNonce         = uint256();
-        nSolution.clear();
+        pSolution.reset();
     }
 
     CBlockIndex()
@@ -358,7 +365,7 @@ public:
         nTime          = block.nTime;
         nBits          = block.nBits;
         nNonce         = block.nNonce;
-        nSolution      = block.nSolution;
+        pSolution      = std::make_shared<const std::vector<unsigned char> >(block.nSolution);
     }
 
     void SetHeight(int32_t height)
@@ -389,7 +396,9 @@ public:
         return ret;
     }
 
-    CBlockHeader GetBlockHeader() const
+    //! The header of the block, without fSolution nSolution is left empty and no db read is needed.
+    //! The solution is also left empty if it cannot be read back, use the other overload to serve headers
+    CBlockHeader GetBlockHeader(bool fSolution = true) const
     {
         CBlockHeader block;
         block.nVersion       = nVersion;
@@ -400,10 +409,32 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nNonce         = nNonce;
-        block.nSolution      = nSolution;
+        if (fSolution)
+            GetSolution(block.nSolution);
         return block;
     }
 
+    //! The header of the block with its solution, false if the solution cannot be read back
+    bool GetBlockHeader(CBlockHeader& block) const
+    {
+        block = GetBlockHeader(false);
+        return GetSolution(block.nSolution);
+    }
+
+    //! The equihash solution, read from the block tree db if it was trimmed. False if the entry cannot be read
+    bool GetSolution(std::vector<unsigned char>& solution) const;
+
+    bool HasSolution() const
+    {
+        return std::atomic_load(&pSolution) != nullptr;
+    }
+
+    //! Frees the solution, only valid once this entry has been written to the block tree db
+    void TrimSolution()
+    {
+        std::atomic_store(&pSolution, std::shared_ptr<const std::vector<unsigned char> >());
+    }
+
     uint256 GetBlockHash() const
     {
         return *phashBlock;
@@ -470,13 +501,13 @@ public:
 
     int32_t GetVerusPOSTarget() const
     {
-        return GetBlockHeader().GetVerusPOSTarget();
+        return GetBlockHeader(false).GetVerusPOSTarget();
     }
 
     bool IsVerusPOSBlock() const
     {
         if ( ASSETCHAINS_LWMAPOS != 0 )
-            return GetBlockHeader().IsVerusPOSBlock();
+            return GetBlockHeader(false).IsVerusPOSBlock();
         else return(0);
     }
 };
@@ -486,13 +517,20 @@ class CDiskBlockIndex : public CBlockIndex
 {
 public:
     uint256 hashPrev;
+    std::vector<unsigned char> nSolution;
+    //! false if the entry was trimmed and its solution could not be read back, it must not be written then
+    bool fSolution;
 
     CDiskBlockIndex() : CBlockIndex() {
         hashPrev = uint256();
+        fSolution = true;
     }
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        // a trimmed entry that is written again keeps the solution of the entry it replaces
+        fSolution = pindex->GetSolution(nSolution);
+        pSolution.reset();
     }
 
     ADD_SERIALIZE_METHODS;
@@ -22,7 +22,9 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
+class COutPoint;
 class HTTPRequest;
 
 /** Start HTTP RPC subsystem.
@@ -49,4 +51,9 @@ void InterruptREST();
  */
 void StopREST();
 
+/** Number of the outpoints that are unspent, looked up the way /rest/getutxos (in requests of at most
+ *  MAX_GETUTXOS_OUTPOINTS) or /rest/getutxosbatch does. Used by the getutxos benchmark.
+ */
+size_t rest_countutxos(const std::vector<COutPoint>& vOutPoints, bool fCheckMemPool, bool fBatch);
+
 #endif
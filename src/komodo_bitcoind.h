@@ -20,6 +20,7 @@
 #include "primitives/nonce.h"
 #include "consensus/params.h"
 #include "komodo_defs.h"
+#include "blockfilepool.h"
 #include "script/standard.h"
 #include "cc/CCinclude.h"
 
@@ -886,7 +887,18 @@ int32_t komodo_block2pubkey33(uint8_t *pubkey33,CBlock *block)
 
 int32_t komodo_blockload(CBlock& block,CBlockIndex *pindex)
 {
+    CBlockFileSpan span;
     block.SetNull();
+    if ( blockfilepool.GetBlock(pindex->GetBlockPos(),span) )
+    {
+        try { CMemoryReader s(span.begin,span.end,SER_DISK,CLIENT_VERSION); s >> block; }
+        catch (const std::exception& e)
+        {
+            fprintf(stderr,"readblockfromdisk err B\n");
+            return(-1);
+        }
+        return(0);
+    }
     // Open history file to read
     CAutoFile filein(OpenBlockFile(pindex->GetBlockPos(),true),SER_DISK,CLIENT_VERSION);
     if (filein.IsNull())
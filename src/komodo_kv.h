@@ -17,6 +17,18 @@
 #define H_KOMODOKV_H
 
 #include "komodo_defs.h"
+#include "kvdb.h"
+
+/*
+ KV state is kept in the kv db (kvdb.h) which is updated with the 'K' opreturns of each connected block and rolled back
+ from the undo records of the block on disconnect. Lookups read the db directly, changes of the block being connected
+ (or of the mempool) are overlaid with a komodo_kvchanges map.
+ */
+typedef std::map<KVKey,CKVRecord> komodo_kvchanges;
+
+// mempool transactions with a 'K' opreturn, by the key they update. Kept by the CTxMemPool add and remove hooks,
+// guarded by mempool.cs, the pointers are to the transactions in mempool.mapTx
+static std::map<KVKey,std::map<uint256,const CTransaction *> > komodo_kvmempool;
 
 int32_t komodo_kvcmp(uint8_t *refvalue,uint16_t refvaluesize,uint8_t *value,uint16_t valuesize)
 {
@@ -53,54 +65,45 @@ uint64_t komodo_kvfee(uint32_t flags,int32_t opretlen,int32_t keylen)
     return(fee);
 }
 
-int32_t komodo_kvsearch(uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen)
+// returns false if the key is absent or expired at current_height
+bool komodo_kvget(const komodo_kvchanges *changes,const KVKey &key,int32_t current_height,CKVRecord &record)
+{
+    komodo_kvchanges::const_iterator it;
+    if ( changes != 0 && (it= changes->find(key)) != changes->end() )
+        record = it->second;
+    else if ( pkvdb == 0 || pkvdb->ReadKV(key,record) == 0 )
+        return(false);
+    if ( record.IsNull() || current_height > (record.height + komodo_kvduration(record.flags)) )
+        return(false);
+    return(true);
+}
+
+int32_t komodo_kvsearchview(const komodo_kvchanges *changes,uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen)
 {
-    struct komodo_kv *ptr; int32_t duration,retval = -1;
+    CKVRecord record; int32_t retval = -1;
     *heightp = -1;
     *flagsp = 0;
     memset(pubkeyp,0,sizeof(*pubkeyp));
-    portable_mutex_lock(&KOMODO_KV_mutex);
-    HASH_FIND(hh,KOMODO_KV,key,keylen,ptr);
-    if ( ptr != 0 )
+    if ( komodo_kvget(changes,KVKey(key,key+keylen),current_height,record) )
     {
-        duration = komodo_kvduration(ptr->flags);
-        //fprintf(stderr,"duration.%d flags.%d current.%d ht.%d keylen.%d valuesize.%d\n",duration,ptr->flags,current_height,ptr->height,ptr->keylen,ptr->valuesize);
-        if ( current_height > (ptr->height + duration) )
-        {
-            HASH_DELETE(hh,KOMODO_KV,ptr);
-            if ( ptr->value != 0 )
-                free(ptr->value);
-            if ( ptr->key != 0 )
-                free(ptr->key);
-            free(ptr);
-        }
-        else
-        {
-            *heightp = ptr->height;
-            *flagsp = ptr->flags;
-            int32_t i; for (i=0; i<32; i++)
-            {
-                //printf("%02x",((uint8_t *)&ptr->pubkey)[31-i]);
-                ((uint8_t *)pubkeyp)[i] = ((uint8_t *)&ptr->pubkey)[31-i];
-            }
-            //printf(" ptr->pubkey\n");
-            memcpy(pubkeyp,&ptr->pubkey,sizeof(*pubkeyp));
-            if ( (retval= ptr->valuesize) > 0 )
-                memcpy(value,ptr->value,retval);
-        }
-    } //else fprintf(stderr,"couldnt find (%s)\n",(char *)key);
-    portable_mutex_unlock(&KOMODO_KV_mutex);
-    if ( retval < 0 )
-    {
-        // search rawmempool
+        *heightp = record.height;
+        *flagsp = record.flags;
+        memcpy(pubkeyp,&record.pubkey,sizeof(*pubkeyp));
+        if ( (retval= (int32_t)record.value.size()) > 0 )
+            memcpy(value,record.value.data(),retval);
     }
     return(retval);
 }
 
-void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
+int32_t komodo_kvsearch(uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen)
+{
+    return(komodo_kvsearchview(0,pubkeyp,current_height,flagsp,heightp,value,key,keylen));
+}
+
+void komodo_kvupdate(komodo_kvchanges &changes,uint8_t *opretbuf,int32_t opretlen,uint64_t value)
 {
     static uint256 zeroes;
-    uint32_t flags; uint256 pubkey,refpubkey,sig; int32_t i,refvaluesize,hassig,coresize,haspubkey,height,kvheight; uint16_t keylen,valuesize,newflag = 0; uint8_t *key,*valueptr,keyvalue[IGUANA_MAXSCRIPTSIZE*8]; struct komodo_kv *ptr; char *transferpubstr,*tstr; uint64_t fee;
+    uint32_t flags; uint256 pubkey,refpubkey,sig; int32_t i,refvaluesize,hassig,coresize,haspubkey,height,kvheight; uint16_t keylen,valuesize,newflag = 0; uint8_t *key,*valueptr,keyvalue[IGUANA_MAXSCRIPTSIZE*8]; CKVRecord record; char *transferpubstr,*tstr; uint64_t fee;
     if ( ASSETCHAINS_SYMBOL[0] == 0 ) // disable KV for KMD
         return;
     iguana_rwnum(0,&opretbuf[1],sizeof(keylen),&keylen);
@@ -136,7 +139,7 @@ void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
                     ((uint8_t *)&sig)[i] = opretbuf[coresize+sizeof(uint256)+i];
             }
             memcpy(keyvalue,key,keylen);
-            if ( (refvaluesize= komodo_kvsearch((uint256 *)&refpubkey,height,&flags,&kvheight,&keyvalue[keylen],key,keylen)) >= 0 )
+            if ( (refvaluesize= komodo_kvsearchview(&changes,(uint256 *)&refpubkey,height,&flags,&kvheight,&keyvalue[keylen],key,keylen)) >= 0 )
             {
                 if ( memcmp(&zeroes,&refpubkey,sizeof(refpubkey)) != 0 )
                 {
@@ -147,12 +150,11 @@ void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
                     }
                 }
             }
-            portable_mutex_lock(&KOMODO_KV_mutex);
-            HASH_FIND(hh,KOMODO_KV,key,keylen,ptr);
-            if ( ptr != 0 )
+            KVKey vkey(key,key+keylen);
+            if ( komodo_kvget(&changes,vkey,height,record) )
             {
                 //fprintf(stderr,"(%s) already there\n",(char *)key);
-                //if ( (ptr->flags & KOMODO_KVPROTECTED) != 0 )
+                //if ( (record.flags & KOMODO_KVPROTECTED) != 0 )
                 {
                     tstr = (char *)"transfer:";
                     transferpubstr = (char *)&valueptr[strlen(tstr)];
@@ -164,38 +166,191 @@ void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
                     }
                 }
             }
-            else if ( ptr == 0 )
+            else
             {
-                ptr = (struct komodo_kv *)calloc(1,sizeof(*ptr));
-                ptr->key = (uint8_t *)calloc(1,keylen);
-                ptr->keylen = keylen;
-                memcpy(ptr->key,key,keylen);
+                record = CKVRecord();
                 newflag = 1;
-                HASH_ADD_KEYPTR(hh,KOMODO_KV,ptr->key,ptr->keylen,ptr);
-                //fprintf(stderr,"KV add.(%s) (%s)\n",ptr->key,valueptr);
+                //fprintf(stderr,"KV add.(%s) (%s)\n",key,valueptr);
             }
-            if ( newflag != 0 || (ptr->flags & KOMODO_KVPROTECTED) == 0 )
-            {
-                if ( ptr->value != 0 )
-                    free(ptr->value), ptr->value = 0;
-                if ( (ptr->valuesize= valuesize) != 0 )
-                {
-                    ptr->value = (uint8_t *)calloc(1,valuesize);
-                    memcpy(ptr->value,valueptr,valuesize);
-                }
-            } else fprintf(stderr,"newflag.%d zero or protected %d\n",newflag,(ptr->flags & KOMODO_KVPROTECTED));
-            /*for (i=0; i<32; i++)
-                printf("%02x",((uint8_t *)&ptr->pubkey)[i]);
-            printf(" <- ");
-            for (i=0; i<32; i++)
-                printf("%02x",((uint8_t *)&pubkey)[i]);
-            printf(" new pubkey\n");*/
-            memcpy(&ptr->pubkey,&pubkey,sizeof(ptr->pubkey));
-            ptr->height = height;
-            ptr->flags = flags; // jl777 used to or in KVPROTECTED
-            portable_mutex_unlock(&KOMODO_KV_mutex);
+            if ( newflag != 0 || (record.flags & KOMODO_KVPROTECTED) == 0 )
+                record.value.assign(valueptr,valueptr+valuesize);
+            else fprintf(stderr,"newflag.%d zero or protected %d\n",newflag,(record.flags & KOMODO_KVPROTECTED));
+            record.pubkey = pubkey;
+            record.height = height;
+            record.flags = flags; // jl777 used to or in KVPROTECTED
+            changes[vkey] = record;
         } else fprintf(stderr,"KV update size mismatch %d vs %d\n",opretlen,coresize);
     } else fprintf(stderr,"not enough fee\n");
 }
 
+// returns the 'K' opreturn of the output, if any
+int32_t komodo_kvopret(const CTxOut &txout,std::vector<uint8_t> &opret)
+{
+    const CScript &script = txout.scriptPubKey; opcodetype opcode;
+    if ( script.size() < 2 || script[0] != OP_RETURN || ASSETCHAINS_SYMBOL[0] == 0 )
+        return(0);
+    CScript::const_iterator pc = script.begin() + 1;
+    if ( script.GetOp(pc,opcode,opret) == 0 || opret.size() == 0 || opret[0] != 'K' || opret.size() == 40 )
+        return(0);
+    return((int32_t)opret.size());
+}
+
+void komodo_kvapplytx(komodo_kvchanges &changes,const CTransaction &tx)
+{
+    std::vector<uint8_t> opret;
+    for (int32_t j=0; j<tx.vout.size(); j++)
+        if ( komodo_kvopret(tx.vout[j],opret) > 0 )
+            komodo_kvupdate(changes,opret.data(),(int32_t)opret.size(),(uint64_t)tx.vout[j].nValue);
+}
+
+// applies the kv updates of the block to the kv db, the block must connect to the current best block of the db
+// (the genesis block is not connected, an empty db starts at ht.1)
+void komodo_kvconnectblock(CBlockIndex *pindex,const CBlock &block)
+{
+    komodo_kvchanges changes; KVUndo undo; CKVRecord record; uint256 hashBest;
+    if ( pkvdb == 0 || ASSETCHAINS_SYMBOL[0] == 0 )
+        return;
+    if ( (hashBest= pkvdb->ReadBestBlock()) != block.hashPrevBlock && (hashBest.IsNull() == 0 || pindex->GetHeight() != 1) )
+    {
+        // blocks already applied, as the ones VerifyDB reconnects below the tip, are skipped quietly
+        BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+        if ( mi == mapBlockIndex.end() || mi->second == 0 || mi->second->GetAncestor(pindex->GetHeight()) != pindex )
+            LogPrintf("komodo_kvconnectblock: ht.%d doesnt connect to kv best block %s\n",pindex->GetHeight(),hashBest.GetHex());
+        return;
+    }
+    for (int32_t i=0; i<block.vtx.size(); i++)
+        komodo_kvapplytx(changes,block.vtx[i]);
+    CDBBatch batch(*pkvdb);
+    if ( changes.size() > 0 )
+    {
+        for (komodo_kvchanges::const_iterator it=changes.begin(); it!=changes.end(); it++)
+        {
+            if ( pkvdb->ReadKV(it->first,record) == 0 )
+                record = CKVRecord();
+            undo.push_back(std::make_pair(it->first,record));
+            pkvdb->WriteKV(batch,it->first,it->second);
+        }
+        pkvdb->WriteUndo(batch,pindex->GetBlockHash(),undo);
+    }
+    pkvdb->WriteBestBlock(batch,pindex->GetBlockHash());
+    pkvdb->WriteBatch(batch);
+}
+
+void komodo_kvdisconnectblock(CBlockIndex *pindex)
+{
+    KVUndo undo;
+    if ( pkvdb == 0 || ASSETCHAINS_SYMBOL[0] == 0 || pkvdb->ReadBestBlock() != pindex->GetBlockHash() )
+        return;
+    CDBBatch batch(*pkvdb);
+    if ( pkvdb->ReadUndo(pindex->GetBlockHash(),undo) )
+    {
+        for (KVUndo::const_iterator it=undo.begin(); it!=undo.end(); it++)
+            pkvdb->WriteKV(batch,it->first,it->second);
+        pkvdb->EraseUndo(batch,pindex->GetBlockHash());
+    }
+    pkvdb->WriteBestBlock(batch,pindex->pprev != 0 ? pindex->pprev->GetBlockHash() : uint256());
+    pkvdb->WriteBatch(batch);
+}
+
+// brings the kv db to the active chain tip: rolls back blocks not in the active chain (after an unclean shutdown)
+// and connects the missing ones (first start with an existing chain)
+void komodo_kvsync()
+{
+    CBlockIndex *pindex = 0; CBlock block; uint256 hashBest;
+    if ( pkvdb == 0 || ASSETCHAINS_SYMBOL[0] == 0 )
+        return;
+    LOCK(cs_main);
+    if ( (hashBest= pkvdb->ReadBestBlock()).IsNull() == 0 )
+    {
+        BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+        if ( mi == mapBlockIndex.end() )
+        {
+            LogPrintf("komodo_kvsync: kv best block %s not found, -reindex is needed to rebuild the kv index\n",hashBest.GetHex());
+            return;
+        }
+        for (pindex=mi->second; pindex != 0 && chainActive.Contains(pindex) == 0; pindex=pindex->pprev)
+            komodo_kvdisconnectblock(pindex);
+    }
+    if ( pindex != 0 && pindex == chainActive.Tip() )
+        return;
+    LogPrintf("komodo_kvsync: updating kv index from ht.%d to ht.%d\n",pindex != 0 ? pindex->GetHeight() : 0,chainActive.Height());
+    for (pindex=(pindex != 0 ? chainActive.Next(pindex) : chainActive[1]); pindex != 0; pindex=chainActive.Next(pindex))
+    {
+        if ( ReadBlockFromDisk(block,pindex,1) != 0 )
+            komodo_kvconnectblock(pindex,block);
+        else
+        {
+            LogPrintf("komodo_kvsync: cant read block ht.%d\n",pindex->GetHeight());
+            break;
+        }
+    }
+}
+
+// the keys updated by the 'K' opreturns of the transaction
+void komodo_kvtxkeys(const CTransaction &tx,std::vector<KVKey> &keys)
+{
+    std::vector<uint8_t> opret; uint16_t keylen;
+    for (int32_t j=0; j<tx.vout.size(); j++)
+    {
+        if ( komodo_kvopret(tx.vout[j],opret) > 13 )
+        {
+            iguana_rwnum(0,&opret[1],sizeof(keylen),&keylen);
+            if ( keylen+13 <= opret.size() )
+                keys.push_back(KVKey(&opret[13],&opret[13+keylen]));
+        }
+    }
+}
+
+// called from CTxMemPool with mempool.cs held
+void komodo_kvmempooladd(const CTransaction &tx)
+{
+    std::vector<KVKey> keys;
+    komodo_kvtxkeys(tx,keys);
+    for (int32_t i=0; i<keys.size(); i++)
+        komodo_kvmempool[keys[i]][tx.GetHash()] = &tx;
+}
+
+void komodo_kvmempoolremove(const CTransaction &tx)
+{
+    std::vector<KVKey> keys; std::map<KVKey,std::map<uint256,const CTransaction *> >::iterator it;
+    komodo_kvtxkeys(tx,keys);
+    for (int32_t i=0; i<keys.size(); i++)
+    {
+        if ( (it= komodo_kvmempool.find(keys[i])) != komodo_kvmempool.end() )
+        {
+            it->second.erase(tx.GetHash());
+            if ( it->second.empty() )
+                komodo_kvmempool.erase(it);
+        }
+    }
+}
+
+void komodo_kvmempoolclear()
+{
+    komodo_kvmempool.clear();
+}
+
+// kvsearch with the pending updates in the mempool applied over the confirmed state. Only the mempool transactions
+// updating the key are applied, oldest first
+int32_t komodo_kvsearchmempool(uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen)
+{
+    komodo_kvchanges changes; std::vector<std::pair<std::pair<int64_t,uint256>,const CTransaction *> > txs;
+    std::map<KVKey,std::map<uint256,const CTransaction *> >::const_iterator it;
+    {
+        LOCK(mempool.cs);
+        if ( (it= komodo_kvmempool.find(KVKey(key,key+keylen))) != komodo_kvmempool.end() )
+        {
+            for (std::map<uint256,const CTransaction *>::const_iterator ti=it->second.begin(); ti!=it->second.end(); ti++)
+            {
+                CTxMemPool::indexed_transaction_set::const_iterator mi = mempool.mapTx.find(ti->first);
+                txs.push_back(std::make_pair(std::make_pair(mi != mempool.mapTx.end() ? mi->GetTime() : 0,ti->first),ti->second));
+            }
+            std::sort(txs.begin(),txs.end());
+            for (int32_t i=0; i<txs.size(); i++)
+                komodo_kvapplytx(changes,*txs[i].second);
+        }
+    }
+    return(komodo_kvsearchview(&changes,pubkeyp,current_height,flagsp,heightp,value,key,keylen));
+}
+
 #endif
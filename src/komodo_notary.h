@@ -19,6 +19,8 @@
 
 #include "notaries_staked.h"
 
+#include <atomic>
+
 #define KOMODO_MAINNET_START 178999
 #define KOMODO_NOTARIES_HEIGHT1 814000
 
@@ -87,10 +89,116 @@ int32_t getacseason(uint32_t timestamp)
     return(0);
 }
 
+/*
+ The elected notaries of a KMD season never change, so each season gets an immutable table that is built on first use
+ and published through an atomic pointer: block validation, the miner and notarisation parsing read it without
+ komodo_mutex and without copying the pubkeys. Pubkeys map to notary ids through a perfect hash, the slot is the first
+ 8 bytes of the x coordinate modulo a modulus chosen at build time so that no two notaries share a slot.
+ */
+#define KOMODO_NOTARYTABLE_MAXSLOTS 1024
+
+struct komodo_notarytable
+{
+    int32_t numnotaries,modulus;
+    uint8_t pubkeys[64][33];
+    int8_t slots[KOMODO_NOTARYTABLE_MAXSLOTS];
+    char addresses[64][64]; // PIRATE only, for the notary exemptions
+};
+
+static std::atomic<struct komodo_notarytable *> komodo_notarytables[NUM_KMD_SEASONS];
+
+static uint64_t komodo_notaryslotkey(const uint8_t *pubkey33)
+{
+    uint64_t key;
+    memcpy(&key,&pubkey33[1],sizeof(key));
+    return(key);
+}
+
+// returns the notary id of pubkey33 or -1
+int32_t komodo_notarytable_id(const struct komodo_notarytable *tp,const uint8_t *pubkey33)
+{
+    int32_t i,id;
+    if ( tp->modulus == 0 ) // no perfect hash was found, cant happen with 64 random keys
+    {
+        for (i=0; i<tp->numnotaries; i++)
+            if ( memcmp(tp->pubkeys[i],pubkey33,33) == 0 )
+                return(i);
+        return(-1);
+    }
+    if ( (id= tp->slots[komodo_notaryslotkey(pubkey33) % tp->modulus]) >= 0 && memcmp(tp->pubkeys[id],pubkey33,33) == 0 )
+        return(id);
+    return(-1);
+}
+
+static struct komodo_notarytable *komodo_notarytable_build(int32_t kmd_season)
+{
+    int32_t i,slot,modulus; struct komodo_notarytable *tp;
+    tp = (struct komodo_notarytable *)calloc(1,sizeof(*tp));
+    tp->numnotaries = NUM_KMD_NOTARIES;
+    for (i=0; i<NUM_KMD_NOTARIES; i++)
+        decode_hex(tp->pubkeys[i],33,(char *)notaries_elected[kmd_season-1][i][1]);
+    if ( ASSETCHAINS_PRIVATE != 0 )
+    {
+        // this is PIRATE, we need to populate the address array for the notary exemptions.
+        // it is filled before the table is published, so readers never see it half done
+        for (i=0; i<NUM_KMD_NOTARIES; i++)
+            pubkey2addr(tp->addresses[i],tp->pubkeys[i]);
+    }
+    for (modulus=2*NUM_KMD_NOTARIES; modulus<=KOMODO_NOTARYTABLE_MAXSLOTS; modulus++)
+    {
+        memset(tp->slots,0xff,sizeof(tp->slots));
+        for (i=0; i<NUM_KMD_NOTARIES; i++)
+        {
+            slot = komodo_notaryslotkey(tp->pubkeys[i]) % modulus;
+            if ( tp->slots[slot] < 0 )
+                tp->slots[slot] = i;
+            else if ( memcmp(tp->pubkeys[tp->slots[slot]],tp->pubkeys[i],33) != 0 ) // a repeated pubkey keeps its first id
+                break;
+        }
+        if ( i == NUM_KMD_NOTARIES )
+        {
+            tp->modulus = modulus;
+            break;
+        }
+    }
+    return(tp);
+}
+
+// KMD season (1 based) whose elected notaries sign at height/timestamp, 0 if the notaries come from elsewhere
+int32_t komodo_kmdseason(int32_t height,uint32_t timestamp)
+{
+    // LABS chains have their own notaries in notaries_staked.cpp
+    if ( is_STAKED(ASSETCHAINS_SYMBOL) != 0 )
+        return(0);
+    // This is KMD, use block heights to determine the KMD notary season..
+    if ( ASSETCHAINS_SYMBOL[0] == 0 )
+        return(height >= KOMODO_NOTARIES_HARDCODED ? getkmdseason(height) : 0);
+    // This is a non LABS assetchain, use timestamp to detemine notary pubkeys.
+    if ( timestamp == 0 )
+        timestamp = komodo_heightstamp(height);
+    return(getacseason(timestamp));
+}
+
+// returns the notary table of the season at height/timestamp, NULL when komodo_notaries has to be used
+const struct komodo_notarytable *komodo_notarytable(int32_t height,uint32_t timestamp)
+{
+    int32_t kmd_season; struct komodo_notarytable *tp,*expected = 0;
+    if ( (kmd_season= komodo_kmdseason(height,timestamp)) == 0 )
+        return(0);
+    if ( (tp= komodo_notarytables[kmd_season-1].load(std::memory_order_acquire)) != 0 )
+        return(tp);
+    tp = komodo_notarytable_build(kmd_season);
+    if ( komodo_notarytables[kmd_season-1].compare_exchange_strong(expected,tp,std::memory_order_acq_rel) == 0 )
+    {
+        free(tp); // another thread published the same table first
+        return(expected);
+    }
+    return(tp);
+}
+
 int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestamp)
 {
-    int32_t i,htind,n; uint64_t mask = 0; struct knotary_entry *kp,*tmp;
-    static uint8_t kmd_pubkeys[NUM_KMD_SEASONS][64][33],didinit[NUM_KMD_SEASONS];
+    int32_t i,htind,n; uint64_t mask = 0; struct knotary_entry *kp,*tmp; const struct komodo_notarytable *tp;
     
     if ( timestamp == 0 && ASSETCHAINS_SYMBOL[0] != 0 )
         timestamp = komodo_heightstamp(height);
@@ -100,34 +208,10 @@ int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestam
     // If this chain is not a staked chain, use the normal Komodo logic to determine notaries. This allows KMD to still sync and use its proper pubkeys for dPoW.
     if ( is_STAKED(ASSETCHAINS_SYMBOL) == 0 )
     {
-        int32_t kmd_season = 0;
-        if ( ASSETCHAINS_SYMBOL[0] == 0 )
-        {
-            // This is KMD, use block heights to determine the KMD notary season.. 
-            if ( height >= KOMODO_NOTARIES_HARDCODED )
-                kmd_season = getkmdseason(height);
-        }
-        else 
+        if ( (tp= komodo_notarytable(height,timestamp)) != 0 )
         {
-            // This is a non LABS assetchain, use timestamp to detemine notary pubkeys. 
-            kmd_season = getacseason(timestamp);
-        }
-        if ( kmd_season != 0 )
-        {
-            if ( didinit[kmd_season-1] == 0 )
-            {
-                for (i=0; i<NUM_KMD_NOTARIES; i++) 
-                    decode_hex(kmd_pubkeys[kmd_season-1][i],33,(char *)notaries_elected[kmd_season-1][i][1]);
-                if ( ASSETCHAINS_PRIVATE != 0 )
-                {
-                    // this is PIRATE, we need to populate the address array for the notary exemptions. 
-                    for (i = 0; i<NUM_KMD_NOTARIES; i++)
-                        pubkey2addr((char *)NOTARY_ADDRESSES[kmd_season-1][i],(uint8_t *)kmd_pubkeys[kmd_season-1][i]);
-                }
-                didinit[kmd_season-1] = 1;
-            }
-            memcpy(pubkeys,kmd_pubkeys[kmd_season-1],NUM_KMD_NOTARIES * 33);
-            return(NUM_KMD_NOTARIES);
+            memcpy(pubkeys,tp->pubkeys,tp->numnotaries * 33);
+            return(tp->numnotaries);
         }
     }
     else if ( timestamp != 0 )
@@ -170,7 +254,12 @@ int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestam
 
 int32_t komodo_electednotary(int32_t *numnotariesp,uint8_t *pubkey33,int32_t height,uint32_t timestamp)
 {
-    int32_t i,n; uint8_t pubkeys[64][33];
+    int32_t i,n; uint8_t pubkeys[64][33]; const struct komodo_notarytable *tp;
+    if ( (tp= komodo_notarytable(height,timestamp)) != 0 )
+    {
+        *numnotariesp = tp->numnotaries;
+        return(komodo_notarytable_id(tp,pubkey33));
+    }
     n = komodo_notaries(pubkeys,height,timestamp);
     *numnotariesp = n;
     for (i=0; i<n; i++)
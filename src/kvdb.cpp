@@ -0,0 +1,78 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "kvdb.h"
+#include "util.h"
+
+static const char DB_KV = 'k';
+static const char DB_KV_UNDO = 'u';
+static const char DB_BEST_BLOCK = 'B';
+
+
+CKVDB *pkvdb;
+
+
+CKVDB::CKVDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "kv", nCacheSize, fMemory, fWipe) { }
+
+
+bool CKVDB::ReadKV(const KVKey &key, CKVRecord &record) const
+{
+    return Read(std::make_pair(DB_KV, key), record);
+}
+
+
+bool CKVDB::ReadUndo(const uint256 &blockHash, KVUndo &undo) const
+{
+    return Read(std::make_pair(DB_KV_UNDO, blockHash), undo);
+}
+
+
+uint256 CKVDB::ReadBestBlock() const
+{
+    uint256 hashBestBlock;
+    if (!Read(DB_BEST_BLOCK, hashBestBlock))
+        return uint256();
+    return hashBestBlock;
+}
+
+
+/*
+ * A null record erases the key
+ */
+void CKVDB::WriteKV(CDBBatch &batch, const KVKey &key, const CKVRecord &record) const
+{
+    if (record.IsNull())
+        batch.Erase(std::make_pair(DB_KV, key));
+    else
+        batch.Write(std::make_pair(DB_KV, key), record);
+}
+
+
+void CKVDB::WriteUndo(CDBBatch &batch, const uint256 &blockHash, const KVUndo &undo) const
+{
+    batch.Write(std::make_pair(DB_KV_UNDO, blockHash), undo);
+}
+
+
+void CKVDB::EraseUndo(CDBBatch &batch, const uint256 &blockHash) const
+{
+    batch.Erase(std::make_pair(DB_KV_UNDO, blockHash));
+}
+
+
+void CKVDB::WriteBestBlock(CDBBatch &batch, const uint256 &blockHash) const
+{
+    batch.Write(DB_BEST_BLOCK, blockHash);
+}
@@ -0,0 +1,78 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef KVDB_H
+#define KVDB_H
+
+#include "uint256.h"
+#include "dbwrapper.h"
+#include "serialize.h"
+
+#include <vector>
+
+
+/*
+ * Current state of a key stored with the kvupdate opreturn ('K')
+ */
+class CKVRecord
+{
+public:
+    std::vector<uint8_t> value;
+    int32_t height;
+    uint32_t flags;
+    uint256 pubkey;
+
+    CKVRecord() : height(-1), flags(0) {}
+
+    bool IsNull() const { return height < 0; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(value);
+        READWRITE(height);
+        READWRITE(flags);
+        READWRITE(pubkey);
+    }
+};
+
+typedef std::vector<uint8_t> KVKey;
+typedef std::vector<std::pair<KVKey,CKVRecord> > KVUndo;
+
+
+/*
+ * Index of the kv keys, maintained by ConnectBlock/DisconnectTip.
+ * Blocks changing any key keep the previous records of the keys (null if the key was absent) to undo the changes.
+ */
+class CKVDB : public CDBWrapper
+{
+public:
+    CKVDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    bool ReadKV(const KVKey &key, CKVRecord &record) const;
+    bool ReadUndo(const uint256 &blockHash, KVUndo &undo) const;
+    uint256 ReadBestBlock() const;
+
+    void WriteKV(CDBBatch &batch, const KVKey &key, const CKVRecord &record) const;
+    void WriteUndo(CDBBatch &batch, const uint256 &blockHash, const KVUndo &undo) const;
+    void EraseUndo(CDBBatch &batch, const uint256 &blockHash) const;
+    void WriteBestBlock(CDBBatch &batch, const uint256 &blockHash) const;
+};
+
+
+extern CKVDB *pkvdb;
+
+#endif  /* KVDB_H */
@@ -26,6 +26,7 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockfilepool.h"
 #include "importcoin.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -40,6 +41,7 @@
 #include "net.h"
 #include "pow.h"
 #include "script/interpreter.h"
+#include "txcache.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -55,6 +57,7 @@
 #include <algorithm>
 #include <atomic>
 #include <sstream>
+#include <list>
 #include <map>
 #include <unordered_map>
 #include <vector>
@@ -88,6 +91,8 @@ int32_t komodo_block2pubkey33(uint8_t *pubkey33,CBlock *block);
 bool Getscriptaddress(char *destaddr,const CScript &scriptPubKey);
 void komodo_setactivation(int32_t height);
 void komodo_pricesupdate(int32_t height,CBlock *pblock);
+void CCConnectBlock(const CBlock &block,int32_t height);
+void CCDisconnectBlock(const CBlock &block,int32_t height);
 
 BlockMap mapBlockIndex;
 CChain chainActive;
@@ -100,6 +105,7 @@ bool fExperimentalMode = true;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
+bool fAsyncIndexWrites = DEFAULT_ASYNCINDEXWRITES;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
@@ -404,14 +410,11 @@ namespace {
 
     void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
     {
-        /*    int expired = pool.Expire(GetTime() - age);
-         if (expired != 0)
-         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+        int expired = pool.Expire(GetTime() - age);
+        if (expired != 0)
+            LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
-         std::vector<uint256> vNoSpendsRemaining;
-         pool.TrimToSize(limit, &vNoSpendsRemaining);
-         BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
-         pcoinsTip->Uncache(removed);*/
+        pool.TrimToSize(limit);
     }
 
     // Requires cs_main.
@@ -679,6 +682,104 @@ bool komodo_snapshot2(std::map <std::string, CAmount> &addressAmounts)
 int32_t lastSnapShotHeight = 0;
 std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 
+// balances of all transparent addresses in the address unspent index (cc outputs and the snapshot ignore list left out,
+// same as Snapshot2), ranked by amount. Loaded from the index by the first snapshot, after that ConnectBlock and
+// DisconnectBlock apply their address index deltas, so a daily snapshot only has to undo the blocks above the
+// notarized height instead of sweeping the whole index. Guarded by cs_main.
+static std::map<CTxDestination, CAmount> mapAddressBalances;
+static std::set<std::pair<CAmount, CTxDestination> > setAddressRanks;
+static uint256 hashAddressBalances; // block the balances are valid at, null until loaded
+
+static bool komodo_snapshotignored(const CTxDestination &dest)
+{
+    static std::set<CTxDestination> ignored;
+    if ( ignored.empty() )
+    {
+        for (const std::string &address : SnapshotIgnoreList())
+            ignored.insert(DecodeDestination(address));
+    }
+    return ignored.count(dest) != 0;
+}
+
+static void komodo_addressbalance(const CTxDestination &dest, CAmount delta)
+{
+    CAmount balance = delta;
+    std::map<CTxDestination, CAmount>::iterator it = mapAddressBalances.find(dest);
+    if ( it != mapAddressBalances.end() )
+    {
+        balance += it->second;
+        setAddressRanks.erase(std::make_pair(it->second, dest));
+        mapAddressBalances.erase(it);
+    }
+    if ( balance > 0 )
+    {
+        mapAddressBalances[dest] = balance;
+        setAddressRanks.insert(std::make_pair(balance, dest));
+    }
+}
+
+static bool komodo_addressbalances_load()
+{
+    std::map <std::string, CAmount> addressAmounts;
+    AssertLockHeld(cs_main);
+    if ( chainActive.Tip() == 0 )
+        return false;
+    if ( hashAddressBalances == chainActive.Tip()->GetBlockHash() )
+        return true;
+    hashAddressBalances.SetNull();
+    mapAddressBalances.clear();
+    setAddressRanks.clear();
+    if ( !komodo_snapshot2(addressAmounts) )
+        return false;
+    for (std::map <std::string, CAmount>::const_iterator it = addressAmounts.begin(); it != addressAmounts.end(); ++it)
+        komodo_addressbalance(DecodeDestination(it->first), it->second);
+    hashAddressBalances = chainActive.Tip()->GetBlockHash();
+    return true;
+}
+
+// applies the address index entries written (fConnect) or erased by a block to the balances. A block that does not
+// extend (or is not the tip of) the loaded balances is ignored, the next snapshot then reloads them from the index.
+static void komodo_addressbalances_update(const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, bool fConnect)
+{
+    std::map<CTxDestination, CAmount> deltas;
+    if ( hashAddressBalances.IsNull() || pindex->pprev == 0 )
+        return;
+    if ( (fConnect ? pindex->pprev->GetBlockHash() : pindex->GetBlockHash()) != hashAddressBalances )
+        return;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); ++it)
+    {
+        CTxDestination dest;
+        if ( it->first.type == 1 )
+            dest = CKeyID(it->first.hashBytes);
+        else if ( it->first.type == 2 )
+            dest = CScriptID(it->first.hashBytes);
+        else continue;
+        if ( komodo_snapshotignored(dest) )
+            continue;
+        deltas[dest] += fConnect ? it->second : -it->second;
+    }
+    for (std::map<CTxDestination, CAmount>::const_iterator it = deltas.begin(); it != deltas.end(); ++it)
+    {
+        if ( it->second != 0 )
+            komodo_addressbalance(it->first, it->second);
+    }
+    hashAddressBalances = fConnect ? pindex->GetBlockHash() : pindex->pprev->GetBlockHash();
+}
+
+// returns the address string of vDest, on first use the address is seeded with its balance at the tip
+static std::string komodo_snapshotaddress(std::map <std::string, int64_t> &addressAmounts, std::set<CTxDestination> &touched, const CTxDestination &vDest)
+{
+    std::string address = CBitcoinAddress(vDest).ToString();
+    CTxDestination dest = DecodeDestination(address);
+    if ( touched.insert(dest).second )
+    {
+        std::map<CTxDestination, CAmount>::const_iterator it = mapAddressBalances.find(dest);
+        if ( it != mapAddressBalances.end() )
+            addressAmounts[address] = it->second;
+    }
+    return address;
+}
+
 bool komodo_dailysnapshot(int32_t height)
 {
     int reorglimit = 100; 
@@ -708,8 +809,10 @@ bool komodo_dailysnapshot(int32_t height)
     // if we already did this height dont bother doing it again, this is just a reorg. The actual snapshot height cannot be reorged.
     if ( undo_height == lastSnapShotHeight )
         return true;
+    // only the addresses touched by the undone blocks are copied out of the balances table
     std::map <std::string, int64_t> addressAmounts;
-    if ( !komodo_snapshot2(addressAmounts) )
+    std::set<CTxDestination> touched;
+    if ( !komodo_addressbalances_load() )
         return false;
 
     // undo blocks in reverse order
@@ -730,9 +833,10 @@ bool komodo_dailysnapshot(int32_t height)
                 const CTxOut &out = tx.vout[k];
                 if ( ExtractDestination(out.scriptPubKey, vDest) )
                 {
-                    addressAmounts[CBitcoinAddress(vDest).ToString()] -= out.nValue;
-                    if ( addressAmounts[CBitcoinAddress(vDest).ToString()] < 1 )
-                        addressAmounts.erase(CBitcoinAddress(vDest).ToString());
+                    std::string address = komodo_snapshotaddress(addressAmounts, touched, vDest);
+                    addressAmounts[address] -= out.nValue;
+                    if ( addressAmounts[address] < 1 )
+                        addressAmounts.erase(address);
                     //fprintf(stderr, "VOUT: address.%s remove_coins.%li\n",CBitcoinAddress(vDest).ToString().c_str(), out.nValue);
                 } 
             }
@@ -747,7 +851,7 @@ bool komodo_dailysnapshot(int32_t height)
                     if ( ExtractDestination(txin.vout[vout].scriptPubKey, vDest) )
                     {
                         //fprintf(stderr, "VIN: address.%s add_coins.%li\n",CBitcoinAddress(vDest).ToString().c_str(), txin.vout[vout].nValue);
-                        addressAmounts[CBitcoinAddress(vDest).ToString()] += txin.vout[vout].nValue;
+                        addressAmounts[komodo_snapshotaddress(addressAmounts, touched, vDest)] += txin.vout[vout].nValue;
                     }
                 }
             }
@@ -757,6 +861,12 @@ bool komodo_dailysnapshot(int32_t height)
     // convert address string to destination for easier conversion to what ever is required, eg, scriptPubKey. 
     for ( auto element : addressAmounts)
         vAddressSnapshot.push_back(make_pair(element.second, DecodeDestination(element.first)));
+    // untouched addresses keep their tip balance, no more than 3999 of them can make it into the snapshot
+    for (std::set<std::pair<CAmount, CTxDestination> >::const_reverse_iterator it = setAddressRanks.rbegin(); it != setAddressRanks.rend() && vAddressSnapshot.size() < addressAmounts.size()+3999; ++it)
+    {
+        if ( touched.count(it->second) == 0 )
+            vAddressSnapshot.push_back(*it);
+    }
     // sort the vector by amount, highest at top.
     std::sort(vAddressSnapshot.rbegin(), vAddressSnapshot.rend());
     //for (int j = 0; j < 50; j++) 
@@ -1436,19 +1546,16 @@ bool CheckTransaction(uint32_t tiptime,const CTransaction& tx, CValidationState
 
 int32_t komodo_isnotaryvout(char *coinaddr,uint32_t tiptime) // from ac_private chains only
 {
-    int32_t season = getacseason(tiptime);
-    if ( NOTARY_ADDRESSES[season-1][0][0] == 0 )
-    {
-        uint8_t pubkeys[64][33];
-        komodo_notaries(pubkeys,0,tiptime);
-    }
+    const struct komodo_notarytable *tp = komodo_notarytable(0,tiptime);
     if ( strcmp(coinaddr,CRYPTO777_KMDADDR) == 0 )
         return(1);
-    for (int32_t i = 0; i < NUM_KMD_NOTARIES; i++) 
+    if ( tp == 0 )
+        return(0);
+    for (int32_t i = 0; i < tp->numnotaries; i++) 
     {
-        if ( strcmp(coinaddr,NOTARY_ADDRESSES[season-1][i]) == 0 )
+        if ( strcmp(coinaddr,tp->addresses[i]) == 0 )
         {
-            //fprintf(stderr, "coinaddr.%s notaryaddress[%i].%s\n",coinaddr,i,NOTARY_ADDRESSES[season-1][i]);
+            //fprintf(stderr, "coinaddr.%s notaryaddress[%i].%s\n",coinaddr,i,tp->addresses[i]);
             return(1);
         }
     }
@@ -2020,6 +2127,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                 return state.DoS(0, error("AcceptToMemoryPool: not enough fees %s, %d < %d",hash.ToString(), nFees, txMinFee),REJECT_INSUFFICIENTFEE, "insufficient fee");
             }
         }
+
+        // Don't accept it if the pool was recently trimmed and it pays less than what was evicted
+        CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+        if (!tx.IsCoinImport() && !tx.IsPegsImport() && mempoolRejectFee > 0 && nFees < mempoolRejectFee)
+            return state.DoS(0, error("AcceptToMemoryPool: mempool min fee not met %s, %d < %d", hash.ToString(), nFees, mempoolRejectFee), REJECT_INSUFFICIENTFEE, "mempool min fee not met");
         
         // Require that free transactions have sufficient priority to be mined in the next block.
         if (GetBoolArg("-relaypriority", false) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
@@ -2115,6 +2227,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                 }
             }
         }
+
+        // trim the pool after the indexes are added so that an evicted transaction is also removed from them
+        LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        if (!pool.exists(hash))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
     }
     // This should be here still? 
     //SyncWithWallets(tx, NULL); 
@@ -2222,6 +2339,38 @@ bool myAddtomempool(CTransaction &tx, CValidationState *pstate, bool fSkipExpiry
     else return(true);
 }
 
+/** Reads the transaction at postx and the hash of its block, from the mapped blk file when possible */
+static bool ReadBlockFileTransaction(const CDiskTxPos &postx, CTransaction &txOut, uint256 &hashBlock)
+{
+    CBlockHeader header;
+    CBlockFileSpan span;
+    if (blockfilepool.GetBlock(postx, span)) {
+        try {
+            CMemoryReader s(span.begin, span.end, SER_DISK, CLIENT_VERSION);
+            s >> header;
+            s.ignore(postx.nTxOffset);
+            s >> txOut;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s", __func__, e.what());
+        }
+        hashBlock = header.GetHash();
+        return true;
+    }
+
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: OpenBlockFile failed", __func__);
+    try {
+        file >> header;
+        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+        file >> txOut;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    hashBlock = header.GetHash();
+    return true;
+}
+
 bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock)
 {
     memset(&hashBlock,0,sizeof(hashBlock));
@@ -2248,27 +2397,23 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
     }
     //fprintf(stderr,"check disk %s\n",hash.GetHex().c_str());
 
+    std::shared_ptr<const CTransaction> ptx;
+    if (fTxIndex && (ptx = txcache.Get(hash, hashBlock)))
+    {
+        txOut = *ptx;
+        return true;
+    }
     if (fTxIndex) {
         CDiskTxPos postx;
         //fprintf(stderr,"ReadTxIndex\n");
         if (pblocktree->ReadTxIndex(hash, postx)) {
-            //fprintf(stderr,"OpenBlockFile\n");
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            //fprintf(stderr,"seek and read\n");
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            }
-            hashBlock = header.GetHash();
+            //fprintf(stderr,"ReadBlockFileTransaction\n");
+            if (!ReadBlockFileTransaction(postx, txOut, hashBlock))
+                return false;
             if (txOut.GetHash() != hash)
                 return error("%s: txid mismatch", __func__);
             //fprintf(stderr,"found on disk %s\n",hash.GetHex().c_str());
+            txcache.Put(txOut, hashBlock);
             return true;
         }
     }
@@ -2307,23 +2452,20 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
         return true;
     }
 
+    std::shared_ptr<const CTransaction> ptx;
+    if ((fTxIndex || fAllowSlow) && (ptx = txcache.Get(hash, hashBlock)))
+    {
+        txOut = *ptx;
+        return true;
+    }
     if (fTxIndex) {
         CDiskTxPos postx;
         if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e) {
-                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            }
-            hashBlock = header.GetHash();
+            if (!ReadBlockFileTransaction(postx, txOut, hashBlock))
+                return false;
             if (txOut.GetHash() != hash)
                 return error("%s: txid mismatch", __func__);
+            txcache.Put(txOut, hashBlock);
             return true;
         }
     }
@@ -2347,6 +2489,7 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
                 if (tx.GetHash() == hash) {
                     txOut = tx;
                     hashBlock = pindexSlow->GetBlockHash();
+                    txcache.Put(txOut, hashBlock);
                     return true;
                 }
             }
@@ -2402,21 +2545,37 @@ bool ReadBlockFromDisk(int32_t height,CBlock& block, const CDiskBlockPos& pos,bo
     uint8_t pubkey33[33];
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
+    CBlockFileSpan span;
+    if (blockfilepool.GetBlock(pos, span))
     {
-        //fprintf(stderr,"readblockfromdisk err A\n");
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+        // Read block from the mapped file
+        try {
+            CMemoryReader s(span.begin, span.end, SER_DISK, CLIENT_VERSION);
+            s >> block;
+        }
+        catch (const std::exception& e) {
+            fprintf(stderr,"readblockfromdisk err B\n");
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
+    else
+    {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+        {
+            //fprintf(stderr,"readblockfromdisk err A\n");
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+        }
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        fprintf(stderr,"readblockfromdisk err B\n");
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            fprintf(stderr,"readblockfromdisk err B\n");
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
     // Check the header
     if ( 0 && checkPOW != 0 )
@@ -2446,6 +2605,71 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW)
     return true;
 }
 
+// the last blocks connected, in their serialized network form, most recently used first. ConnectTip fills it so the
+// zmq rawblock notifier, rest and getblock can send a new tip without reading it back from disk. A request for any
+// other block reads it from disk and does not insert it, so a scan over old blocks cannot push the tips out
+static const size_t MAX_SERIALIZED_BLOCKS = 8;
+static CCriticalSection cs_serializedBlocks;
+static std::list<std::pair<uint256, CSerializedBlockRef> > listSerializedBlocks;
+
+static void CacheSerializedBlock(const uint256 &hash, const CSerializedBlockRef &ref)
+{
+    LOCK(cs_serializedBlocks);
+    for (std::list<std::pair<uint256, CSerializedBlockRef> >::iterator it = listSerializedBlocks.begin(); it != listSerializedBlocks.end(); ++it)
+    {
+        if (it->first == hash)
+        {
+            listSerializedBlocks.erase(it);
+            break;
+        }
+    }
+    listSerializedBlocks.push_front(std::make_pair(hash, ref));
+    if (listSerializedBlocks.size() > MAX_SERIALIZED_BLOCKS)
+        listSerializedBlocks.pop_back();
+}
+
+static CSerializedBlockRef SerializeBlock(const CBlock &block)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    return std::make_shared<const std::vector<unsigned char> >(ss.begin(), ss.end());
+}
+
+CSerializedBlockRef GetSerializedBlock(const CBlockIndex *pindex)
+{
+    uint256 hash = pindex->GetBlockHash();
+    {
+        LOCK(cs_serializedBlocks);
+        for (std::list<std::pair<uint256, CSerializedBlockRef> >::iterator it = listSerializedBlocks.begin(); it != listSerializedBlocks.end(); ++it)
+        {
+            if (it->first == hash)
+            {
+                listSerializedBlocks.splice(listSerializedBlocks.begin(), listSerializedBlocks, it);
+                return it->second;
+            }
+        }
+    }
+    CBlock block;
+    {
+        LOCK(cs_main);
+        if (!ReadBlockFromDisk(block, pindex, 1))
+            return CSerializedBlockRef();
+    }
+    return SerializeBlock(block);
+}
+
+bool DeserializeBlock(CBlock &block, const CSerializedBlockRef &ref)
+{
+    try {
+        CDataStream ss(*ref, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> block;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s", __func__, e.what());
+    }
+    return true;
+}
+
 //uint64_t komodo_moneysupply(int32_t height);
 extern char ASSETCHAINS_SYMBOL[KOMODO_ASSETCHAIN_MAXLEN];
 extern uint64_t ASSETCHAINS_ENDSUBSIDY[ASSETCHAINS_MAX_ERAS+1], ASSETCHAINS_REWARD[ASSETCHAINS_MAX_ERAS+1], ASSETCHAINS_HALVING[ASSETCHAINS_MAX_ERAS+1];
@@ -2670,6 +2894,7 @@ void Misbehaving(NodeId pnode, int howmuch)
     if (howmuch == 0)
         return;
 
+    LOCK(cs_main);
     CNodeState *state = State(pnode);
     if (state == NULL)
         return;
@@ -3309,6 +3534,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
+        komodo_addressbalances_update(pindex, addressIndex, false);
     }
 
     return fClean;
@@ -3322,8 +3548,10 @@ void static FlushBlockFile(bool fFinalize = false)
 
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
+            blockfilepool.Invalidate(nLastBlockFile);
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -3346,6 +3574,83 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+bool CIndexCheck::operator()() {
+    const CTransaction &tx = *ptx;
+    const uint256 txhash = tx.GetHash();
+    if (!tx.IsMint() && ptxundo != NULL)
+    {
+        // the undo data holds the spent outputs in input order, UpdateCoins skips the pegs import input
+        size_t k = 0;
+        for (size_t j = 0; j < tx.vin.size(); j++)
+        {
+            const CTxIn &input = tx.vin[j];
+            if (tx.IsPegsImport() && input.prevout.n == 10e8) continue;
+            if (k >= ptxundo->vprevout.size())
+                return ::error("CIndexCheck(): %s missing undo data for input %d", txhash.ToString(), (int)j);
+            const CTxOut &prevout = ptxundo->vprevout[k++].txout;
+
+            vector<vector<unsigned char>> vSols;
+            CTxDestination vDest;
+            txnouttype txType = TX_PUBKEYHASH;
+            uint160 addrHash;
+            int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
+            if ( keyType != 0 )
+            {
+                for (auto addr : vSols)
+                {
+                    addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                    if (fAddressIndex) {
+                        // record spending activity
+                        pentries->addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, nHeight, nTx, txhash, j, true), prevout.nValue * -1));
+
+                        // remove address from unspent index
+                        pentries->addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+                    }
+                }
+
+                if (fSpentIndex) {
+                    // add the spent index to determine the txid and input that spent an output
+                    // and to find the amount and address from an input
+                    pentries->spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, nHeight, prevout.nValue, keyType, addrHash)));
+                }
+            }
+        }
+    }
+
+    if (fAddressIndex) {
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut &out = tx.vout[k];
+
+            uint160 addrHash;
+
+            vector<vector<unsigned char>> vSols;
+            CTxDestination vDest;
+            txnouttype txType = TX_PUBKEYHASH;
+            int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
+            if ( keyType != 0 )
+            {
+                for (auto addr : vSols)
+                {
+                    addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
+                    // record receiving activity
+                    pentries->addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, nHeight, nTx, txhash, k, false), out.nValue));
+
+                    // record unspent output
+                    pentries->addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static CCheckQueue<CIndexCheck> indexcheckqueue(128);
+
+void ThreadIndexCheck() {
+    RenameThread("komodo-indexch");
+    indexcheckqueue.Thread();
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -3567,9 +3872,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     // Construct the incremental merkle tree at the current
     // block position,
     auto old_sprout_tree_root = view.GetBestAnchor(SPROUT);
@@ -3621,39 +3923,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 return state.DoS(100, error("ConnectBlock(): JoinSplit requirements not met"),
                                  REJECT_INVALID, "bad-txns-joinsplit-requirements-not-met");
 
-            if (fAddressIndex || fSpentIndex)
-            {
-                for (size_t j = 0; j < tx.vin.size(); j++) 
-                {
-                    if (tx.IsPegsImport() && j==0) continue;
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-
-                    vector<vector<unsigned char>> vSols;
-                    CTxDestination vDest;
-                    txnouttype txType = TX_PUBKEYHASH;
-                    uint160 addrHash;
-                    int keyType = GetAddressType(prevout.scriptPubKey, vDest, txType, vSols);
-                    if ( keyType != 0 )
-                    {
-                        for (auto addr : vSols)
-                        {
-                            addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                            // record spending activity
-                            addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->GetHeight(), i, txhash, j, true), prevout.nValue * -1));
-
-                            // remove address from unspent index
-                            addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-                        }
-
-                        if (fSpentIndex) {
-                            // add the spent index to determine the txid and input that spent an output
-                            // and to find the amount and address from an input
-                            spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->GetHeight(), prevout.nValue, keyType, addrHash)));
-                        }
-                    }
-                }
-            }
             // Add in sigops done by pay-to-script-hash inputs;
             // this is to prevent a "rogue miner" from creating
             // an incredibly-expensive-to-validate block.
@@ -3693,31 +3962,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             control.Add(vChecks);
         }
 
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-
-                uint160 addrHash;
-
-                vector<vector<unsigned char>> vSols;
-                CTxDestination vDest;
-                txnouttype txType = TX_PUBKEYHASH;
-                int keyType = GetAddressType(out.scriptPubKey, vDest, txType, vSols);
-                if ( keyType != 0 )
-                {
-                    for (auto addr : vSols)
-                    {
-                        addrHash = addr.size() == 20 ? uint160(addr) : Hash160(addr);
-                        // record receiving activity
-                        addressIndex.push_back(make_pair(CAddressIndexKey(keyType, addrHash, pindex->GetHeight(), i, txhash, k, false), out.nValue));
-
-                        // record unspent output
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(keyType, addrHash, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->GetHeight())));
-                    }
-                }
-            }
-        }
-
         //if ( ASSETCHAINS_SYMBOL[0] == 0 )
         //    komodo_earned_interest(pindex->GetHeight(),sum);
         CTxUndo undoDummy;
@@ -3741,6 +3985,29 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
+
+    // Build the address and spent index entries of each transaction on the index check threads while the scripts
+    // are verified, the spent outputs are taken from the undo data
+    bool fIndexEntries = !fJustCheck && (fAddressIndex || fSpentIndex);
+    std::vector<CBlockIndexEntries> vTxIndexEntries;
+    CCheckQueueControl<CIndexCheck> indexcontrol(fIndexEntries && nScriptCheckThreads ? &indexcheckqueue : NULL);
+    if (fIndexEntries)
+    {
+        vTxIndexEntries.resize(block.vtx.size());
+        std::vector<CIndexCheck> vIndexChecks;
+        for (unsigned int i = 0; i < block.vtx.size(); i++)
+        {
+            CIndexCheck check(block.vtx[i], i > 0 ? &blockundo.vtxundo[i - 1] : NULL, pindex->GetHeight(), i, &vTxIndexEntries[i]);
+            if (nScriptCheckThreads)
+            {
+                vIndexChecks.push_back(CIndexCheck());
+                check.swap(vIndexChecks.back());
+            }
+            else if (!check())
+                return AbortNode(state, "Failed to build block index entries");
+        }
+        indexcontrol.Add(vIndexChecks);
+    }
     
     // This is moved from CheckBlock for staking chains, so we can enforce the staking tx value was indeed paid to the coinbase.
     //fprintf(stderr, "blockReward.%li stakeTxValue.%li sum.%li\n",blockReward,stakeTxValue,sum);
@@ -3804,6 +4071,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fJustCheck)
         return true;
 
+    // Collect the index entries before anything is written, a failure is a fault of the local undo data and
+    // not of the block
+    if (fIndexEntries && !indexcontrol.Wait())
+        return AbortNode(state, "Failed to build block index entries");
+
     // Write undo information to disk
     //fprintf(stderr,"nFile.%d isNull %d vs isvalid %d nStatus %x\n",(int32_t)pindex->nFile,pindex->GetUndoPos().IsNull(),pindex->IsValid(BLOCK_VALID_SCRIPTS),(uint32_t)pindex->nStatus);
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
@@ -3839,23 +4111,23 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     ConnectNotarisations(block, pindex->GetHeight()); // MoMoM notarisation DB.
 
+    // Merge the index entries into one batch
+    std::shared_ptr<CBlockIndexEntries> pentries = std::make_shared<CBlockIndexEntries>();
     if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
-    if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
+        pentries->vPos.swap(vPos);
+    if (fIndexEntries)
+    {
+        for (const CBlockIndexEntries &txentries : vTxIndexEntries)
+        {
+            pentries->addressIndex.insert(pentries->addressIndex.end(), txentries.addressIndex.begin(), txentries.addressIndex.end());
+            pentries->addressUnspentIndex.insert(pentries->addressUnspentIndex.end(), txentries.addressUnspentIndex.begin(), txentries.addressUnspentIndex.end());
+            pentries->spentIndex.insert(pentries->spentIndex.end(), txentries.spentIndex.begin(), txentries.spentIndex.end());
         }
     }
 
-    if (fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
-
+    // the logical timestamp of the last connected block, its entry may still be written in the background
+    static uint256 hashLastTimestamp;
+    static unsigned int lastLogicalTS = 0;
     if (fTimestampIndex)
     {
         unsigned int logicalTS = pindex->nTime;
@@ -3863,20 +4135,34 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
         // retrieve logical timestamp of the previous block
         if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
+        {
+            if (pindex->pprev->GetBlockHash() == hashLastTimestamp)
+                prevLogicalTS = lastLogicalTS;
+            else if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
                 LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+        }
 
         if (logicalTS <= prevLogicalTS) {
             logicalTS = prevLogicalTS + 1;
             LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
         }
 
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
+        pentries->fTimestampIndex = true;
+        pentries->logicalTS = logicalTS;
+        pentries->hashBlock = pindex->GetBlockHash();
+    }
 
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
+    if (!pblocktree->WriteBlockIndexEntries(pentries, fAsyncIndexWrites))
+        return AbortNode(state, "Failed to write block indexes");
+    if (fTimestampIndex)
+    {
+        hashLastTimestamp = pindex->GetBlockHash();
+        lastLogicalTS = pentries->logicalTS;
     }
+    if (fAddressIndex)
+        komodo_addressbalances_update(pindex, pentries->addressIndex, true);
+    // after the last step that can fail, the kv db is not rolled back when ConnectBlock returns false
+    komodo_kvconnectblock(pindex, block); // KV DB.
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -3964,6 +4250,9 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
+            // and the index entries of the connected blocks, the block index and the chain state must not get ahead of them
+            if (!pblocktree->SyncIndexWrites())
+                return AbortNode(state, "Failed to write block indexes");
             // Then update all block file information (which may refer to block and undo files).
             {
                 std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -3974,14 +4263,20 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                     setDirtyFileInfo.erase(it++);
                 }
                 std::vector<const CBlockIndex*> vBlocks;
+                std::vector<CBlockIndex*> vWritten;
                 vBlocks.reserve(setDirtyBlockIndex.size());
+                vWritten.reserve(setDirtyBlockIndex.size());
                 for (set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
                     vBlocks.push_back(*it);
+                    vWritten.push_back(*it);
                     setDirtyBlockIndex.erase(it++);
                 }
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return AbortNode(state, "Files to write to block index database");
                 }
+                // the solutions of the written entries can be read back from the db, they need not stay in memory
+                BOOST_FOREACH(CBlockIndex* pindex, vWritten)
+                    pindex->TrimSolution();
             }
             // Finally remove any pruned files
             if (fFlushForPrune)
@@ -4112,6 +4407,10 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
         DisconnectNotarisations(block);
+        komodo_kvdisconnectblock(pindexDelete);
+        txcache.EraseBlock(block);
+        if ( ASSETCHAINS_CC != 0 )
+            CCDisconnectBlock(block,pindexDelete->GetHeight()); // cc module caches and indexes
     }
     pindexDelete->segid = -2;
     pindexDelete->nNotaryPay = 0; 
@@ -4298,6 +4597,9 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
             }
             return error("ConnectTip(): ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
         }
+        // the txindex still points to the disconnected block until this one is connected, so a read in between may
+        // have cached its transactions with their old block
+        txcache.EraseBlock(*pblock);
         mapBlockSource.erase(pindexNew->GetBlockHash());
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
@@ -4323,6 +4625,8 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
 
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    if (!IsInitialBlockDownload())
+        CacheSerializedBlock(pindexNew->GetBlockHash(), SerializeBlock(*pblock));
     if ( KOMODO_NSPV_FULLNODE )
     {
         // Tell wallet about transactions that went from mempool
@@ -4355,6 +4659,8 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     {
         if ( ASSETCHAINS_CBOPRET != 0 )
             komodo_pricesupdate(pindexNew->GetHeight(),pblock);
+        if ( ASSETCHAINS_CC != 0 )
+            CCConnectBlock(*pblock,pindexNew->GetHeight()); // cc module caches and indexes
         if ( ASSETCHAINS_SAPLING <= 0 && pindexNew->nTime > KOMODO_SAPLING_ACTIVATION - 24*3600 )
             komodo_activate_sapling(pindexNew);
         if ( ASSETCHAINS_CC != 0 && KOMODO_SNAPSHOT_INTERVAL != 0 && (pindexNew->GetHeight() % KOMODO_SNAPSHOT_INTERVAL) == 0 && pindexNew->GetHeight() >= KOMODO_SNAPSHOT_INTERVAL )
@@ -4683,7 +4989,7 @@ bool InvalidateBlock(CValidationState& state, CBlockIndex *pindex) {
             return false;
         }
     }
-    //LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
 
     // The resulting new best tip may not be in setBlockIndexCandidates anymore, so
     // add it again.
@@ -5940,6 +6246,7 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockfilepool.Invalidate(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -6073,9 +6380,10 @@ bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
     LogPrintf("%s: start loading guts\n", __func__);
+    int64_t nStart = GetTimeMillis();
     if (!pblocktree->LoadBlockIndexGuts())
         return false;
-    LogPrintf("%s: loaded guts\n", __func__);
+    LogPrintf("%s: loaded guts, %u entries in %dms\n", __func__, mapBlockIndex.size(), GetTimeMillis() - nStart);
     boost::this_thread::interruption_point();
 
     // Calculate chainPower
@@ -6263,6 +6571,123 @@ bool static LoadBlockIndexDB()
     return true;
 }
 
+/** A block of the VerifyDB window with the results of check level 0, the stateless part of level 1 and level 2 */
+struct CVerifyBlock
+{
+    CBlockIndex *pindex;
+    CBlock block;
+    bool fRead;
+    bool fSolution;
+    bool fMerkleRoot;
+    bool fMutated;
+    bool fUndo;
+    int64_t nReadTime;
+    int64_t nCheckTime;
+    int64_t nUndoTime;
+
+    CVerifyBlock() : pindex(NULL), fRead(false), fSolution(false), fMerkleRoot(false), fMutated(false), fUndo(false), nReadTime(0), nCheckTime(0), nUndoTime(0) {}
+};
+
+/** Reads a block, checks its equihash solution and merkle root and its undo data for VerifyDB. The results are left
+ *  in the entry so that the blocks are judged in chain order, the check itself always succeeds so that the queue does
+ *  not skip the rest of the window. */
+class CBlockReadCheck
+{
+private:
+    CVerifyBlock *pentry;
+    bool fCheck;
+    bool fUndo;
+
+public:
+    CBlockReadCheck(): pentry(0), fCheck(false), fUndo(false) {}
+    CBlockReadCheck(CVerifyBlock *pentryIn, bool fCheckIn, bool fUndoIn) : pentry(pentryIn), fCheck(fCheckIn), fUndo(fUndoIn) {}
+
+    bool operator()()
+    {
+        int64_t nTimeStart = GetTimeMicros();
+        pentry->fRead = ReadBlockFromDisk(pentry->block, pentry->pindex, 0);
+        int64_t nTimeRead = GetTimeMicros();
+        pentry->nReadTime = nTimeRead - nTimeStart;
+        pentry->fSolution = pentry->fMerkleRoot = true;
+        if (fCheck && pentry->fRead)
+        {
+            pentry->fSolution = CheckEquihashSolution(&pentry->block, Params());
+            pentry->fMerkleRoot = (pentry->block.BuildMerkleTree(&pentry->fMutated) == pentry->block.hashMerkleRoot);
+            pentry->nCheckTime = GetTimeMicros() - nTimeRead;
+            nTimeRead = GetTimeMicros();
+        }
+        pentry->fUndo = true;
+        if (fUndo && pentry->fRead)
+        {
+            CBlockUndo undo;
+            CDiskBlockPos pos = pentry->pindex->GetUndoPos();
+            if (!pos.IsNull())
+                pentry->fUndo = UndoReadFromDisk(undo, pos, pentry->pindex->pprev->GetBlockHash());
+            pentry->nUndoTime = GetTimeMicros() - nTimeRead;
+        }
+        return true;
+    }
+
+    void swap(CBlockReadCheck &check) {
+        std::swap(pentry, check.pentry);
+        std::swap(fCheck, check.fCheck);
+        std::swap(fUndo, check.fUndo);
+    }
+};
+
+/** The -par threads VerifyDB reads blocks on, they only live for the duration of the verification */
+class CBlockReadThreads
+{
+private:
+    CCheckQueue<CBlockReadCheck> queue;
+    boost::thread_group threads;
+    int nThreads;
+
+    static void Thread(CCheckQueue<CBlockReadCheck> *pqueue)
+    {
+        RenameThread("komodo-verifydb");
+        pqueue->Thread();
+    }
+
+public:
+    CBlockReadThreads(int nThreadsIn) : queue(1), nThreads(std::max(nThreadsIn, 1))
+    {
+        // the thread calling Wait is the last reader
+        for (int i = 0; i < nThreads - 1; i++)
+            threads.create_thread(boost::bind(&CBlockReadThreads::Thread, &queue));
+    }
+
+    ~CBlockReadThreads()
+    {
+        Wait();
+        threads.interrupt_all();
+        threads.join_all();
+    }
+
+    int GetThreads() const { return nThreads; }
+
+    void Add(std::vector<CVerifyBlock> &window, bool fCheck, bool fUndo)
+    {
+        std::vector<CBlockReadCheck> vChecks;
+        vChecks.reserve(window.size());
+        for (CVerifyBlock &entry : window)
+            vChecks.push_back(CBlockReadCheck(&entry, fCheck, fUndo));
+        if (nThreads > 1)
+            queue.Add(vChecks);
+        else
+        {
+            for (CBlockReadCheck &check : vChecks)
+                check();
+        }
+    }
+
+    void Wait()
+    {
+        if (nThreads > 1)
+            queue.Wait();
+    }
+};
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0);
@@ -6293,51 +6718,88 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
     CValidationState state;
     // No need to verify JoinSplits twice
     auto verifier = libzcash::ProofVerifier::Disabled();
-    //fprintf(stderr,"start VerifyDB %u\n",(uint32_t)time(NULL));
-    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
+    int64_t nTimeRead = 0, nTimeSolution = 0, nTimeUndo = 0, nTimeWait = 0, nTimeCheck = 0, nTimeDisconnect = 0, nTimeConnect = 0;
+
+    // Levels 0 and 2 and the equihash solution and merkle root of level 1 only read the disk and hash, they run on
+    // the -par threads one window ahead of the remaining checks. The rest of CheckBlock and the coins checks use the
+    // komodo and mempool state and stay serial.
+    std::vector<CVerifyBlock> vWindows[2];
+    CBlockReadThreads readers(nScriptCheckThreads);
+    size_t nWindowSize = VERIFYDB_BLOCKS_PER_THREAD * readers.GetThreads();
+    int nStopHeight = chainActive.Height() - nCheckDepth;
+    CBlockIndex *pindexNext = chainActive.Tip();
+    auto queueWindow = [&](std::vector<CVerifyBlock> &window) {
+        window.clear();
+        while (window.size() < nWindowSize && pindexNext && pindexNext->pprev && pindexNext->GetHeight() >= nStopHeight)
+        {
+            window.push_back(CVerifyBlock());
+            window.back().pindex = pindexNext;
+            pindexNext = pindexNext->pprev;
+        }
+        readers.Add(window, nCheckLevel >= 1, nCheckLevel >= 2);
+    };
+
+    int nWindow = 0;
+    queueWindow(vWindows[nWindow]);
+    while (!vWindows[nWindow].empty())
     {
-        boost::this_thread::interruption_point();
-        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->GetHeight())) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
-        if (pindex->GetHeight() < chainActive.Height()-nCheckDepth)
-            break;
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex,0))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->GetHeight(), pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        int32_t futureblock;
-        if (nCheckLevel >= 1 && !CheckBlock(&futureblock,pindex->GetHeight(),pindex,block, state, verifier,0) )
-            return error("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->GetHeight(), pindex->GetBlockHash().ToString());
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->GetHeight(), pindex->GetBlockHash().ToString());
-            }
-        }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
-            bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
-                return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->GetHeight(), pindex->GetBlockHash().ToString());
-            pindexState = pindex->pprev;
-            if (!fClean) {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            } else
-                nGoodTransactions += block.vtx.size();
-        }
-        if (ShutdownRequested())
-            return true;
+        int64_t nTimeStart = GetTimeMicros();
+        readers.Wait();
+        nTimeWait += GetTimeMicros() - nTimeStart;
+        queueWindow(vWindows[1 - nWindow]);
+        for (CVerifyBlock &entry : vWindows[nWindow])
+        {
+            CBlockIndex *pindex = entry.pindex;
+            CBlock &block = entry.block;
+            boost::this_thread::interruption_point();
+            uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->GetHeight())) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
+            nTimeRead += entry.nReadTime;
+            nTimeSolution += entry.nCheckTime;
+            nTimeUndo += entry.nUndoTime;
+            // check level 0: read from disk
+            if (!entry.fRead)
+                return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->GetHeight(), pindex->GetBlockHash().ToString());
+            // check level 1: verify block validity, the solution and merkle root were checked by the readers
+            if (!entry.fSolution)
+                return error("VerifyDB(): *** invalid Equihash solution at %d, hash=%s\n", pindex->GetHeight(), pindex->GetBlockHash().ToString());
+            if (!entry.fMerkleRoot)
+                return error("VerifyDB(): *** hashMerkleRoot mismatch at %d, hash=%s\n", pindex->GetHeight(), pindex->GetBlockHash().ToString());
+            if (entry.fMutated)
+                return error("VerifyDB(): *** duplicate transaction at %d, hash=%s\n", pindex->GetHeight(), pindex->GetBlockHash().ToString());
+            int32_t futureblock;
+            nTimeStart = GetTimeMicros();
+            if (nCheckLevel >= 1 && !CheckBlock(&futureblock,pindex->GetHeight(),pindex,block, state, verifier,0,false) )
+                return error("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->GetHeight(), pindex->GetBlockHash().ToString());
+            nTimeCheck += GetTimeMicros() - nTimeStart;
+            // check level 2: verify undo validity
+            if (nCheckLevel >= 2 && !entry.fUndo)
+                return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->GetHeight(), pindex->GetBlockHash().ToString());
+            // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
+            nTimeStart = GetTimeMicros();
+            if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
+                bool fClean = true;
+                if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+                    return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->GetHeight(), pindex->GetBlockHash().ToString());
+                pindexState = pindex->pprev;
+                if (!fClean) {
+                    nGoodTransactions = 0;
+                    pindexFailure = pindex;
+                } else
+                    nGoodTransactions += block.vtx.size();
+            }
+            nTimeDisconnect += GetTimeMicros() - nTimeStart;
+            block.SetNull();
+            if (ShutdownRequested())
+                return true;
+        }
+        nWindow = 1 - nWindow;
     }
-    //fprintf(stderr,"end VerifyDB %u\n",(uint32_t)time(NULL));
     if (pindexFailure)
         return error("VerifyDB(): *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", chainActive.Height() - pindexFailure->GetHeight() + 1, nGoodTransactions);
 
     // check level 4: try reconnecting blocks
     if (nCheckLevel >= 4) {
+        int64_t nTimeStart = GetTimeMicros();
         CBlockIndex *pindex = pindexState;
         while (pindex != chainActive.Tip()) {
             boost::this_thread::interruption_point();
@@ -6349,10 +6811,13 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
             if (!ConnectBlock(block, state, pindex, coins,false, true))
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s", pindex->GetHeight(), pindex->GetBlockHash().ToString());
         }
+        nTimeConnect = GetTimeMicros() - nTimeStart;
     }
 
     LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", chainActive.Height() - pindexState->GetHeight(), nGoodTransactions);
-    
+    LogPrintf("VerifyDB: read %.2fms, solution and merkle root %.2fms, undo %.2fms on %d threads (waited %.2fms), check %.2fms, disconnect %.2fms, reconnect %.2fms\n",
+              nTimeRead * 0.001, nTimeSolution * 0.001, nTimeUndo * 0.001, readers.GetThreads(), nTimeWait * 0.001, nTimeCheck * 0.001, nTimeDisconnect * 0.001, nTimeConnect * 0.001);
+
     return true;
 }
 
@@ -7009,8 +7474,8 @@ void static ProcessGetData(CNode* pfrom)
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
-
+    // cs_main is only held to look the requested blocks up, the block files are read without it so that
+    // peers downloading blocks do not hold up validation
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -7024,33 +7489,46 @@ void static ProcessGetData(CNode* pfrom)
             if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
             {
                 bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
+                CDiskBlockPos pos;
+                int32_t nHeight = 0;
                 {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                        (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
-                        (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
-                        if (!send) {
-                            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                    LOCK(cs_main);
+                    BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+                    if (mi != mapBlockIndex.end())
+                    {
+                        if (chainActive.Contains(mi->second)) {
+                            send = true;
+                        } else {
+                            static const int nOneMonth = 30 * 24 * 60 * 60;
+                            // To prevent fingerprinting attacks, only send blocks outside of the active
+                            // chain if they are valid, and no more than a month older (both in time, and in
+                            // best equivalent proof of work) than the best header chain we know about.
+                            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+                            (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
+                            (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
+                            if (!send) {
+                                LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                            }
                         }
                     }
+                    // Pruned nodes may have deleted the block, so check whether
+                    // it's available before trying to send.
+                    if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                    {
+                        pos = mi->second->GetBlockPos();
+                        nHeight = mi->second->GetHeight();
+                    }
+                    else
+                        send = false;
                 }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                if (send)
                 {
                     // Send block from disk
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second,1))
+                    if (!ReadBlockFromDisk(nHeight, block, pos, 1) || block.GetHash() != inv.hash)
                     {
-                        assert(!"cannot load block from disk");
+                        // the file may have been pruned since the lookup
+                        LogPrintf("%s: cannot load block %s from disk for peer=%i\n", __func__, inv.hash.ToString(), pfrom->GetId());
                     }
                     else
                     {
@@ -7092,7 +7570,10 @@ void static ProcessGetData(CNode* pfrom)
                         // and we want it right after the last block so they don't
                         // wait for other stuff first.
                         vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                        {
+                            LOCK(cs_main);
+                            vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                        }
                         pfrom->PushMessage("inv", vInv);
                         pfrom->hashContinue.SetNull();
                     }
@@ -7398,9 +7879,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     LOCK(cs_vNodes);
                     // Use deterministic randomness to send to the same nodes for 24 hours
                     // at a time so the addrKnowns of the chosen nodes prevent repeats
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
+                    static const uint256 hashSalt = GetRandHash();
                     uint64_t hashAddr = addr.GetHash();
                     uint256 hashRand = ArithToUint256(UintToArith256(hashSalt) ^ (hashAddr<<32) ^ ((GetTime()+hashAddr)/(24*60*60)));
                     hashRand = Hash(BEGIN(hashRand), END(hashRand));
@@ -7524,7 +8003,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         pfrom->fSentAddr = true;
         
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_vAddrToSend);
+            pfrom->vAddrToSend.clear();
+        }
         vector<CAddress> vAddr = addrman.GetAddr();
         BOOST_FOREACH(const CAddress &addr, vAddr)
         pfrom->PushAddress(addr);
@@ -7537,6 +8019,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         vRecv >> payload;
 
         if (strCommand == "getnSPV" && KOMODO_NSPV == 0) {
+            // the requests are served concurrently with other messages, cs_main is only taken around the chain reads
             komodo_nSPVreq(pfrom, payload);
         } else if (strCommand == "nSPV" && KOMODO_NSPV_SUPERLITE) {
             komodo_nSPVresp(pfrom, payload);
@@ -7673,57 +8156,61 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
-        LOCK(cs_main);
-
-        if (chainActive.LastTip() != 0 && chainActive.LastTip()->GetHeight() > 100000 && IsInitialBlockDownload())
-        {
-            //fprintf(stderr,"dont process getheaders during initial download\n");
-            return true;
-        }
-        CBlockIndex* pindex = NULL;
-        if (locator.IsNull())
+        // we must use CNetworkBlockHeader, as CBlockHeader won't include the 0x00 nTx count at the end for compatibility
+        vector<CNetworkBlockHeader> vHeaders;
         {
-            // If locator is null, return the hashStop block
-            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
-            if (mi == mapBlockIndex.end())
+            LOCK(cs_main);
+
+            if (chainActive.LastTip() != 0 && chainActive.LastTip()->GetHeight() > 100000 && IsInitialBlockDownload())
             {
-                //fprintf(stderr,"mi == end()\n");
+                //fprintf(stderr,"dont process getheaders during initial download\n");
                 return true;
             }
-            pindex = (*mi).second;
-        }
-        else
-        {
-            // Find the last block the caller has in the main chain
-            pindex = FindForkInGlobalIndex(chainActive, locator);
-            if (pindex)
-                pindex = chainActive.Next(pindex);
-        }
+            CBlockIndex* pindex = NULL;
+            if (locator.IsNull())
+            {
+                // If locator is null, return the hashStop block
+                BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+                if (mi == mapBlockIndex.end())
+                {
+                    //fprintf(stderr,"mi == end()\n");
+                    return true;
+                }
+                pindex = (*mi).second;
+            }
+            else
+            {
+                // Find the last block the caller has in the main chain
+                pindex = FindForkInGlobalIndex(chainActive, locator);
+                if (pindex)
+                    pindex = chainActive.Next(pindex);
+            }
 
-        // we must use CNetworkBlockHeader, as CBlockHeader won't include the 0x00 nTx count at the end for compatibility
-        vector<CNetworkBlockHeader> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
-        LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->GetHeight() : -1), hashStop.ToString(), pfrom->id);
-        //if ( pfrom->lasthdrsreq >= chainActive.Height()-MAX_HEADERS_RESULTS || pfrom->lasthdrsreq != (int32_t)(pindex ? pindex->GetHeight() : -1) )// no need to ever suppress this
-        {
-            pfrom->lasthdrsreq = (int32_t)(pindex ? pindex->GetHeight() : -1);
-            for (; pindex; pindex = chainActive.Next(pindex))
+            int nLimit = MAX_HEADERS_RESULTS;
+            LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->GetHeight() : -1), hashStop.ToString(), pfrom->id);
+            //if ( pfrom->lasthdrsreq >= chainActive.Height()-MAX_HEADERS_RESULTS || pfrom->lasthdrsreq != (int32_t)(pindex ? pindex->GetHeight() : -1) )// no need to ever suppress this
             {
-                CBlockHeader h = pindex->GetBlockHeader();
-                //printf("size.%i, solution size.%i\n", (int)sizeof(h), (int)h.nSolution.size());
-                //printf("hash.%s prevhash.%s nonce.%s\n", h.GetHash().ToString().c_str(), h.hashPrevBlock.ToString().c_str(), h.nNonce.ToString().c_str());
-                vHeaders.push_back(pindex->GetBlockHeader());
-                if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
-                    break;
+                pfrom->lasthdrsreq = (int32_t)(pindex ? pindex->GetHeight() : -1);
+                for (; pindex; pindex = chainActive.Next(pindex))
+                {
+                    // a header whose solution cannot be read back is not sent, nor anything after it
+                    CBlockHeader header;
+                    if (!pindex->GetBlockHeader(header))
+                        break;
+                    vHeaders.push_back(header);
+                    if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
+                        break;
+                }
             }
-            pfrom->PushMessage("headers", vHeaders);
+            /*else if ( IS_KOMODO_NOTARY != 0 )
+            {
+                static uint32_t counter;
+                if ( counter++ < 3 )
+                    fprintf(stderr,"you can ignore redundant getheaders from peer.%d %d prev.%d\n",(int32_t)pfrom->id,(int32_t)(pindex ? pindex->GetHeight() : -1),pfrom->lasthdrsreq);
+            }*/
         }
-        /*else if ( IS_KOMODO_NOTARY != 0 )
-        {
-            static uint32_t counter;
-            if ( counter++ < 3 )
-                fprintf(stderr,"you can ignore redundant getheaders from peer.%d %d prev.%d\n",(int32_t)pfrom->id,(int32_t)(pindex ? pindex->GetHeight() : -1),pfrom->lasthdrsreq);
-        }*/
+        // the headers are serialized and queued without holding cs_main
+        pfrom->PushMessage("headers", vHeaders);
     }
 
 
@@ -7991,7 +8478,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
     else if (strCommand == "mempool")
     {
-        LOCK2(cs_main, pfrom->cs_filter);
+        LOCK(pfrom->cs_filter);
 
         std::vector<uint256> vtxid;
         mempool.queryHashes(vtxid);
@@ -8083,16 +8570,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         // Nodes must NEVER send a data item > 520 bytes (the max size for a script data object,
         // and thus, the maximum size any matched object can have) in a filteradd message
-        if (vData.size() > MAX_SCRIPT_ELEMENT_SIZE)
+        bool fBadFilter = vData.size() > MAX_SCRIPT_ELEMENT_SIZE;
+        if (!fBadFilter)
         {
-            Misbehaving(pfrom->GetId(), 100);
-        } else {
             LOCK(pfrom->cs_filter);
             if (pfrom->pfilter)
                 pfrom->pfilter->insert(vData);
             else
-                Misbehaving(pfrom->GetId(), 100);
+                fBadFilter = true;
         }
+        // Misbehaving takes cs_main, which RelayTransaction holds while it takes cs_filter, so it is called after cs_filter is released
+        if (fBadFilter)
+            Misbehaving(pfrom->GetId(), 100);
     }
 
 
@@ -8146,6 +8635,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 }
 
 // requires LOCK(cs_vRecvMsg)
+// Messages are handled by several threads, each one working on a different peer. The commands below only touch the
+// sending peer, addrman or the mempool, or take cs_main themselves just long enough to read the chain, so they run
+// concurrently. All other messages change the chain state or rely on being processed one at a time, they are handled
+// under cs_msgSerial.
+static CCriticalSection cs_msgSerial;
+static const std::set<std::string> setConcurrentMessages = {
+    "verack", "addr", "ping", "pong", "getaddr", "getnSPV", "inv", "getdata", "getblocks", "getheaders",
+    "mempool", "filterload", "filteradd", "filterclear", "reject", "notfound"
+};
+
 bool ProcessMessages(CNode* pfrom)
 {
     //if (fDebug)
@@ -8160,6 +8659,7 @@ bool ProcessMessages(CNode* pfrom)
     //  (x) data
     //
     bool fOk = true;
+    bool fProcessedSerial = false;
 
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(pfrom);
@@ -8185,6 +8685,18 @@ bool ProcessMessages(CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // a message waiting for another thread to finish its serial message stays queued, the peer's messages are
+        // processed in order
+        bool fSerial = setConcurrentMessages.count(msg.hdr.GetCommand()) == 0;
+        CCriticalBlock lockSerial(fSerial ? &cs_msgSerial : NULL, "cs_msgSerial", __FILE__, __LINE__, true);
+        if (fSerial && !lockSerial)
+        {
+            pfrom->fWaitSerial = true;
+            break;
+        }
+        pfrom->fWaitSerial = false;
+        fProcessedSerial = fSerial;
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -8262,6 +8774,10 @@ bool ProcessMessages(CNode* pfrom)
     if (!pfrom->fDisconnect)
         pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin(), it);
 
+    // peers with a serial message queued can go on now
+    if (fProcessedSerial)
+        WakeMessageHandler();
+
     return fOk;
 }
 
@@ -8311,18 +8827,25 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         static int64_t nLastRebroadcast;
         if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60))
         {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
+            // cs_vSend of pto is held, relays take cs_vNodes before the cs_vSend of the peers they push to
+            TRY_LOCK(cs_vNodes, lockNodes);
+            if (lockNodes)
             {
-                // Periodically clear addrKnown to allow refresh broadcasts
-                if (nLastRebroadcast)
-                    pnode->addrKnown.reset();
+                BOOST_FOREACH(CNode* pnode, vNodes)
+                {
+                    // Periodically clear addrKnown to allow refresh broadcasts
+                    if (nLastRebroadcast)
+                    {
+                        LOCK(pnode->cs_vAddrToSend);
+                        pnode->addrKnown.reset();
+                    }
 
-                // Rebroadcast our address
-                AdvertizeLocal(pnode);
+                    // Rebroadcast our address
+                    AdvertizeLocal(pnode);
+                }
+                if (!vNodes.empty())
+                    nLastRebroadcast = GetTime();
             }
-            if (!vNodes.empty())
-                nLastRebroadcast = GetTime();
         }
 
         //
@@ -8331,24 +8854,22 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (fSendTrickle)
         {
             vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
             {
-                if (!pto->addrKnown.contains(addr.GetKey()))
+                LOCK(pto->cs_vAddrToSend);
+                vAddr.reserve(pto->vAddrToSend.size());
+                BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
                 {
-                    pto->addrKnown.insert(addr.GetKey());
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000)
+                    if (!pto->addrKnown.contains(addr.GetKey()))
                     {
-                        pto->PushMessage("addr", vAddr);
-                        vAddr.clear();
+                        pto->addrKnown.insert(addr.GetKey());
+                        vAddr.push_back(addr);
                     }
                 }
+                pto->vAddrToSend.clear();
             }
-            pto->vAddrToSend.clear();
-            if (!vAddr.empty())
-                pto->PushMessage("addr", vAddr);
+            // receiver rejects addr messages larger than 1000
+            for (size_t i = 0; i < vAddr.size(); i += 1000)
+                pto->PushMessage("addr", vector<CAddress>(vAddr.begin() + i, vAddr.begin() + std::min(vAddr.size(), i + 1000)));
         }
 
         CNodeState &state = *State(pto->GetId());
@@ -47,6 +47,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -60,12 +61,14 @@ class CBlockTreeDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CTxUndo;
 class CValidationInterface;
 class CValidationState;
 class PrecomputedTransactionData;
 
 struct CNodeStateStats;
-#define DEFAULT_MEMPOOL_EXPIRY 1
+/** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
+#define DEFAULT_MEMPOOL_EXPIRY 72
 #define _COINBASE_MATURITY 100
 
 /** Default for -blockmaxsize and -blockminsize, which control the range of sizes the mining code will create **/
@@ -73,6 +76,8 @@ static const unsigned int DEFAULT_BLOCK_MAX_SIZE = 2000000;//MAX_BLOCK_SIZE;
 static const unsigned int DEFAULT_BLOCK_MIN_SIZE = 0;
 /** Default for -blockprioritysize, maximum space for zero/low-fee transactions **/
 static const unsigned int DEFAULT_BLOCK_PRIORITY_SIZE = DEFAULT_BLOCK_MAX_SIZE / 2;
+/** Default for -maxmempool, maximum megabytes of mempool memory usage */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
 /** Default for accepting alerts from the P2P network. */
 static const bool DEFAULT_ALERTS = true;
 /** Minimum alert priority for enabling safe mode. */
@@ -100,6 +105,8 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Number of blocks VerifyDB reads ahead per script-checking thread */
+static const unsigned int VERIFYDB_BLOCKS_PER_THREAD = 4;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -128,6 +135,7 @@ static const bool DEFAULT_NSPV_PROCESSING = false;
 #define DEFAULT_ADDRESSINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 #define DEFAULT_SPENTINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 static const bool DEFAULT_TIMESTAMPINDEX = false;
+static const bool DEFAULT_ASYNCINDEXWRITES = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
 
@@ -160,6 +168,8 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+/** Write the index entries of a connected block in the background, see CBlockTreeDB::WriteBlockIndexEntries */
+extern bool fAsyncIndexWrites;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -242,6 +252,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the index checking thread */
+void ThreadIndexCheck();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -798,6 +810,49 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/** Index entries of a connected block, written by CBlockTreeDB::WriteBlockIndexEntries in one batch */
+struct CBlockIndexEntries
+{
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    bool fTimestampIndex;
+    unsigned int logicalTS;
+    uint256 hashBlock;
+
+    CBlockIndexEntries() : fTimestampIndex(false), logicalTS(0) {}
+};
+
+/**
+ * Closure building the address and spent index entries of one transaction of a connected block, run on the
+ * index check queue while the scripts of the block are verified. The spent outputs come from the undo data.
+ */
+class CIndexCheck
+{
+private:
+    const CTransaction *ptx;
+    const CTxUndo *ptxundo;
+    int nHeight;
+    unsigned int nTx;
+    CBlockIndexEntries *pentries;
+
+public:
+    CIndexCheck(): ptx(0), ptxundo(0), nHeight(0), nTx(0), pentries(0) {}
+    CIndexCheck(const CTransaction& txIn, const CTxUndo *ptxundoIn, int nHeightIn, unsigned int nTxIn, CBlockIndexEntries *pentriesIn) :
+        ptx(&txIn), ptxundo(ptxundoIn), nHeight(nHeightIn), nTx(nTxIn), pentries(pentriesIn) { }
+
+    bool operator()();
+
+    void swap(CIndexCheck &check) {
+        std::swap(ptx, check.ptx);
+        std::swap(ptxundo, check.ptxundo);
+        std::swap(nHeight, check.nHeight);
+        std::swap(nTx, check.nTx);
+        std::swap(pentries, check.pentries);
+    }
+};
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(uint160 addressHash, int type,
@@ -812,6 +867,14 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos,bool checkPOW);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW);
 bool PruneOneBlockFile(bool tempfile, const int fileNumber);
 
+/** A block in its serialized network form, shared between the zmq, rest and rpc consumers */
+typedef std::shared_ptr<const std::vector<unsigned char> > CSerializedBlockRef;
+/** Returns the block from the cache of recently connected tips, reading it from disk on a miss (without caching it).
+ *  Empty if the block cannot be read. Does not need cs_main on a hit. */
+CSerializedBlockRef GetSerializedBlock(const CBlockIndex* pindex);
+/** Deserializes a block returned by GetSerializedBlock, for callers that also need its bytes */
+bool DeserializeBlock(CBlock& block, const CSerializedBlockRef& ref);
+
 /** Functions for validating blocks and updating the block tree */
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
@@ -82,12 +82,12 @@ using namespace std;
 class COrphan
 {
 public:
-    const CTransaction* ptx;
+    const CTxMemPoolEntry* pentry;
     set<uint256> setDependsOn;
     CFeeRate feeRate;
     double dPriority;
 
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
+    COrphan(const CTxMemPoolEntry* pentryIn) : pentry(pentryIn), feeRate(0), dPriority(0)
     {
     }
 };
@@ -96,7 +96,7 @@ uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
 // We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
+typedef boost::tuple<double, CFeeRate, const CTxMemPoolEntry*> TxPriority;
 class TxPriorityCompare
 {
     bool byFee;
@@ -121,6 +121,88 @@ public:
     }
 };
 
+// Facts about mempool transactions that CreateNewBlock needs and that do not change from one template to the next:
+// the pubkeys of the p2pk outputs spent by notary transactions (otherwise read back with myGetTransaction for every
+// input on every round) and the opreturn sizes checked against -opretmintxfee. Only what a template used is kept
+// for the next one, so the cache follows the mempool. Guarded by mempool.cs.
+// This only removes the disk reads and rescans from a round, each template still scores all of mapTx and heap-sorts
+// it. The fee part could walk the CompareTxMemPoolEntryByFee index of mapTx until the block is full, but by default
+// the first half of the block (-blockprioritysize) is filled by priority first. Priority at the template height is
+// GetPriority(height), which grows linearly with a slope of input value / modified size that differs per
+// transaction, so the priority order changes from one height to the next and cannot be kept as a mempool index.
+// Notarisations are also lifted to 1e16 from the notary keys of the season of the template height.
+class CBlockTemplateCache
+{
+public:
+    // returns the 33 byte pubkey if prevout is a pay to pubkey output, NULL otherwise
+    const uint8_t *NotaryInputPubkey(const COutPoint &prevout)
+    {
+        std::map<COutPoint, std::vector<uint8_t> >::iterator it = mapPubkeysNext.find(prevout);
+        if ( it == mapPubkeysNext.end() )
+        {
+            std::vector<uint8_t> pubkey;
+            std::map<COutPoint, std::vector<uint8_t> >::iterator itprev = mapPubkeys.find(prevout);
+            if ( itprev != mapPubkeys.end() )
+                pubkey = itprev->second;
+            else
+            {
+                CTransaction tx; uint256 hashBlock;
+                if ( myGetTransaction(prevout.hash,tx,hashBlock) == 0 || prevout.n >= tx.vout.size() )
+                    return(0);
+                const CScript &script = tx.vout[prevout.n].scriptPubKey;
+                if ( script.size() == 35 && script[0] == 33 && script[34] == OP_CHECKSIG )
+                    pubkey.assign(script.begin()+1,script.begin()+34);
+            }
+            it = mapPubkeysNext.insert(std::make_pair(prevout,pubkey)).first;
+        }
+        return(it->second.empty() ? 0 : &it->second[0]);
+    }
+
+    // total size of the opreturn data of tx
+    unsigned int OpretSize(const CTransaction &tx)
+    {
+        const uint256 &hash = tx.GetHash();
+        std::map<uint256, unsigned int>::iterator it = mapOpretSizesNext.find(hash);
+        if ( it != mapOpretSizesNext.end() )
+            return(it->second);
+        unsigned int nTxOpretSize = 0;
+        std::map<uint256, unsigned int>::iterator itprev = mapOpretSizes.find(hash);
+        if ( itprev != mapOpretSizes.end() )
+            nTxOpretSize = itprev->second;
+        else
+        {
+            BOOST_FOREACH(const CTxOut& txout, tx.vout) {
+                if (txout.scriptPubKey.IsOpReturn()) {
+                    CScript::const_iterator it = txout.scriptPubKey.begin() + 1;
+                    opcodetype op;
+                    std::vector<uint8_t> opretData;
+                    if (txout.scriptPubKey.GetOp(it, op, opretData)) {
+                        //std::cerr << HexStr(opretData.begin(), opretData.end()) << std::endl;
+                        nTxOpretSize += opretData.size();
+                    }
+                }
+            }
+        }
+        mapOpretSizesNext[hash] = nTxOpretSize;
+        return(nTxOpretSize);
+    }
+
+    // called when a template is complete, drops what it did not use
+    void EndTemplate()
+    {
+        mapPubkeys.swap(mapPubkeysNext);
+        mapPubkeysNext.clear();
+        mapOpretSizes.swap(mapOpretSizesNext);
+        mapOpretSizesNext.clear();
+    }
+
+private:
+    std::map<COutPoint, std::vector<uint8_t> > mapPubkeys, mapPubkeysNext;
+    std::map<uint256, unsigned int> mapOpretSizes, mapOpretSizesNext;
+};
+
+static CBlockTemplateCache blockTemplateCache;
+
 void UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
     if ( ASSETCHAINS_ADAPTIVEPOW <= 0 )
@@ -305,6 +387,18 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
         vector<TxPriority> vecPriority;
         vecPriority.reserve(mempool.mapTx.size() + 1);
 
+        // Opret spam limits
+        bool fOpretMinFee = mapArgs.count("-opretmintxfee") != 0;
+        CFeeRate opretMinFeeRate;
+        if (fOpretMinFee)
+        {
+            CAmount n = 0;
+            if (ParseMoney(mapArgs["-opretmintxfee"], n) && n > 0)
+                opretMinFeeRate = CFeeRate(n);
+            else
+                opretMinFeeRate = CFeeRate(400000); // default opretMinFeeRate (1 KMD per 250 Kb = 0.004 per 1 Kb = 400000 sat per 1 Kb)
+        }
+
         // now add transactions from the mem pool
         int32_t Notarisations = 0; uint64_t txvalue;
         for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
@@ -380,7 +474,7 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
                         if (!porphan)
                         {
                             // Use list for automatic deletion
-                            vOrphan.push_back(COrphan(&tx));
+                            vOrphan.push_back(COrphan(&(*mi)));
                             porphan = &vOrphan.back();
                         }
                         mapDependers[txin.prevout.hash].push_back(porphan);
@@ -396,15 +490,13 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
 
                     int nConf = nHeight - coins->nHeight;
                     
-                    uint8_t *script; int32_t scriptlen; uint256 hash; CTransaction tx1;
+                    const uint8_t *pubkey33;
                     // loop over notaries array and extract index of signers.
-                    if ( fToCryptoAddress && myGetTransaction(txin.prevout.hash,tx1,hash) )
+                    if ( fToCryptoAddress && (pubkey33= blockTemplateCache.NotaryInputPubkey(txin.prevout)) != 0 )
                     {
                         for (int8_t i = 0; i < numSN; i++) 
                         {
-                            script = (uint8_t *)&tx1.vout[txin.prevout.n].scriptPubKey[0];
-                            scriptlen = (int32_t)tx1.vout[txin.prevout.n].scriptPubKey.size();
-                            if ( scriptlen == 35 && script[0] == 33 && script[34] == OP_CHECKSIG && memcmp(script+1,notarypubkeys[i],33) == 0 )
+                            if ( memcmp(pubkey33,notarypubkeys[i],33) == 0 )
                             {
                                 // We can add the index of each notary to vector, and clear it if this notarisation is not valid later on.
                                 TMP_NotarisationNotaries.push_back(i);                          
@@ -428,7 +520,7 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
             if (fMissingInputs) continue;
 
             // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            unsigned int nTxSize = mi->GetTxSize();
             dPriority = tx.ComputePriority(dPriority, nTxSize);
 
             uint256 hash = tx.GetHash();
@@ -476,7 +568,7 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
                 porphan->feeRate = feeRate;
             }
             else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &(mi->GetTx())));
+                vecPriority.push_back(TxPriority(dPriority, feeRate, &(*mi)));
         }
 
         // Collect transactions into block
@@ -494,40 +586,22 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
             // Take highest priority transaction off the priority queue:
             double dPriority = vecPriority.front().get<0>();
             CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
+            const CTxMemPoolEntry& entry = *(vecPriority.front().get<2>());
+            const CTransaction& tx = entry.GetTx();
 
             std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
             vecPriority.pop_back();
 
             // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            unsigned int nTxSize = entry.GetTxSize();
 
             // Opret spam limits
-            if (mapArgs.count("-opretmintxfee"))
+            if (fOpretMinFee)
             {
-                CAmount n = 0;
-                CFeeRate opretMinFeeRate;
-                if (ParseMoney(mapArgs["-opretmintxfee"], n) && n > 0)
-                    opretMinFeeRate = CFeeRate(n);
-                else
-                    opretMinFeeRate = CFeeRate(400000); // default opretMinFeeRate (1 KMD per 250 Kb = 0.004 per 1 Kb = 400000 sat per 1 Kb)
-
                 bool fSpamTx = false;
-                unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-                unsigned int nTxOpretSize = 0;
 
                 // calc total oprets size
-                BOOST_FOREACH(const CTxOut& txout, tx.vout) {
-                    if (txout.scriptPubKey.IsOpReturn()) {
-                        CScript::const_iterator it = txout.scriptPubKey.begin() + 1;
-                        opcodetype op;
-                        std::vector<uint8_t> opretData;
-                        if (txout.scriptPubKey.GetOp(it, op, opretData)) {
-                            //std::cerr << HexStr(opretData.begin(), opretData.end()) << std::endl;
-                            nTxOpretSize += opretData.size();
-                        }
-                    }
-                }
+                unsigned int nTxOpretSize = blockTemplateCache.OpretSize(tx);
 
                 if ((nTxOpretSize > 256) && (feeRate < opretMinFeeRate)) fSpamTx = true;
                 // std::cerr << tx.GetHash().ToString() << " nTxSize." << nTxSize << " nTxOpretSize." << nTxOpretSize << " feeRate." << feeRate.ToString() << " opretMinFeeRate." << opretMinFeeRate.ToString() << " fSpamTx." << fSpamTx << std::endl;
@@ -621,7 +695,7 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
                         porphan->setDependsOn.erase(hash);
                         if (porphan->setDependsOn.empty())
                         {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
+                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->pentry));
                             std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
                         }
                     }
@@ -629,6 +703,8 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
             }
         }
 
+        blockTemplateCache.EndTemplate();
+
         nLastBlockTx = nBlockTx;
         nLastBlockSize = nBlockSize;
         if ( ASSETCHAINS_ADAPTIVEPOW <= 0 )
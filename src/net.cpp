@@ -39,6 +39,8 @@
 #include <fcntl.h>
 #endif
 
+#include <atomic>
+
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -116,6 +118,9 @@ CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
 static boost::condition_variable messageHandlerCondition;
+// Peer that the next trickle goes to. The first message handler draws it once per round and the first thread that
+// sends to that peer takes it, so addresses and inventory trickle as often as with a single handler thread.
+static std::atomic<NodeId> nodeTrickle(-1);
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -638,7 +643,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            messageHandlerCondition.notify_all();
         }
     }
 
@@ -1572,7 +1577,17 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
-void ThreadMessageHandler()
+void WakeMessageHandler()
+{
+    messageHandlerCondition.notify_all();
+}
+
+/*
+ * Any number of these threads walk vNodes. A peer is processed by one thread at a time, its receive lock is held
+ * while its next message is processed and while messages are sent to it, so the messages of a peer are handled in
+ * order. A thread that finds a peer busy moves on to the next one instead of waiting.
+ */
+void ThreadMessageHandler(bool fDrawTrickle)
 {
     boost::mutex condition_mutex;
     boost::unique_lock<boost::mutex> lock(condition_mutex);
@@ -1590,9 +1605,8 @@ void ThreadMessageHandler()
         }
 
         // Poll the connected nodes for messages
-        CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
-            pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
+        if (fDrawTrickle)
+            nodeTrickle = vNodesCopy.empty() ? -1 : vNodesCopy[GetRand(vNodesCopy.size())]->GetId();
 
         bool fSleep = true;
 
@@ -1601,21 +1615,19 @@ void ThreadMessageHandler()
             if (pnode->fDisconnect)
                 continue;
 
+            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+            if (!lockRecv)
+                continue;
+
             // Receive messages
+            if (!g_signals.ProcessMessages(pnode))
+                pnode->CloseSocketDisconnect();
+
+            if (pnode->nSendSize < SendBufferSize() && !pnode->fWaitSerial)
             {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
+                if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
                 {
-                    if (!g_signals.ProcessMessages(pnode))
-                        pnode->CloseSocketDisconnect();
-
-                    if (pnode->nSendSize < SendBufferSize())
-                    {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
-                        {
-                            fSleep = false;
-                        }
-                    }
+                    fSleep = false;
                 }
             }
             boost::this_thread::interruption_point();
@@ -1624,7 +1636,11 @@ void ThreadMessageHandler()
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
-                    g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
+                {
+                    NodeId nodeid = pnode->GetId();
+                    bool fSendTrickle = nodeTrickle.compare_exchange_strong(nodeid, -1);
+                    g_signals.SendMessages(pnode, fSendTrickle || pnode->fWhitelisted);
+                }
             }
             boost::this_thread::interruption_point();
         }
@@ -1840,7 +1856,10 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    int nMessageHandlers = GetArg("-msghandlers", DEFAULT_MSGHANDLER_THREADS);
+    nMessageHandlers = std::max(1, std::min(nMessageHandlers, MAX_MSGHANDLER_THREADS));
+    for (int i = 0; i < nMessageHandlers; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand", boost::function<void()>(boost::bind(&ThreadMessageHandler, i == 0))));
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpAddresses, DUMP_ADDRESSES_INTERVAL);
@@ -2125,6 +2144,7 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     fNetworkNode = false;
     fSuccessfullyConnected = false;
     fDisconnect = false;
+    fWaitSerial = false;
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
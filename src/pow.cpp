@@ -648,7 +648,7 @@ uint32_t lwmaGetNextPOSRequired(const CBlockIndex* pindexLast, const Consensus::
         if (!pindexFirst)
             return nProofOfStakeLimit;
 
-        CBlockHeader hdr = pindexFirst->GetBlockHeader();
+        CBlockHeader hdr = pindexFirst->GetBlockHeader(false);
 
         if (hdr.IsVerusPOSBlock())
         {
@@ -674,7 +674,7 @@ uint32_t lwmaGetNextPOSRequired(const CBlockIndex* pindexLast, const Consensus::
             if (!pindexFirst)
                 return nProofOfStakeLimit;
 
-            CBlockHeader hdr = pindexFirst->GetBlockHeader();
+            CBlockHeader hdr = pindexFirst->GetBlockHeader(false);
             if (hdr.IsVerusPOSBlock())
             {
                 nBits = hdr.GetVerusPOSTarget();
@@ -21,7 +21,9 @@
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
+#include "httprpc.h"
 #include "httpserver.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -37,6 +39,7 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const size_t MAX_GETUTXOS_BATCH_OUTPOINTS = 10000; //allow a max of 10000 outpoints in a /rest/getutxosbatch request
 
 enum RetFormat {
     RF_UNDEF,
@@ -71,8 +74,9 @@ struct CCoin {
     }
 };
 
-extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
+extern void TxToJSONStream(CJSONWriter& writer, const CTransaction& tx, const uint256 hashBlock, const CTxJSONContext& ctx);
 extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSONStream(CJSONWriter& writer, const CBlock& block, const CBlockIndex* blockindex);
 extern UniValue mempoolInfoToJSON();
 extern UniValue mempoolToJSON(bool fVerbose = false);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
@@ -168,7 +172,10 @@ static bool rest_headers(HTTPRequest* req,
 
     CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
     BOOST_FOREACH(const CBlockIndex *pindex, headers) {
-        ssHeader << pindex->GetBlockHeader();
+        CBlockHeader header;
+        if (!pindex->GetBlockHeader(header))
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Cannot read the header of " + pindex->GetBlockHash().GetHex());
+        ssHeader << header;
     }
 
     switch (rf) {
@@ -218,7 +225,7 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
+    CSerializedBlockRef ssBlock;
     CBlockIndex* pblockindex = NULL;
     {
         LOCK(cs_main);
@@ -228,32 +235,41 @@ static bool rest_block(HTTPRequest* req,
         pblockindex = mapBlockIndex[hash];
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
-
-        if (!ReadBlockFromDisk(block, pblockindex,1))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
+    // recently connected blocks are served from memory, without holding cs_main
+    if (!(ssBlock = GetSerializedBlock(pblockindex)))
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
     switch (rf) {
     case RF_BINARY: {
-        string binaryBlock = ssBlock.str();
+        string binaryBlock(ssBlock->begin(), ssBlock->end());
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RF_HEX: {
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        string strHex = HexStr(ssBlock->begin(), ssBlock->end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
+        CBlock block;
+        if (!DeserializeBlock(block, ssBlock))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        string strJSON;
+        if (showTxDetails)
+        {
+            // large blocks are written without building the whole tree first
+            CJSONWriter writer(strJSON);
+            blockToJSONStream(writer, block, pblockindex);
+            strJSON += "\n";
+        }
+        else
+            strJSON = blockToJSON(block, pblockindex, false).write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
         return true;
@@ -392,9 +408,10 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     }
 
     case RF_JSON: {
-        UniValue objTx(UniValue::VOBJ);
-        TxToJSON(tx, hashBlock, objTx);
-        string strJSON = objTx.write() + "\n";
+        string strJSON;
+        CJSONWriter writer(strJSON);
+        TxToJSONStream(writer, tx, hashBlock, CTxJSONContext::Current());
+        strJSON += "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
         return true;
@@ -409,6 +426,93 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+// looks the outpoints up one by one through a fresh view cache
+static void LookupUTXOs(const vector<COutPoint>& vOutPoints, bool fCheckMemPool, boost::dynamic_bitset<unsigned char>& hits, vector<CCoin>& outs)
+{
+    LOCK2(cs_main, mempool.cs);
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+
+    CCoinsViewCache& viewChain = *pcoinsTip;
+    CCoinsViewMemPool viewMempool(&viewChain, mempool);
+
+    if (fCheckMemPool)
+        view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
+
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        CCoins coins;
+        uint256 hash = vOutPoints[i].hash;
+        if (view.GetCoins(hash, coins)) {
+            mempool.pruneSpent(hash, coins);
+            if (coins.IsAvailable(vOutPoints[i].n)) {
+                hits[i] = true;
+                // Safe to index into vout here because IsAvailable checked if it's off the end of the array, or if
+                // n is valid but points to an already spent output (IsNull).
+                CCoin coin;
+                coin.nTxVer = coins.nVersion;
+                coin.nHeight = coins.nHeight;
+                coin.out = coins.vout.at(vOutPoints[i].n);
+                assert(!coin.out.IsNull());
+                outs.push_back(coin);
+            }
+        }
+    }
+}
+
+// resolves the outpoints in txid order in a single pass, so the coins of each transaction are fetched (and pruned
+// against the mempool) once no matter how many of its outputs are asked for. coins is indexed like vOutPoints.
+static void LookupUTXOsBatch(const vector<COutPoint>& vOutPoints, bool fCheckMemPool, boost::dynamic_bitset<unsigned char>& hits, vector<CCoin>& coinsOut)
+{
+    vector<size_t> vOrder(vOutPoints.size());
+    for (size_t i = 0; i < vOrder.size(); i++)
+        vOrder[i] = i;
+    std::sort(vOrder.begin(), vOrder.end(), [&vOutPoints](size_t a, size_t b) { return vOutPoints[a] < vOutPoints[b]; });
+    coinsOut.resize(vOutPoints.size());
+
+    LOCK2(cs_main, mempool.cs);
+
+    CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
+    const CCoinsView& view = fCheckMemPool ? (const CCoinsView&)viewMempool : (const CCoinsView&)*pcoinsTip;
+
+    CCoins coins;
+    bool fHaveCoins = false;
+    for (size_t k = 0; k < vOrder.size(); k++) {
+        const COutPoint& outpoint = vOutPoints[vOrder[k]];
+        if (k == 0 || outpoint.hash != vOutPoints[vOrder[k-1]].hash) {
+            fHaveCoins = view.GetCoins(outpoint.hash, coins);
+            if (fHaveCoins)
+                mempool.pruneSpent(outpoint.hash, coins);
+        }
+        if (fHaveCoins && coins.IsAvailable(outpoint.n)) {
+            hits[vOrder[k]] = true;
+            CCoin& coin = coinsOut[vOrder[k]];
+            coin.nTxVer = coins.nVersion;
+            coin.nHeight = coins.nHeight;
+            coin.out = coins.vout.at(outpoint.n);
+        }
+    }
+}
+
+size_t rest_countutxos(const vector<COutPoint>& vOutPoints, bool fCheckMemPool, bool fBatch)
+{
+    size_t nHits = 0;
+    if (fBatch) {
+        boost::dynamic_bitset<unsigned char> hits(vOutPoints.size());
+        vector<CCoin> coins;
+        LookupUTXOsBatch(vOutPoints, fCheckMemPool, hits, coins);
+        return hits.count();
+    }
+    for (size_t i = 0; i < vOutPoints.size(); i += MAX_GETUTXOS_OUTPOINTS) {
+        vector<COutPoint> vRequest(vOutPoints.begin() + i, vOutPoints.begin() + std::min(vOutPoints.size(), i + MAX_GETUTXOS_OUTPOINTS));
+        boost::dynamic_bitset<unsigned char> hits(vRequest.size());
+        vector<CCoin> outs;
+        LookupUTXOs(vRequest, fCheckMemPool, hits, outs);
+        nHits += hits.count();
+    }
+    return nHits;
+}
+
 static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -508,39 +612,9 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     vector<CCoin> outs;
     std::string bitmapStringRepresentation;
     boost::dynamic_bitset<unsigned char> hits(vOutPoints.size());
-    {
-        LOCK2(cs_main, mempool.cs);
-
-        CCoinsView viewDummy;
-        CCoinsViewCache view(&viewDummy);
-
-        CCoinsViewCache& viewChain = *pcoinsTip;
-        CCoinsViewMemPool viewMempool(&viewChain, mempool);
-
-        if (fCheckMemPool)
-            view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
-
-        for (size_t i = 0; i < vOutPoints.size(); i++) {
-            CCoins coins;
-            uint256 hash = vOutPoints[i].hash;
-            if (view.GetCoins(hash, coins)) {
-                mempool.pruneSpent(hash, coins);
-                if (coins.IsAvailable(vOutPoints[i].n)) {
-                    hits[i] = true;
-                    // Safe to index into vout here because IsAvailable checked if it's off the end of the array, or if
-                    // n is valid but points to an already spent output (IsNull).
-                    CCoin coin;
-                    coin.nTxVer = coins.nVersion;
-                    coin.nHeight = coins.nHeight;
-                    coin.out = coins.vout.at(vOutPoints[i].n);
-                    assert(!coin.out.IsNull());
-                    outs.push_back(coin);
-                }
-            }
-
-            bitmapStringRepresentation.append(hits[i] ? "1" : "0"); // form a binary string representation (human-readable for json output)
-        }
-    }
+    LookupUTXOs(vOutPoints, fCheckMemPool, hits, outs);
+    for (size_t i = 0; i < vOutPoints.size(); i++)
+        bitmapStringRepresentation.append(hits[i] ? "1" : "0"); // form a binary string representation (human-readable for json output)
     boost::to_block_range(hits, std::back_inserter(bitmap));
 
     switch (rf) {
@@ -605,6 +679,79 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * /rest/getutxosbatch.<bin|hex>
+ * Same request and response as the binary /rest/getutxos, for up to MAX_GETUTXOS_BATCH_OUTPOINTS outpoints. The
+ * outpoints are resolved in one pass (see LookupUTXOsBatch) and the unspent outputs are serialized straight into
+ * the reply, in request order.
+ */
+static bool rest_getutxosbatch(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strURIPart);
+
+    std::string strRequestMutable = req->ReadBody();
+    switch (rf) {
+    case RF_HEX: {
+        std::vector<unsigned char> strRequestV = ParseHex(strRequestMutable);
+        strRequestMutable.assign(strRequestV.begin(), strRequestV.end());
+        break;
+    }
+    case RF_BINARY:
+        break;
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+    }
+    }
+    if (strRequestMutable.length() == 0)
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Error: empty request");
+
+    bool fCheckMemPool = false;
+    vector<COutPoint> vOutPoints;
+    try {
+        CDataStream oss(strRequestMutable.data(), strRequestMutable.data() + strRequestMutable.size(), SER_NETWORK, PROTOCOL_VERSION);
+        oss >> fCheckMemPool;
+        oss >> vOutPoints;
+    } catch (const std::ios_base::failure& e) {
+        // abort in case of unreadable binary data
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Parse error");
+    }
+
+    if (vOutPoints.size() > MAX_GETUTXOS_BATCH_OUTPOINTS)
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", MAX_GETUTXOS_BATCH_OUTPOINTS, vOutPoints.size()));
+
+    boost::dynamic_bitset<unsigned char> hits(vOutPoints.size());
+    vector<CCoin> coins;
+    LookupUTXOsBatch(vOutPoints, fCheckMemPool, hits, coins);
+
+    vector<unsigned char> bitmap;
+    boost::to_block_range(hits, std::back_inserter(bitmap));
+
+    // same layout as a serialized vector<CCoin>, without collecting the hits into one first
+    CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
+    {
+        LOCK(cs_main);
+        ssGetUTXOResponse << chainActive.Height() << chainActive.LastTip()->GetBlockHash();
+    }
+    ssGetUTXOResponse << bitmap;
+    WriteCompactSize(ssGetUTXOResponse, hits.count());
+    for (size_t i = 0; i < coins.size(); i++)
+        if (hits[i])
+            ssGetUTXOResponse << coins[i];
+
+    if (rf == RF_HEX) {
+        string strHex = HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    req->WriteHeader("Content-Type", "application/octet-stream");
+    req->WriteReply(HTTP_OK, ssGetUTXOResponse.str());
+    return true;
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -616,6 +763,7 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/getutxosbatch", rest_getutxosbatch}, // before /rest/getutxos, handlers are matched by prefix
       {"/rest/getutxos", rest_getutxos},
 };
 
@@ -28,9 +28,11 @@
 #include "cc/eval.h"
 #include "main.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txcache.h"
 #include "util.h"
 #include "script/script.h"
 #include "script/script_error.h"
@@ -49,7 +51,8 @@
 using namespace std;
 
 extern int32_t KOMODO_INSYNC;
-extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
+extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, const CTxJSONContext& ctx);
+extern void TxToJSONStream(CJSONWriter& writer, const CTransaction& tx, const uint256 hashBlock, const CTxJSONContext& ctx);
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 int32_t komodo_notarized_height(int32_t *prevMoMheightp,uint256 *hashp,uint256 *txidp);
 #include "komodo_defs.h"
@@ -150,7 +153,10 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.push_back(Pair("finalsaplingroot", blockindex->hashFinalSaplingRoot.GetHex()));
     result.push_back(Pair("time", (int64_t)blockindex->nTime));
     result.push_back(Pair("nonce", blockindex->nNonce.GetHex()));
-    result.push_back(Pair("solution", HexStr(blockindex->nSolution)));
+    std::vector<unsigned char> solution;
+    if (!blockindex->GetSolution(solution))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot read the block header");
+    result.push_back(Pair("solution", HexStr(solution)));
     result.push_back(Pair("bits", strprintf("%08x", blockindex->nBits)));
     result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
     result.push_back(Pair("chainwork", blockindex->chainPower.chainWork.GetHex()));
@@ -285,12 +291,10 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, const CTxJSONContext& ctx)
 {
     UniValue result(UniValue::VOBJ);
-    uint256 notarized_hash,notarized_desttxid; int32_t prevMoMheight,notarized_height;
-    notarized_height = komodo_notarized_height(&prevMoMheight,&notarized_hash,&notarized_desttxid);
-    result.push_back(Pair("last_notarized_height", notarized_height));
+    result.push_back(Pair("last_notarized_height", ctx.nNotarizedHeight));
     result.push_back(Pair("hash", block.GetHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
@@ -310,7 +314,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
         if(txDetails)
         {
             UniValue objTx(UniValue::VOBJ);
-            TxToJSON(tx, uint256(), objTx);
+            TxToJSON(tx, uint256(), objTx, ctx);
             txs.push_back(objTx);
         }
         else
@@ -339,6 +343,36 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    return blockToJSON(block, blockindex, txDetails, CTxJSONContext::Current());
+}
+
+// blockToJSON with transaction details, written straight to the output. Only the transactions are written here,
+// the other fields are taken from blockToJSON without details so that both stay the same.
+void blockToJSONStream(CJSONWriter& writer, const CBlock& block, const CBlockIndex* blockindex)
+{
+    CTxJSONContext ctx = CTxJSONContext::Current();
+    UniValue header = blockToJSON(block, blockindex, false, ctx);
+    const std::vector<std::string>& keys = header.getKeys();
+    const std::vector<UniValue>& values = header.getValues();
+    writer.BeginObject();
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        writer.Key(keys[i]);
+        if (keys[i] == "tx")
+        {
+            writer.BeginArray();
+            BOOST_FOREACH(const CTransaction&tx, block.vtx)
+                TxToJSONStream(writer, tx, uint256(), ctx);
+            writer.EndArray();
+        }
+        else
+            writer.Value(values[i]);
+    }
+    writer.EndObject();
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() != 0)
@@ -769,8 +803,11 @@ UniValue getblockheader(const UniValue& params, bool fHelp, const CPubKey& mypk)
 
     if (!fVerbose)
     {
+        CBlockHeader header;
+        if (!pblockindex->GetBlockHeader(header))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot read the block header");
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << pblockindex->GetBlockHeader();
+        ssBlock << header;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
@@ -877,17 +914,19 @@ UniValue getblock(const UniValue& params, bool fHelp, const CPubKey& mypk)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, pblockindex,1))
+    CSerializedBlockRef ssBlock = GetSerializedBlock(pblockindex);
+    if (!ssBlock)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     if (verbosity == 0)
     {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        std::string strHex = HexStr(ssBlock->begin(), ssBlock->end());
         return strHex;
     }
 
+    if (!DeserializeBlock(block, ssBlock))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
@@ -933,12 +972,13 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp, const CPubKey& mypk
 UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     UniValue ret(UniValue::VOBJ); uint32_t flags; uint8_t value[IGUANA_MAXSCRIPTSIZE*8],key[IGUANA_MAXSCRIPTSIZE*8]; int32_t duration,j,height,valuesize,keylen; uint256 refpubkey; static uint256 zeroes;
-    if (fHelp || params.size() != 1 )
+    if (fHelp || params.size() < 1 || params.size() > 2 )
         throw runtime_error(
-            "kvsearch key\n"
+            "kvsearch key ( includemempool )\n"
             "\nSearch for a key stored via the kvupdate command. This feature is only available for asset chains.\n"
             "\nArguments:\n"
             "1. key                      (string, required) search the chain for this key\n"
+            "2. includemempool           (boolean, optional, default=false) include the updates pending in the mempool\n"
             "\nResult:\n"
             "{\n"
             "  \"coin\": \"xxxxx\",          (string) chain the key is stored on\n"
@@ -954,19 +994,26 @@ UniValue kvsearch(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("kvsearch", "examplekey")
+            + HelpExampleCli("kvsearch", "examplekey true")
             + HelpExampleRpc("kvsearch", "\"examplekey\"")
         );
-    LOCK(cs_main);
+    bool fMempool = params.size() > 1 && params[1].get_bool();
+    int32_t currentheight;
+    {
+        LOCK(cs_main);
+        currentheight = chainActive.LastTip()->GetHeight();
+    }
+    // the kv db is read without cs_main, block updates are written atomically
     if ( (keylen= (int32_t)strlen(params[0].get_str().c_str())) > 0 )
     {
         ret.push_back(Pair("coin",(char *)(ASSETCHAINS_SYMBOL[0] == 0 ? "KMD" : ASSETCHAINS_SYMBOL)));
-        ret.push_back(Pair("currentheight", (int64_t)chainActive.LastTip()->GetHeight()));
+        ret.push_back(Pair("currentheight", (int64_t)currentheight));
         ret.push_back(Pair("key",params[0].get_str()));
         ret.push_back(Pair("keylen",keylen));
         if ( keylen < sizeof(key) )
         {
             memcpy(key,params[0].get_str().c_str(),keylen);
-            if ( (valuesize= komodo_kvsearch(&refpubkey,chainActive.LastTip()->GetHeight(),&flags,&height,value,key,keylen)) >= 0 )
+            if ( (valuesize= (fMempool ? komodo_kvsearchmempool : komodo_kvsearch)(&refpubkey,currentheight,&flags,&height,value,key,keylen)) >= 0 )
             {
                 std::string val; char *valuestr;
                 val.resize(valuesize);
@@ -1703,6 +1750,13 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp, const CPubKey& my
             "  \"consensus\": {               (object) branch IDs of the current and upcoming consensus rules\n"
             "     \"chaintip\": \"xxxxxxxx\",   (string) branch ID used to validate the current chain tip\n"
             "     \"nextblock\": \"xxxxxxxx\"   (string) branch ID that the next block will be validated under\n"
+            "  },\n"
+            "  \"txcache\": {                 (object) cache of recently looked up confirmed transactions\n"
+            "     \"size\": xxxxx,             (numeric) number of cached transactions\n"
+            "     \"usage\": xxxxx,            (numeric) memory usage in bytes\n"
+            "     \"maxsize\": xxxxx,          (numeric) memory budget in bytes (-txcachesize)\n"
+            "     \"hits\": xxxxx,             (numeric) lookups served from the cache\n"
+            "     \"misses\": xxxxx            (numeric) lookups that went to the block files\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -1761,6 +1815,14 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp, const CPubKey& my
     consensus.push_back(Pair("nextblock", HexInt(CurrentEpochBranchId(tip->GetHeight() + 1, consensusParams))));
     obj.push_back(Pair("consensus", consensus));
 
+    UniValue cache(UniValue::VOBJ);
+    cache.push_back(Pair("size", (uint64_t)txcache.GetCount()));
+    cache.push_back(Pair("usage", (uint64_t)txcache.DynamicMemoryUsage()));
+    cache.push_back(Pair("maxsize", (uint64_t)txcache.GetMaxSize()));
+    cache.push_back(Pair("hits", txcache.GetHits()));
+    cache.push_back(Pair("misses", txcache.GetMisses()));
+    obj.push_back(Pair("txcache", cache));
+
     if (fPruneMode)
     {
         CBlockIndex *block = chainActive.LastTip();
@@ -1905,6 +1967,9 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
     ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
 
     if (Params().NetworkIDString() == "regtest") {
         ret.push_back(Pair("fullyNotified", mempool.IsFullyNotified()));
@@ -1924,6 +1989,8 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum memory usage for the mempool\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee per kB for a transaction to be accepted\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
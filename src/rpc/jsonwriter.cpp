@@ -0,0 +1,163 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "rpc/jsonwriter.h"
+
+#include "main.h"
+#include "tinyformat.h"
+#include "utilstrencodings.h"
+
+#include <iterator>
+
+int32_t komodo_notarized_height(int32_t *prevMoMheightp,uint256 *hashp,uint256 *txidp);
+
+CTxJSONContext CTxJSONContext::Current()
+{
+    CTxJSONContext ctx;
+    uint256 notarized_hash,notarized_desttxid; int32_t prevMoMheight;
+    ctx.nNotarizedHeight = komodo_notarized_height(&prevMoMheight,&notarized_hash,&notarized_desttxid);
+    LOCK(cs_main);
+    CBlockIndex *tipindex = chainActive.LastTip();
+    if ( tipindex != 0 )
+        ctx.nTipHeight = tipindex->GetHeight();
+    return ctx;
+}
+
+void CJSONWriter::Separator()
+{
+    if (fKey)
+    {
+        fKey = false;
+        return;
+    }
+    if (!vFirst.empty())
+    {
+        if (!vFirst.back())
+            strOut += ',';
+        vFirst.back() = false;
+    }
+}
+
+void CJSONWriter::Escape(const std::string &str)
+{
+    static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    // the same escapes as univalue_escapes.h
+    for (size_t i = 0; i < str.size(); i++)
+    {
+        unsigned char ch = str[i];
+        switch (ch)
+        {
+            case '"': strOut += "\\\""; break;
+            case '\\': strOut += "\\\\"; break;
+            case '\b': strOut += "\\b"; break;
+            case '\t': strOut += "\\t"; break;
+            case '\n': strOut += "\\n"; break;
+            case '\f': strOut += "\\f"; break;
+            case '\r': strOut += "\\r"; break;
+            default:
+                if (ch < 0x20 || ch == 0x7f)
+                {
+                    strOut += "\\u00";
+                    strOut += hexmap[ch >> 4];
+                    strOut += hexmap[ch & 15];
+                }
+                else
+                    strOut += ch;
+        }
+    }
+}
+
+void CJSONWriter::BeginObject()
+{
+    Separator();
+    strOut += '{';
+    vFirst.push_back(true);
+}
+
+void CJSONWriter::EndObject()
+{
+    vFirst.pop_back();
+    strOut += '}';
+}
+
+void CJSONWriter::BeginArray()
+{
+    Separator();
+    strOut += '[';
+    vFirst.push_back(true);
+}
+
+void CJSONWriter::EndArray()
+{
+    vFirst.pop_back();
+    strOut += ']';
+}
+
+void CJSONWriter::Key(const std::string &strKey)
+{
+    Separator();
+    strOut += '"';
+    Escape(strKey);
+    strOut += "\":";
+    fKey = true;
+}
+
+void CJSONWriter::Null()
+{
+    Separator();
+    strOut += "null";
+}
+
+void CJSONWriter::Bool(bool fValue)
+{
+    Separator();
+    strOut += fValue ? "true" : "false";
+}
+
+void CJSONWriter::Int(int64_t nValue)
+{
+    Separator();
+    strOut += i64tostr(nValue);
+}
+
+void CJSONWriter::String(const std::string &str)
+{
+    Separator();
+    strOut += '"';
+    Escape(str);
+    strOut += '"';
+}
+
+void CJSONWriter::Amount(const CAmount &amount)
+{
+    bool sign = amount < 0;
+    int64_t n_abs = (sign ? -amount : amount);
+    Separator();
+    strOut += strprintf("%s%d.%08d", sign ? "-" : "", n_abs / COIN, n_abs % COIN);
+}
+
+void CJSONWriter::Hash(const uint256 &hash)
+{
+    // GetHex writes the bytes in reverse order
+    typedef std::reverse_iterator<const unsigned char*> reverse_iterator;
+    Hex(reverse_iterator(hash.end()), reverse_iterator(hash.begin()));
+}
+
+void CJSONWriter::Value(const UniValue &value)
+{
+    Separator();
+    strOut += value.write();
+}
@@ -0,0 +1,94 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef BITCOIN_RPC_JSONWRITER_H
+#define BITCOIN_RPC_JSONWRITER_H
+
+#include "amount.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <univalue.h>
+
+/** Chain state that the verbose transaction and block output reads once per request instead of once per transaction */
+struct CTxJSONContext
+{
+    int32_t nNotarizedHeight;
+    int32_t nTipHeight; // -1 without a tip
+
+    CTxJSONContext() : nNotarizedHeight(0), nTipHeight(-1) {}
+
+    /** Snapshots the last notarised height and the tip */
+    static CTxJSONContext Current();
+};
+
+/*
+ * Appends compact JSON to a string as it is produced, for responses that are too large to build as a UniValue tree
+ * first. The output is the same as UniValue::write() of the equivalent tree. Values the writer has no type for are
+ * written from a UniValue.
+ */
+class CJSONWriter
+{
+public:
+    CJSONWriter(std::string &strOutIn) : strOut(strOutIn), fKey(false) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    /** Starts a member of the current object, its value is written next */
+    void Key(const std::string &strKey);
+
+    void Null();
+    void Bool(bool fValue);
+    void Int(int64_t nValue);
+    void String(const std::string &str);
+    /** A coin amount as written by ValueFromAmount */
+    void Amount(const CAmount &amount);
+    /** A hash as written by uint256::GetHex */
+    void Hash(const uint256 &hash);
+    void Value(const UniValue &value);
+
+    /** A string of the bytes in hex as written by HexStr */
+    template<typename T>
+    void Hex(const T itbegin, const T itend)
+    {
+        static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+                                         '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+        Separator();
+        strOut.reserve(strOut.size() + (itend - itbegin) * 2 + 2);
+        strOut += '"';
+        for (T it = itbegin; it < itend; ++it)
+        {
+            unsigned char val = (unsigned char)(*it);
+            strOut += hexmap[val >> 4];
+            strOut += hexmap[val & 15];
+        }
+        strOut += '"';
+    }
+
+private:
+    std::string &strOut;
+    std::vector<bool> vFirst; // per open object or array, whether nothing was written into it yet
+    bool fKey; // a key was just written, its value needs no separator
+
+    void Separator();
+    void Escape(const std::string &str);
+};
+
+#endif // BITCOIN_RPC_JSONWRITER_H
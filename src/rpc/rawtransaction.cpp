@@ -29,6 +29,7 @@
 #include "merkleblock.h"
 #include "net.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
 #include "script/script.h"
 #include "script/script_error.h"
@@ -185,15 +186,13 @@ int32_t myIsutxo_spent(uint256 &spenttxid,uint256 txid,int32_t vout)
     return(-1);
 }
 
-void TxToJSONExpanded(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, int nHeight = 0, int nConfirmations = 0, int nBlockTime = 0)
+void TxToJSONExpanded(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, const CTxJSONContext& ctx, int nHeight = 0, int nConfirmations = 0, int nBlockTime = 0)
 {
-    uint256 notarized_hash,notarized_desttxid; int32_t prevMoMheight,notarized_height;
-    notarized_height = komodo_notarized_height(&prevMoMheight,&notarized_hash,&notarized_desttxid);
     uint256 txid = tx.GetHash();
     entry.push_back(Pair("txid", txid.GetHex()));
     entry.push_back(Pair("overwintered", tx.fOverwintered));
     entry.push_back(Pair("version", tx.nVersion));
-    entry.push_back(Pair("last_notarized_height", notarized_height));
+    entry.push_back(Pair("last_notarized_height", ctx.nNotarizedHeight));
     if (tx.fOverwintered) {
         entry.push_back(Pair("versiongroupid", HexInt(tx.nVersionGroupId)));
     }
@@ -263,19 +262,16 @@ void TxToJSONExpanded(const CTransaction& tx, const uint256 hashBlock, UniValue&
         vin.push_back(in);
     }
     entry.push_back(Pair("vin", vin));
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex *tipindex,*pindex = it->second;
-    uint64_t interest;
     UniValue vout(UniValue::VARR);
     for (unsigned int i = 0; i < tx.vout.size(); i++)
     {
         const CTxOut& txout = tx.vout[i];
         UniValue out(UniValue::VOBJ);
         out.push_back(Pair("value", ValueFromAmount(txout.nValue)));
-        if ( ASSETCHAINS_SYMBOL[0] == 0 && pindex != 0 && tx.nLockTime >= 500000000 && (tipindex= chainActive.LastTip()) != 0 )
+        if ( ASSETCHAINS_SYMBOL[0] == 0 && tx.nLockTime >= 500000000 && ctx.nTipHeight >= 0 )
         {
             int64_t interest; int32_t txheight; uint32_t locktime;
-            interest = komodo_accrued_interest(&txheight,&locktime,tx.GetHash(),i,0,txout.nValue,(int32_t)tipindex->GetHeight());
+            interest = komodo_accrued_interest(&txheight,&locktime,tx.GetHash(),i,0,txout.nValue,ctx.nTipHeight);
             out.push_back(Pair("interest", ValueFromAmount(interest)));
         }
         out.push_back(Pair("valueSat", txout.nValue)); // [+] Decker
@@ -337,7 +333,7 @@ void TxToJSONExpanded(const CTransaction& tx, const uint256 hashBlock, UniValue&
 
 }
 
-void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
+void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, const CTxJSONContext& ctx)
 {
     entry.push_back(Pair("txid", tx.GetHash().GetHex()));
     entry.push_back(Pair("overwintered", tx.fOverwintered));
@@ -367,17 +363,14 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
     }
     entry.push_back(Pair("vin", vin));
     UniValue vout(UniValue::VARR);
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex *tipindex;//,*pindex = it->second;
-    uint64_t interest;
     for (unsigned int i = 0; i < tx.vout.size(); i++) {
         const CTxOut& txout = tx.vout[i];
         UniValue out(UniValue::VOBJ);
         out.push_back(Pair("value", ValueFromAmount(txout.nValue)));
-        if ( KOMODO_NSPV_FULLNODE && ASSETCHAINS_SYMBOL[0] == 0 && tx.nLockTime >= 500000000 && (tipindex= chainActive.LastTip()) != 0 )
+        if ( KOMODO_NSPV_FULLNODE && ASSETCHAINS_SYMBOL[0] == 0 && tx.nLockTime >= 500000000 && ctx.nTipHeight >= 0 )
         {
             int64_t interest; int32_t txheight; uint32_t locktime;
-            interest = komodo_accrued_interest(&txheight,&locktime,tx.GetHash(),i,0,txout.nValue,(int32_t)tipindex->GetHeight());
+            interest = komodo_accrued_interest(&txheight,&locktime,tx.GetHash(),i,0,txout.nValue,ctx.nTipHeight);
             out.push_back(Pair("interest", ValueFromAmount(interest)));
         }        
         out.push_back(Pair("valueZat", txout.nValue));
@@ -422,6 +415,159 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
     }
 }
 
+void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
+{
+    TxToJSON(tx, hashBlock, entry, CTxJSONContext::Current());
+}
+
+static void ScriptPubKeyToJSONStream(CJSONWriter& writer, const CScript& scriptPubKey)
+{
+    txnouttype type;
+    vector<CTxDestination> addresses;
+    int nRequired;
+
+    writer.BeginObject();
+    writer.Key("asm");
+    writer.String(ScriptToAsmStr(scriptPubKey));
+    writer.Key("hex");
+    writer.Hex(scriptPubKey.begin(), scriptPubKey.end());
+
+    if (!ExtractDestinations(scriptPubKey, type, addresses, nRequired))
+    {
+        writer.Key("type");
+        writer.String(GetTxnOutputType(type));
+        writer.EndObject();
+        return;
+    }
+
+    writer.Key("reqSigs");
+    writer.Int(nRequired);
+    writer.Key("type");
+    writer.String(GetTxnOutputType(type));
+    writer.Key("addresses");
+    writer.BeginArray();
+    for (const CTxDestination& addr : addresses)
+        writer.String(EncodeDestination(addr));
+    writer.EndArray();
+    writer.EndObject();
+}
+
+// TxToJSON written straight to the output, the two must produce the same json
+void TxToJSONStream(CJSONWriter& writer, const CTransaction& tx, const uint256 hashBlock, const CTxJSONContext& ctx)
+{
+    writer.BeginObject();
+    writer.Key("txid");
+    writer.Hash(tx.GetHash());
+    writer.Key("overwintered");
+    writer.Bool(tx.fOverwintered);
+    writer.Key("version");
+    writer.Int(tx.nVersion);
+    if (tx.fOverwintered) {
+        writer.Key("versiongroupid");
+        writer.String(HexInt(tx.nVersionGroupId));
+    }
+    writer.Key("locktime");
+    writer.Int(tx.nLockTime);
+    if (tx.fOverwintered) {
+        writer.Key("expiryheight");
+        writer.Int(tx.nExpiryHeight);
+    }
+    writer.Key("vin");
+    writer.BeginArray();
+    for (const CTxIn& txin : tx.vin) {
+        writer.BeginObject();
+        if (tx.IsCoinBase()) {
+            writer.Key("coinbase");
+            writer.Hex(txin.scriptSig.begin(), txin.scriptSig.end());
+        } else {
+            writer.Key("txid");
+            writer.Hash(txin.prevout.hash);
+            writer.Key("vout");
+            writer.Int(txin.prevout.n);
+            writer.Key("scriptSig");
+            writer.BeginObject();
+            writer.Key("asm");
+            writer.String(ScriptToAsmStr(txin.scriptSig, true));
+            writer.Key("hex");
+            writer.Hex(txin.scriptSig.begin(), txin.scriptSig.end());
+            writer.EndObject();
+        }
+        writer.Key("sequence");
+        writer.Int(txin.nSequence);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.Key("vout");
+    writer.BeginArray();
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        const CTxOut& txout = tx.vout[i];
+        writer.BeginObject();
+        writer.Key("value");
+        writer.Amount(txout.nValue);
+        if ( KOMODO_NSPV_FULLNODE && ASSETCHAINS_SYMBOL[0] == 0 && tx.nLockTime >= 500000000 && ctx.nTipHeight >= 0 )
+        {
+            int64_t interest; int32_t txheight; uint32_t locktime;
+            interest = komodo_accrued_interest(&txheight,&locktime,tx.GetHash(),i,0,txout.nValue,ctx.nTipHeight);
+            writer.Key("interest");
+            writer.Amount(interest);
+        }
+        writer.Key("valueZat");
+        writer.Int(txout.nValue);
+        writer.Key("n");
+        writer.Int(i);
+        writer.Key("scriptPubKey");
+        ScriptPubKeyToJSONStream(writer, txout.scriptPubKey);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    // shielded descriptions are rare, they go through UniValue
+    writer.Key("vjoinsplit");
+    writer.Value(TxJoinSplitToJSON(tx));
+
+    if (tx.fOverwintered && tx.nVersion >= SAPLING_TX_VERSION) {
+        writer.Key("valueBalance");
+        writer.Amount(tx.valueBalance);
+        UniValue vspenddesc = TxShieldedSpendsToJSON(tx);
+        writer.Key("vShieldedSpend");
+        writer.Value(vspenddesc);
+        UniValue voutputdesc = TxShieldedOutputsToJSON(tx);
+        writer.Key("vShieldedOutput");
+        writer.Value(voutputdesc);
+        if (!(vspenddesc.empty() && voutputdesc.empty())) {
+            writer.Key("bindingSig");
+            writer.Hex(tx.bindingSig.begin(), tx.bindingSig.end());
+        }
+    }
+
+    if (!hashBlock.IsNull()) {
+        writer.Key("blockhash");
+        writer.Hash(hashBlock);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi != mapBlockIndex.end() && (*mi).second) {
+            CBlockIndex* pindex = (*mi).second;
+            if (chainActive.Contains(pindex)) {
+                writer.Key("height");
+                writer.Int(pindex->GetHeight());
+                writer.Key("rawconfirmations");
+                writer.Int(1 + chainActive.Height() - pindex->GetHeight());
+                writer.Key("confirmations");
+                writer.Int(komodo_dpowconfs(pindex->GetHeight(),1 + chainActive.Height() - pindex->GetHeight()));
+                writer.Key("time");
+                writer.Int(pindex->GetBlockTime());
+                writer.Key("blocktime");
+                writer.Int(pindex->GetBlockTime());
+            } else {
+                writer.Key("confirmations");
+                writer.Int(0);
+                writer.Key("rawconfirmations");
+                writer.Int(0);
+            }
+        }
+    }
+    writer.EndObject();
+}
+
 UniValue getrawtransaction(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -557,7 +703,7 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp, const CPubKey& my
 
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hex", strHex));
-    TxToJSONExpanded(tx, hashBlock, result, nHeight, nConfirmations, nBlockTime);
+    TxToJSONExpanded(tx, hashBlock, result, CTxJSONContext::Current(), nHeight, nConfirmations, nBlockTime);
     return result;
 }
 
@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+
+#include "cc/CCinclude.h"
+#include "utilstrencodings.h"
+
+#include <string>
+
+// in komodo_utils.h
+void calc_rmd160(char deprecated[41],uint8_t buf[20],uint8_t *msg,int32_t len);
+void calc_rmd160_sha256(uint8_t rmd160[20],uint8_t *data,int32_t datalen);
+
+namespace TestKomodoHashes {
+
+    class TestKomodoHashes : public ::testing::Test {};
+
+    static std::string Sha256Hex(const std::string &str)
+    {
+        uint8_t hash[32];
+        vcalc_sha256(0,hash,(uint8_t *)str.data(),str.size());
+        return HexStr(hash,hash+sizeof(hash));
+    }
+
+    static std::string Rmd160Hex(const std::string &str)
+    {
+        uint8_t hash[20];
+        calc_rmd160(0,hash,(uint8_t *)str.data(),str.size());
+        return HexStr(hash,hash+sizeof(hash));
+    }
+
+    TEST(TestKomodoHashes, sha256) {
+        EXPECT_EQ(Sha256Hex(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        EXPECT_EQ(Sha256Hex("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        EXPECT_EQ(Sha256Hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+                  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        EXPECT_EQ(Sha256Hex(std::string(1000000, 'a')), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    }
+
+    TEST(TestKomodoHashes, doublesha256) {
+        // bits256_doublesha256 returns the hash byte reversed
+        std::string str = "abc";
+        bits256 hash = bits256_doublesha256(0,(uint8_t *)str.data(),str.size());
+        EXPECT_EQ(HexStr(hash.bytes,hash.bytes+sizeof(hash)), "58636c3ec08c12d55aedda056d602d5bcca72d8df6a69b519b72d32dc2428b4f");
+    }
+
+    TEST(TestKomodoHashes, rmd160) {
+        EXPECT_EQ(Rmd160Hex(""), "9c1185a5c5e9fc54612808977ee8f548b2258d31");
+        EXPECT_EQ(Rmd160Hex("abc"), "8eb208f7e05d987a9b044a8e98c6b087f15a0bfc");
+        EXPECT_EQ(Rmd160Hex("message digest"), "5d0689ef49d2fae572b881b123a85ffa21595f36");
+        EXPECT_EQ(Rmd160Hex(std::string(1000000, 'a')), "52783243c1697bdbe16d37f97f68f08325dc1528");
+    }
+
+    TEST(TestKomodoHashes, rmd160_sha256) {
+        // the crypto777 pubkey and its hash160
+        std::vector<unsigned char> pubkey = ParseHex("020e46e79a2a8d12b9b5d12c7a91adb4e454edfae43c0a0cb805427d2ac7613fd9");
+        uint8_t rmd160[20];
+        calc_rmd160_sha256(rmd160,pubkey.data(),pubkey.size());
+        EXPECT_EQ(HexStr(rmd160,rmd160+sizeof(rmd160)), "f1dce4182fce875748c4986b240ff7d7bc3fffb0");
+    }
+
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include "amount.h"
+#include "consensus/upgrades.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+#include "txmempool.h"
+
+namespace TestMempoolLimit {
+
+    class TestMempoolLimit : public ::testing::Test {};
+
+    static CTxMemPoolEntry MakeEntry(const CMutableTransaction &tx, CTxMemPool &pool, CAmount nFee, int64_t nTime = 0)
+    {
+        return CTxMemPoolEntry(tx, nFee, nTime, 10.0, 1, pool.HasNoInputsOf(tx), false, SPROUT_BRANCH_ID);
+    }
+
+    TEST(TestMempoolLimit, size_limit)
+    {
+        CTxMemPool pool(CFeeRate(1000));
+
+        CMutableTransaction tx1 = CMutableTransaction();
+        tx1.vin.resize(1);
+        tx1.vin[0].scriptSig = CScript() << OP_1;
+        tx1.vout.resize(1);
+        tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx1.vout[0].nValue = 10 * COIN;
+        pool.addUnchecked(tx1.GetHash(), MakeEntry(tx1, pool, 1000LL, 10));
+
+        CMutableTransaction tx2 = CMutableTransaction();
+        tx2.vin.resize(1);
+        tx2.vin[0].scriptSig = CScript() << OP_2;
+        tx2.vout.resize(1);
+        tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+        tx2.vout[0].nValue = 10 * COIN;
+        pool.addUnchecked(tx2.GetHash(), MakeEntry(tx2, pool, 5000LL, 20));
+
+        /* child of tx1 paying enough for both */
+        CMutableTransaction tx3 = CMutableTransaction();
+        tx3.vin.resize(1);
+        tx3.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+        tx3.vin[0].scriptSig = CScript() << OP_3;
+        tx3.vout.resize(1);
+        tx3.vout[0].scriptPubKey = CScript() << OP_3 << OP_EQUAL;
+        tx3.vout[0].nValue = 10 * COIN;
+        pool.addUnchecked(tx3.GetHash(), MakeEntry(tx3, pool, 20000LL, 30));
+
+        CMutableTransaction tx4 = CMutableTransaction();
+        tx4.vin.resize(1);
+        tx4.vin[0].scriptSig = CScript() << OP_4;
+        tx4.vout.resize(1);
+        tx4.vout[0].scriptPubKey = CScript() << OP_4 << OP_EQUAL;
+        tx4.vout[0].nValue = 10 * COIN;
+        pool.addUnchecked(tx4.GetHash(), MakeEntry(tx4, pool, 2000LL, 40));
+        EXPECT_EQ(pool.size(), 4);
+        EXPECT_EQ(pool.GetMinFee(1).GetFeePerK(), 0);
+
+        // tx1 has the lowest fee rate but is carried by tx3, tx4 goes first
+        pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+        EXPECT_TRUE(pool.exists(tx1.GetHash()));
+        EXPECT_TRUE(pool.exists(tx2.GetHash()));
+        EXPECT_TRUE(pool.exists(tx3.GetHash()));
+        EXPECT_FALSE(pool.exists(tx4.GetHash()));
+        EXPECT_TRUE(pool.GetMinFee(1).GetFeePerK() > 1000);
+
+        pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+        EXPECT_TRUE(pool.exists(tx1.GetHash()));
+        EXPECT_FALSE(pool.exists(tx2.GetHash()));
+        EXPECT_TRUE(pool.exists(tx3.GetHash()));
+
+        // evicting tx1 takes its child along
+        pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+        EXPECT_EQ(pool.size(), 0);
+        EXPECT_EQ(pool.mapNextTx.size(), 0);
+        EXPECT_EQ(pool.DynamicMemoryUsage(), 0);
+
+        // expiring tx1 by age also removes its younger child
+        pool.addUnchecked(tx1.GetHash(), MakeEntry(tx1, pool, 1000LL, 10));
+        pool.addUnchecked(tx3.GetHash(), MakeEntry(tx3, pool, 20000LL, 30));
+        pool.addUnchecked(tx4.GetHash(), MakeEntry(tx4, pool, 2000LL, 40));
+        EXPECT_EQ(pool.Expire(5), 0);
+        EXPECT_EQ(pool.Expire(20), 2);
+        EXPECT_EQ(pool.size(), 1);
+        EXPECT_TRUE(pool.exists(tx4.GetHash()));
+    }
+
+    TEST(TestMempoolLimit, trim_candidates)
+    {
+        CTxMemPool pool(CFeeRate(1000));
+
+        // low fee parents carried by high fee children, more of them than are scored per eviction
+        std::vector<uint256> parents;
+        for (unsigned int i = 0; i < MEMPOOL_TRIM_MAX_CANDIDATES + 10; i++)
+        {
+            CMutableTransaction parent = CMutableTransaction();
+            parent.vin.resize(1);
+            parent.vin[0].scriptSig = CScript() << OP_1;
+            parent.nLockTime = i;
+            parent.vout.resize(1);
+            parent.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            parent.vout[0].nValue = 10 * COIN;
+            pool.addUnchecked(parent.GetHash(), MakeEntry(parent, pool, 100LL + i));
+            parents.push_back(parent.GetHash());
+
+            CMutableTransaction child = CMutableTransaction();
+            child.vin.resize(1);
+            child.vin[0].prevout = COutPoint(parent.GetHash(), 0);
+            child.vin[0].scriptSig = CScript() << OP_1;
+            child.vout.resize(1);
+            child.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            child.vout[0].nValue = 10 * COIN;
+            pool.addUnchecked(child.GetHash(), MakeEntry(child, pool, 100000LL));
+        }
+
+        // a single transaction with the worst score, but above all the parents by its own fee rate
+        CMutableTransaction tx = CMutableTransaction();
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_2;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        pool.addUnchecked(tx.GetHash(), MakeEntry(tx, pool, 1000LL));
+
+        // only the lowest fee rate candidates are scored, so the worst of the scored packages goes
+        size_t nSize = pool.size();
+        pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+        EXPECT_EQ(pool.size(), nSize - 2);
+        EXPECT_TRUE(pool.exists(tx.GetHash()));
+        EXPECT_FALSE(pool.exists(parents[0]));
+    }
+
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "chain.h"
+#include "main.h"
+#include "txdb.h"
+
+namespace TestTrimmedSolution {
+
+    // serves the solutions from a block tree db of its own
+    class TestTrimmedSolution : public ::testing::Test {
+    protected:
+        CBlockTreeDB *pblocktreeSaved;
+
+        virtual void SetUp() {
+            pblocktreeSaved = pblocktree;
+            pblocktree = new CBlockTreeDB(1 << 20, true);
+        }
+
+        virtual void TearDown() {
+            delete pblocktree;
+            pblocktree = pblocktreeSaved;
+        }
+    };
+
+    TEST_F(TestTrimmedSolution, read_back_from_db)
+    {
+        CBlockHeader header;
+        header.nVersion = 4;
+        header.nTime = 1231006505;
+        header.nBits = 0x1f07ffff;
+        header.nSolution = std::vector<unsigned char>(1344, 0x5a);
+        uint256 hash = header.GetHash();
+
+        CBlockIndex index(header);
+        index.phashBlock = &hash;
+        EXPECT_TRUE(index.HasSolution());
+
+        std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
+        std::vector<const CBlockIndex*> vBlocks(1, &index);
+        ASSERT_TRUE(pblocktree->WriteBatchSync(vFiles, 0, vBlocks));
+        index.TrimSolution();
+        EXPECT_FALSE(index.HasSolution());
+        std::vector<unsigned char> solution;
+        EXPECT_TRUE(index.GetSolution(solution));
+        EXPECT_TRUE(solution == header.nSolution);
+        CBlockHeader readheader;
+        EXPECT_TRUE(index.GetBlockHeader(readheader));
+        EXPECT_EQ(readheader.GetHash(), hash);
+        EXPECT_TRUE(index.GetBlockHeader(false).nSolution.empty());
+
+        // writing the trimmed entry again keeps its solution in the db
+        index.nStatus |= BLOCK_VALID_TREE;
+        ASSERT_TRUE(pblocktree->WriteBatchSync(vFiles, 0, vBlocks));
+        CDiskBlockIndex dbindex;
+        ASSERT_TRUE(pblocktree->ReadDiskBlockIndex(hash, dbindex));
+        EXPECT_TRUE(dbindex.nSolution == header.nSolution);
+        EXPECT_EQ(dbindex.GetBlockHash(), hash);
+        EXPECT_EQ(dbindex.nStatus, (unsigned int)BLOCK_VALID_TREE);
+    }
+
+    TEST_F(TestTrimmedSolution, missing_entry)
+    {
+        CBlockHeader header;
+        header.nSolution = std::vector<unsigned char>(1344, 0x5a);
+        uint256 hash = header.GetHash();
+
+        // a trimmed entry that is not in the db reports the failure instead of an empty solution
+        CBlockIndex index(header);
+        index.phashBlock = &hash;
+        index.TrimSolution();
+        std::vector<unsigned char> solution;
+        EXPECT_FALSE(index.GetSolution(solution));
+        CBlockHeader readheader;
+        EXPECT_FALSE(index.GetBlockHeader(readheader));
+    }
+
+}
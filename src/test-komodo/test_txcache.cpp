@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "txcache.h"
+
+namespace TestTxCache {
+
+    class TestTxCache : public ::testing::Test {};
+
+    static CTransaction MakeTx(uint32_t n)
+    {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout.n = n;
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = n;
+        return mtx;
+    }
+
+    TEST(TestTxCache, get_put) {
+        CTxCache cache(1 << 20);
+        CTransaction tx = MakeTx(1);
+        uint256 hashBlock = uint256S("01"), hashBlockOut;
+
+        EXPECT_FALSE(cache.Get(tx.GetHash(), hashBlockOut));
+        cache.Put(tx, hashBlock);
+        std::shared_ptr<const CTransaction> ptx = cache.Get(tx.GetHash(), hashBlockOut);
+        ASSERT_TRUE(ptx != nullptr);
+        EXPECT_EQ(ptx->GetHash(), tx.GetHash());
+        EXPECT_EQ(hashBlockOut, hashBlock);
+        EXPECT_EQ(cache.GetHits(), 1);
+        EXPECT_EQ(cache.GetMisses(), 1);
+        // lookups share the cached transaction instead of copying it
+        EXPECT_EQ(cache.Get(tx.GetHash(), hashBlockOut), ptx);
+    }
+
+    TEST(TestTxCache, erase_block) {
+        CTxCache cache(1 << 20);
+        CBlock block;
+        block.vtx.push_back(MakeTx(1));
+        block.vtx.push_back(MakeTx(2));
+        CTransaction other = MakeTx(3);
+        uint256 hashBlock;
+
+        for (const CTransaction &tx : block.vtx)
+            cache.Put(tx, block.GetHash());
+        cache.Put(other, uint256S("01"));
+        EXPECT_EQ(cache.GetCount(), 3);
+
+        cache.EraseBlock(block);
+        EXPECT_EQ(cache.GetCount(), 1);
+        EXPECT_FALSE(cache.Get(block.vtx[0].GetHash(), hashBlock));
+        EXPECT_TRUE(cache.Get(other.GetHash(), hashBlock));
+    }
+
+    TEST(TestTxCache, memory_bound) {
+        CTxCache cache(64 << 10);
+        uint256 hashBlock;
+
+        for (uint32_t n = 0; n < 10000; n++)
+            cache.Put(MakeTx(n), uint256());
+        EXPECT_LE(cache.DynamicMemoryUsage(), cache.GetMaxSize());
+        EXPECT_LT(cache.GetCount(), 10000);
+        // the most recent transaction was kept
+        EXPECT_TRUE(cache.Get(MakeTx(9999).GetHash(), hashBlock));
+
+        cache.SetMaxSize(0);
+        EXPECT_EQ(cache.GetCount(), 0);
+        cache.Put(MakeTx(1), uint256());
+        EXPECT_FALSE(cache.Get(MakeTx(1).GetHash(), hashBlock));
+    }
+
+}
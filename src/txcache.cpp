@@ -0,0 +1,133 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "txcache.h"
+#include "core_memusage.h"
+#include "memusage.h"
+
+CTxCache txcache(DEFAULT_TXCACHE_SIZE << 20);
+
+
+std::shared_ptr<const CTransaction> CTxCache::Get(const uint256 &hash, uint256 &hashBlock)
+{
+    if (nMaxBytes == 0)
+        return nullptr;
+    Shard &shard = GetShard(hash);
+    {
+        LOCK(shard.cs);
+        auto it = shard.map.find(hash);
+        if (it != shard.map.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            hashBlock = it->second->hashBlock;
+            nHits++;
+            return it->second->tx;
+        }
+    }
+    nMisses++;
+    return nullptr;
+}
+
+void CTxCache::Put(const CTransaction &tx, const uint256 &hashBlock)
+{
+    size_t nMaxShardBytes = nMaxBytes / NUM_SHARDS;
+    const uint256 &hash = tx.GetHash();
+    Entry entry;
+    entry.nUsage = RecursiveDynamicUsage(tx) + sizeof(CTransaction) + sizeof(Entry) + 4 * sizeof(void*);
+    if (entry.nUsage > nMaxShardBytes)
+        return;
+    entry.hash = hash;
+    entry.tx = std::make_shared<const CTransaction>(tx);
+    entry.hashBlock = hashBlock;
+
+    Shard &shard = GetShard(hash);
+    LOCK(shard.cs);
+    if (shard.map.count(hash) != 0)
+        return;
+    shard.lru.push_front(entry);
+    shard.map[hash] = shard.lru.begin();
+    shard.nUsage += entry.nUsage;
+    Trim(shard, nMaxShardBytes);
+}
+
+void CTxCache::EraseBlock(const CBlock &block)
+{
+    for (const CTransaction &tx : block.vtx)
+    {
+        Shard &shard = GetShard(tx.GetHash());
+        LOCK(shard.cs);
+        auto it = shard.map.find(tx.GetHash());
+        if (it != shard.map.end())
+        {
+            shard.nUsage -= it->second->nUsage;
+            shard.lru.erase(it->second);
+            shard.map.erase(it);
+        }
+    }
+}
+
+void CTxCache::Clear()
+{
+    for (Shard &shard : shards)
+    {
+        LOCK(shard.cs);
+        shard.lru.clear();
+        shard.map.clear();
+        shard.nUsage = 0;
+    }
+}
+
+void CTxCache::SetMaxSize(size_t nMaxBytesIn)
+{
+    nMaxBytes = nMaxBytesIn;
+    for (Shard &shard : shards)
+    {
+        LOCK(shard.cs);
+        Trim(shard, nMaxBytesIn / NUM_SHARDS);
+    }
+}
+
+size_t CTxCache::GetCount()
+{
+    size_t count = 0;
+    for (Shard &shard : shards)
+    {
+        LOCK(shard.cs);
+        count += shard.map.size();
+    }
+    return count;
+}
+
+size_t CTxCache::DynamicMemoryUsage()
+{
+    size_t usage = 0;
+    for (Shard &shard : shards)
+    {
+        LOCK(shard.cs);
+        usage += shard.nUsage;
+    }
+    return usage;
+}
+
+void CTxCache::Trim(Shard &shard, size_t nMaxShardBytes)
+{
+    while (shard.nUsage > nMaxShardBytes && !shard.lru.empty())
+    {
+        const Entry &entry = shard.lru.back();
+        shard.nUsage -= entry.nUsage;
+        shard.map.erase(entry.hash);
+        shard.lru.pop_back();
+    }
+}
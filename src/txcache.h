@@ -0,0 +1,96 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef TXCACHE_H
+#define TXCACHE_H
+
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+/** Default for -txcachesize, in megabytes */
+static const int64_t DEFAULT_TXCACHE_SIZE = 32;
+
+/*
+ * Confirmed transactions recently read from the block files by myGetTransaction and GetTransaction.
+ * CC validation, notary detection and the cc rpcs look up the same funding and recent transactions over and over,
+ * each time a txindex read, a seek in the block file and a deserialization without this cache.
+ * The entries are split over shards by txid, each shard is an LRU with its own lock and an equal share of the memory
+ * budget. DisconnectTip drops the transactions of the block it disconnects, they may confirm in another block,
+ * and ConnectTip drops the transactions of the block it connects, a read in between may have cached them with the old block.
+ */
+class CTxCache
+{
+public:
+    static const size_t NUM_SHARDS = 16;
+
+    CTxCache(size_t nMaxBytesIn) : nMaxBytes(nMaxBytesIn), nHits(0), nMisses(0) {}
+
+    /** Returns the cached transaction, shared with the cache, and the hash of its block, or null */
+    std::shared_ptr<const CTransaction> Get(const uint256 &hash, uint256 &hashBlock);
+    void Put(const CTransaction &tx, const uint256 &hashBlock);
+    /** Drops the transactions of a connected or disconnected block */
+    void EraseBlock(const CBlock &block);
+    void Clear();
+
+    /** Memory budget in bytes, 0 disables the cache */
+    void SetMaxSize(size_t nMaxBytesIn);
+    size_t GetMaxSize() const { return nMaxBytes; }
+
+    uint64_t GetHits() const { return nHits; }
+    uint64_t GetMisses() const { return nMisses; }
+    size_t GetCount();
+    size_t DynamicMemoryUsage();
+
+private:
+    struct Entry
+    {
+        uint256 hash;
+        std::shared_ptr<const CTransaction> tx;
+        uint256 hashBlock;
+        size_t nUsage;
+    };
+
+    struct Hasher
+    {
+        size_t operator()(const uint256 &hash) const { return hash.GetCheapHash(); }
+    };
+
+    struct Shard
+    {
+        CCriticalSection cs;
+        std::list<Entry> lru; // most recently used first
+        std::unordered_map<uint256, std::list<Entry>::iterator, Hasher> map;
+        size_t nUsage = 0;
+    };
+
+    std::atomic<size_t> nMaxBytes;
+    std::atomic<uint64_t> nHits, nMisses;
+    Shard shards[NUM_SHARDS];
+
+    Shard &GetShard(const uint256 &hash) { return shards[*(hash.begin() + 8) % NUM_SHARDS]; }
+    // drops least recently used entries until the shard fits nMaxShardBytes, caller holds shard.cs
+    void Trim(Shard &shard, size_t nMaxShardBytes);
+};
+
+extern CTxCache txcache;
+
+#endif // TXCACHE_H
@@ -214,7 +214,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles), fPendingWrite(false), fWriteFailed(false) {
+}
+
+CBlockTreeDB::~CBlockTreeDB() {
+    SyncIndexWrites();
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -237,6 +241,10 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
 
+bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &hash, CDiskBlockIndex &dbindex) {
+    return Read(make_pair(DB_BLOCK_INDEX, hash), dbindex);
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
@@ -290,7 +298,10 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+        CDiskBlockIndex dbindex(*it);
+        if (!dbindex.fSolution)
+            return error("%s: the solution of block %s cannot be read back", __func__, (*it)->GetBlockHash().ToString());
+        batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), dbindex);
     }
     return WriteBatch(batch, true);
 }
@@ -303,11 +314,72 @@ bool CBlockTreeDB::EraseBatchSync(const std::vector<const CBlockIndex*>& blockin
     return WriteBatch(batch, true);
 }
 
+static bool WriteEntries(CBlockTreeDB &db, const CBlockIndexEntries &entries) {
+    CDBBatch batch(db);
+    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=entries.vPos.begin(); it!=entries.vPos.end(); it++)
+        batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=entries.addressIndex.begin(); it!=entries.addressIndex.end(); it++)
+        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=entries.addressUnspentIndex.begin(); it!=entries.addressUnspentIndex.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+        }
+    }
+    for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=entries.spentIndex.begin(); it!=entries.spentIndex.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+        }
+    }
+    if (entries.fTimestampIndex) {
+        batch.Write(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexKey(entries.logicalTS, entries.hashBlock)), 0);
+        batch.Write(make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(entries.hashBlock)), CTimestampBlockIndexValue(entries.logicalTS));
+    }
+    return db.WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteBlockIndexEntries(const std::shared_ptr<const CBlockIndexEntries> &pentries, bool fAsync) {
+    if (!SyncIndexWrites())
+        return false;
+    if (!fAsync)
+        return WriteEntries(*this, *pentries);
+    LOCK(cs_pendingWrite);
+    pendingWrite = std::async(std::launch::async, [this, pentries]() { return WriteEntries(*this, *pentries); });
+    fPendingWrite = true;
+    return true;
+}
+
+bool CBlockTreeDB::SyncIndexWrites() {
+    if (fPendingWrite) {
+        LOCK(cs_pendingWrite);
+        if (pendingWrite.valid()) {
+            try {
+                if (!pendingWrite.get())
+                    fWriteFailed = true;
+            } catch (const std::exception& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+                fWriteFailed = true;
+            }
+            fPendingWrite = false;
+        }
+    }
+    if (fWriteFailed)
+        return error("%s: failed to write block index entries", __func__);
+    return true;
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
+    if (!SyncIndexWrites())
+        return false;
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
 
 bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+    if (!SyncIndexWrites())
+        return false;
     CDBBatch batch(*this);
     for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
@@ -315,10 +387,14 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
 }
 
 bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
+    if (!SyncIndexWrites())
+        return false;
     return Read(make_pair(DB_SPENTINDEX, key), value);
 }
 
 bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+    if (!SyncIndexWrites())
+        return false;
     CDBBatch batch(*this);
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
@@ -331,6 +407,8 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
 }
 
 bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+    if (!SyncIndexWrites())
+        return false;
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
@@ -344,6 +422,8 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
 
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+    if (!SyncIndexWrites())
+        return false;
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -378,6 +458,8 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
 }
 
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    if (!SyncIndexWrites())
+        return false;
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
@@ -385,6 +467,8 @@ bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKe
 }
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    if (!SyncIndexWrites())
+        return false;
     CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
@@ -394,6 +478,8 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKe
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
+    if (!SyncIndexWrites())
+        return false;
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -458,8 +544,22 @@ uint32_t komodo_segid32(char *coinaddr);
     {"RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY", 1} \
 };
 
+const std::set<std::string> &SnapshotIgnoreList()
+{
+    static std::set<std::string> ignoreList;
+    if ( ignoreList.empty() )
+    {
+        DECLARE_IGNORELIST
+        for (std::map<std::string, int>::const_iterator it = ignoredMap.begin(); it != ignoredMap.end(); ++it)
+            ignoreList.insert(it->first);
+    }
+    return ignoreList;
+}
+
 bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret)
 {
+    if (!SyncIndexWrites())
+        return false;
     int64_t total = 0; int64_t totalAddresses = 0; std::string address;
     int64_t utxos = 0; int64_t ignoredAddresses = 0, cryptoConditionsUTXOs = 0, cryptoConditionsTotals = 0;
     DECLARE_IGNORELIST
@@ -567,6 +667,13 @@ UniValue CBlockTreeDB::Snapshot(int top)
     std::map <std::string, CAmount> addressAmounts;
     UniValue result(UniValue::VOBJ);
     UniValue addressesSorted(UniValue::VARR);
+    if (!SyncIndexWrites())
+    {
+        // the address index may be missing the last blocks, do not report balances from it
+        LogPrintf("%s: the block index entries were not written, no snapshot taken\n", __func__);
+        result.push_back(make_pair("error", "problem writing the address index"));
+        return(result);
+    }
     result.push_back(Pair("start_time", (int) time(NULL)));
     if ( (vAddressSnapshot.size() > 0 && top < 0) || (Snapshot2(addressAmounts,&result) && top >= 0) )
     {
@@ -604,12 +711,16 @@ UniValue CBlockTreeDB::Snapshot(int top)
 }
 
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
+    if (!SyncIndexWrites())
+        return false;
     CDBBatch batch(*this);
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
     return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
+    if (!SyncIndexWrites())
+        return false;
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -645,12 +756,16 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
 }
 
 bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
+    if (!SyncIndexWrites())
+        return false;
     CDBBatch batch(*this);
     batch.Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
     return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
+    if (!SyncIndexWrites())
+        return false;
 
     CTimestampBlockIndexValue(lts);
     if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
@@ -712,7 +827,6 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 pindexNew->nTime          = diskindex.nTime;
                 pindexNew->nBits          = diskindex.nBits;
                 pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
                 pindexNew->nTx            = diskindex.nTx;
@@ -721,8 +835,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 pindexNew->segid          = diskindex.segid;
                 pindexNew->nNotaryPay     = diskindex.nNotaryPay;
 //fprintf(stderr,"loadguts ht.%d\n",pindexNew->GetHeight());
-                // Consistency checks
-                auto header = pindexNew->GetBlockHeader();
+                // Consistency checks. The solution is not loaded, it is read back from the db when needed
+                auto header = pindexNew->GetBlockHeader(false);
+                header.nSolution = diskindex.nSolution;
                 if (header.GetHash() != pindexNew->GetBlockHash())
                     return error("LoadBlockIndex(): block header inconsistency detected: on-disk = %s, in-memory = %s",
                                  diskindex.ToString(),  pindexNew->ToString());
@@ -23,8 +23,13 @@
 
 #include "coins.h"
 #include "dbwrapper.h"
+#include "sync.h"
 
+#include <atomic>
+#include <future>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -32,6 +37,7 @@
 
 class CBlockFileInfo;
 class CBlockIndex;
+class CDiskBlockIndex;
 struct CDiskTxPos;
 struct CAddressUnspentKey;
 struct CAddressUnspentValue;
@@ -44,6 +50,7 @@ struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
+struct CBlockIndexEntries;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -85,14 +92,22 @@ class CBlockTreeDB : public CDBWrapper
 {
 public:
     CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool compression = true, int maxOpenFiles = 1000);
+    ~CBlockTreeDB();
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    // index entries of the last connected block being written by a background thread, see WriteBlockIndexEntries
+    CCriticalSection cs_pendingWrite;
+    std::atomic<bool> fPendingWrite;
+    std::atomic<bool> fWriteFailed;
+    std::future<bool> pendingWrite;
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool EraseBatchSync(const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
+    bool ReadDiskBlockIndex(const uint256 &hash, CDiskBlockIndex &dbindex);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
@@ -111,6 +126,12 @@ public:
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
+    /** Writes the tx, address, spent and timestamp index entries of a connected block in one batch.
+     *  With fAsync the batch is written by a background thread and the call returns at once; every read and
+     *  write of these indexes, and SyncIndexWrites, first waits for it. */
+    bool WriteBlockIndexEntries(const std::shared_ptr<const CBlockIndexEntries> &pentries, bool fAsync = false);
+    /** Waits for the pending asynchronous index write, returns false if it failed */
+    bool SyncIndexWrites();
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
@@ -119,4 +140,7 @@ public:
     bool Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret);
 };
 
+/** Addresses left out of the address snapshot. */
+const std::set<std::string> &SnapshotIgnoreList();
+
 #endif // BITCOIN_TXDB_H
@@ -31,6 +31,9 @@
 #include "utilmoneystr.h"
 #include "validationinterface.h"
 #include "version.h"
+
+#include <cmath>
+
 #define _COINBASE_MATURITY 100
 
 using namespace std;
@@ -71,13 +74,17 @@ CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), minReasonableRelayFee(_minRelayFee)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
     // of transactions in the pool
     nCheckFrequency = 0;
 
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
+    rollingMinimumFeeRate = 0;
+
     minerPolicyEstimator = new CBlockPolicyEstimator(_minRelayFee);
 }
 
@@ -112,6 +119,15 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
+// the cc indexes follow the node mempool only, not the temporary pools used while checking a block
+void CCMempoolAdd(const CTransaction &tx);
+void CCMempoolRemove(const CTransaction &tx);
+void CCMempoolClear();
+// and so does the kv overlay of komodo_kvsearchmempool
+void komodo_kvmempooladd(const CTransaction &tx);
+void komodo_kvmempoolremove(const CTransaction &tx);
+void komodo_kvmempoolclear();
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate)
 {
     // Add to memory pool without checking anything.
@@ -141,6 +157,11 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     totalTxSize += entry.GetTxSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
+    if (this == &::mempool)
+    {
+        CCMempoolAdd(tx);
+        komodo_kvmempooladd(tx);
+    }
 
     return true;
 }
@@ -217,7 +238,9 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
         }
     }
 
-    mapAddressInserted.insert(make_pair(txhash, inserted));
+    std::pair<addressDeltaMapInserted::iterator, bool> ret = mapAddressInserted.insert(make_pair(txhash, inserted));
+    if (ret.second)
+        cachedInnerUsage += memusage::DynamicUsage(ret.first->second);
 }
 
 bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
@@ -244,6 +267,7 @@ bool CTxMemPool::removeAddressIndex(const uint256 txhash)
         for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
             mapAddress.erase(*mit);
         }
+        cachedInnerUsage -= memusage::DynamicUsage(it->second);
         mapAddressInserted.erase(it);
     }
 
@@ -302,7 +326,9 @@ void CTxMemPool::addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCac
             inserted.push_back(key);
         }
     }
-    mapSpentInserted.insert(make_pair(txhash, inserted));
+    std::pair<mapSpentIndexInserted::iterator, bool> ret = mapSpentInserted.insert(make_pair(txhash, inserted));
+    if (ret.second)
+        cachedInnerUsage += memusage::DynamicUsage(ret.first->second);
 }
 
 bool CTxMemPool::getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
@@ -328,6 +354,7 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
         for (std::vector<CSpentIndexKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
             mapSpent.erase(*mit);
         }
+        cachedInnerUsage -= memusage::DynamicUsage(it->second);
         mapSpentInserted.erase(it);
     }
 
@@ -379,6 +406,11 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
                 mapSaplingNullifiers.erase(spendDescription.nullifier);
             }
+            if (this == &::mempool)
+            {
+                CCMempoolRemove(tx);
+                komodo_kvmempoolremove(tx);
+            }
             removed.push_back(tx);
             totalTxSize -= mapTx.find(hash)->GetTxSize();
             cachedInnerUsage -= mapTx.find(hash)->DynamicMemoryUsage();
@@ -562,6 +594,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     }
     // After the txs in the new block have been removed from the mempool, update policy estimates
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 /**
@@ -591,6 +625,15 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapAddress.clear();
+    mapAddressInserted.clear();
+    mapSpent.clear();
+    mapSpentInserted.clear();
+    if (this == &::mempool)
+    {
+        CCMempoolClear();
+        komodo_kvmempoolclear();
+    }
     totalTxSize = 0;
     cachedInnerUsage = 0;
     ++nTransactionsUpdated;
@@ -914,6 +957,127 @@ bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 6 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 6 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + cachedInnerUsage;
+    // Estimate the overhead of mapTx to be 9 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 9 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) +
+        memusage::DynamicUsage(mapAddress) + memusage::DynamicUsage(mapAddressInserted) + memusage::DynamicUsage(mapSpent) + memusage::DynamicUsage(mapSpentInserted) +
+        memusage::DynamicUsage(mapRecentlyAddedTx) + memusage::DynamicUsage(mapSproutNullifiers) + memusage::DynamicUsage(mapSaplingNullifiers) + cachedInnerUsage;
+}
+
+CFeeRate CTxMemPool::GetDescendantScore(const CTxMemPoolEntry &entry, std::set<uint256> &setDescendants) const
+{
+    CAmount nFees = 0;
+    size_t nSize = 0;
+    std::deque<uint256> queue;
+    setDescendants.clear();
+    queue.push_back(entry.GetTx().GetHash());
+    while (!queue.empty())
+    {
+        uint256 hash = queue.front();
+        queue.pop_front();
+        indexed_transaction_set::const_iterator it = mapTx.find(hash);
+        if (it == mapTx.end() || !setDescendants.insert(hash).second)
+            continue;
+        if (setDescendants.size() > MEMPOOL_TRIM_MAX_DESCENDANTS)
+            break;
+        nFees += it->GetFee();
+        nSize += it->GetTxSize();
+        for (unsigned int i = 0; i < it->GetTx().vout.size(); i++) {
+            std::map<COutPoint, CInPoint>::const_iterator itnext = mapNextTx.find(COutPoint(hash, i));
+            if (itnext != mapNextTx.end())
+                queue.push_back(itnext->second.ptx->GetHash());
+        }
+    }
+    return std::max(entry.GetFeeRate(), CFeeRate(nFees, nSize));
+}
+
+int CTxMemPool::Expire(int64_t time)
+{
+    LOCK(cs);
+    std::list<CTransaction> transactionsToRemove;
+    indexed_transaction_set::nth_index<2>::type::iterator it = mapTx.get<2>().begin();
+    for (; it != mapTx.get<2>().end() && it->GetTime() < time; it++)
+        transactionsToRemove.push_back(it->GetTx());
+
+    size_t nSizeBefore = mapTx.size();
+    for (const CTransaction& tx : transactionsToRemove) {
+        std::list<CTransaction> removed;
+        remove(tx, removed, true);
+    }
+    return nSizeBefore - mapTx.size();
+}
+
+void CTxMemPool::TrimToSize(size_t sizelimit)
+{
+    LOCK(cs);
+    unsigned int nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    std::set<uint256> setDescendants;
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit)
+    {
+        // the own fee rate is a lower bound of the score, walking up from the lowest fee rate
+        // the best candidate is known once the fee rates reach its score. a long run of low fee
+        // parents with high fee children would make every eviction walk most of the pool, so
+        // only MEMPOOL_TRIM_MAX_CANDIDATES are scored and the worst of them is evicted
+        const CTxMemPoolEntry *pworst = NULL;
+        CFeeRate worstScore;
+        unsigned int nCandidates = 0;
+        indexed_transaction_set::nth_index<1>::type::reverse_iterator it = mapTx.get<1>().rbegin();
+        for (; it != mapTx.get<1>().rend(); it++)
+        {
+            if (pworst != NULL && (it->GetFeeRate() >= worstScore || nCandidates >= MEMPOOL_TRIM_MAX_CANDIDATES))
+                break;
+            if (it->GetTx().IsCoinImport() || it->GetTx().IsPegsImport())
+                continue;
+            CFeeRate score = GetDescendantScore(*it, setDescendants);
+            nCandidates++;
+            if (pworst == NULL || score < worstScore)
+            {
+                pworst = &(*it);
+                worstScore = score;
+            }
+        }
+        if (pworst == NULL)
+            break;
+
+        if (worstScore > maxFeeRateRemoved)
+            maxFeeRateRemoved = worstScore;
+        std::list<CTransaction> removed;
+        CTransaction tx = pworst->GetTx();
+        remove(tx, removed, true);
+        nTxnRemoved += removed.size();
+    }
+
+    if (maxFeeRateRemoved > CFeeRate(0))
+    {
+        rollingMinimumFeeRate = std::max(rollingMinimumFeeRate, (double)(maxFeeRateRemoved.GetFeePerK() + minReasonableRelayFee.GetFeePerK()));
+        blockSinceLastRollingFeeBump = false;
+        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, CFeeRate((CAmount)rollingMinimumFeeRate).ToString());
+    }
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate((CAmount)rollingMinimumFeeRate);
+
+    int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10)
+    {
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (DynamicMemoryUsage() < sizelimit / 4)
+            halflife /= 4;
+        else if (DynamicMemoryUsage() < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < (double)minReasonableRelayFee.GetFeePerK() / 2)
+        {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate((CAmount)rollingMinimumFeeRate), minReasonableRelayFee);
 }
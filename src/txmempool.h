@@ -22,6 +22,7 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "addressindex.h"
 #include "spentindex.h"
@@ -51,6 +52,11 @@ inline bool AllowFree(double dPriority)
 /** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Transactions scored per TrimToSize eviction, walking up from the lowest fee rate */
+static const unsigned int MEMPOOL_TRIM_MAX_CANDIDATES = 100;
+/** Descendants counted in the score of one eviction candidate */
+static const unsigned int MEMPOOL_TRIM_MAX_DESCENDANTS = 100;
+
 /**
  * CTxMemPool stores these:
  */
@@ -112,6 +118,15 @@ public:
     }
 };
 
+class CompareTxMemPoolEntryByEntryTime
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    {
+        return a.GetTime() < b.GetTime();
+    }
+};
+
 class CBlockPolicyEstimator;
 
 /** An inpoint - a combination of a transaction and an index n into its vin */
@@ -155,7 +170,15 @@ private:
     std::map<uint256, const CTransaction*> mapSproutNullifiers;
     std::map<uint256, const CTransaction*> mapSaplingNullifiers;
 
+    CFeeRate minReasonableRelayFee;
+
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate; //! minimum fee to get into the pool, decreases exponentially
+
     void checkNullifiers(ShieldedType type) const;
+    // fee rate of the transaction and its first MEMPOOL_TRIM_MAX_DESCENDANTS in-pool descendants, or its own fee rate if that is higher
+    CFeeRate GetDescendantScore(const CTxMemPoolEntry &entry, std::set<uint256> &setDescendants) const;
     
 public:
     typedef boost::multi_index_container<
@@ -167,6 +190,11 @@ public:
             boost::multi_index::ordered_non_unique<
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByFee
+            >,
+            // sorted by entry time
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByEntryTime
             >
         >
     > indexed_transaction_set;
@@ -188,6 +216,8 @@ private:
     mapSpentIndexInserted mapSpentInserted;
 
 public:
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
+
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
@@ -220,6 +250,19 @@ public:
     void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
                         std::list<CTransaction>& conflicts, bool fCurrentEstimate = true);
     void removeWithoutBranchId(uint32_t nMemPoolBranchId);
+    /** Removes the transactions that entered the pool before time, with their descendants. Returns the number removed */
+    int Expire(int64_t time);
+    /**
+     * Removes the transaction with the lowest descendant score together with its descendants until the pool uses
+     * at most sizelimit bytes, and raises the rolling minimum fee above the scores removed.
+     * Coin and pegs imports carry no fee and are never evicted.
+     */
+    void TrimToSize(size_t sizelimit);
+    /**
+     * The minimum fee rate to get into a pool limited to sizelimit bytes. Raised by TrimToSize, it decays
+     * with a half life of ROLLING_FEE_HALFLIFE (shorter when the pool is less than half full) once a block is connected.
+     */
+    CFeeRate GetMinFee(size_t sizelimit) const;
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
     void pruneSpent(const uint256& hash, CCoins &coins);
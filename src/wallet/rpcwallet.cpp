@@ -595,7 +595,7 @@ UniValue kvupdate(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     static uint256 zeroes;
     CWalletTx wtx; UniValue ret(UniValue::VOBJ);
-    uint8_t keyvalue[IGUANA_MAXSCRIPTSIZE*8],opretbuf[IGUANA_MAXSCRIPTSIZE*8]; int32_t i,coresize,haveprivkey,duration,opretlen,height; uint16_t keylen=0,valuesize=0,refvaluesize=0; uint8_t *key,*value=0; uint32_t flags,tmpflags,n; struct komodo_kv *ptr; uint64_t fee; uint256 privkey,pubkey,refpubkey,sig;
+    uint8_t keyvalue[IGUANA_MAXSCRIPTSIZE*8],opretbuf[IGUANA_MAXSCRIPTSIZE*8]; int32_t i,coresize,haveprivkey,duration,opretlen,height; uint16_t keylen=0,valuesize=0,refvaluesize=0; uint8_t *key,*value=0; uint32_t flags,tmpflags,n; uint64_t fee; uint256 privkey,pubkey,refpubkey,sig;
     if (fHelp || params.size() < 3 )
         throw runtime_error(
             "kvupdate key \"value\" days passphrase\n"
@@ -3397,6 +3397,51 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
             sample_times.push_back(benchmark_loadwallet());
         } else if (benchmarktype == "listunspent") {
             sample_times.push_back(benchmark_listunspent());
+        } else if (benchmarktype == "getutxos" || benchmarktype == "getutxosbatch") {
+            // Number of outpoints looked up, in requests of 15 or in one batch
+            int nOutPoints = 10000;
+            if (params.size() >= 3) {
+                nOutPoints = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_getutxos(nOutPoints, benchmarktype == "getutxosbatch"));
+        } else if (benchmarktype == "gettransaction" || benchmarktype == "gettransactionnocache") {
+            // Number of input transactions of recent blocks looked up
+            int nLookups = 10000;
+            if (params.size() >= 3) {
+                nLookups = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_gettransaction(nLookups, benchmarktype == "gettransaction"));
+        } else if (benchmarktype == "readblockfiles" || benchmarktype == "readblockfilesnomap") {
+            // Number of random transactions read from the block files
+            int nReads = 10000;
+            if (params.size() >= 3) {
+                nReads = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_readblockfiles(nReads, benchmarktype == "readblockfiles"));
+        } else if (benchmarktype == "messagelatency") {
+            if (Params().NetworkIDString() != "regtest") {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
+            }
+            // Number of peers pinging while cs_main is held
+            int nPeers = 64;
+            if (params.size() >= 3) {
+                nPeers = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_messagelatency(nPeers));
+        } else if (benchmarktype == "komodohashes") {
+            // Number of addresses derived and records hashed
+            int nCalls = 100000;
+            if (params.size() >= 3) {
+                nCalls = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_komodohashes(nCalls));
+        } else if (benchmarktype == "blockjson" || benchmarktype == "blockjsonstream") {
+            // Number of transactions of the block written as verbose json
+            int nTxs = 5000;
+            if (params.size() >= 3) {
+                nTxs = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_blockjson(nTxs, benchmarktype == "blockjsonstream"));
         } else if (benchmarktype == "createsaplingspend") {
             sample_times.push_back(benchmark_create_sapling_spend());
         } else if (benchmarktype == "createsaplingoutput") {
@@ -7576,6 +7621,7 @@ UniValue tokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk)
     if ( fHelp || params.size() > 1 )
         throw runtime_error("tokenorders [tokenid]\n"
                             "returns token orders for the tokenid or all available token orders if tokenid is not set\n"
+                            "only confirmed orders are listed, orders in the mempool are not\n"
                             "(this rpc supports only fungible tokens)\n" "\n");
     if (ensure_CCrequirements(EVAL_ASSETS) < 0 || ensure_CCrequirements(EVAL_TOKENS) < 0)
         throw runtime_error(CC_REQUIREMENTS_MSG);
@@ -7597,7 +7643,7 @@ UniValue mytokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk)
     uint256 tokenid;
     if (fHelp || params.size() > 1)
         throw runtime_error("mytokenorders [evalcode]\n"
-                            "returns all the token orders for mypubkey\n"
+                            "returns all the confirmed token orders for mypubkey\n"
                             "if evalcode is set then returns mypubkey token orders for non-fungible tokens with this evalcode\n" "\n");
     if (ensure_CCrequirements(EVAL_ASSETS) < 0 || ensure_CCrequirements(EVAL_TOKENS) < 0)
         throw runtime_error(CC_REQUIREMENTS_MSG);
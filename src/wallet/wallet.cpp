@@ -962,12 +962,12 @@ void CWallet::AddToSpends(const uint256& wtxid)
 void CWallet::ClearNoteWitnessCache()
 {
     LOCK(cs_wallet);
-    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-        for (mapSproutNoteData_t::value_type& item : wtxItem.second.mapSproutNoteData) {
+    for (CWalletTx* pwtx : GetNoteTxs()) {
+        for (mapSproutNoteData_t::value_type& item : pwtx->mapSproutNoteData) {
             item.second.witnesses.clear();
             item.second.witnessHeight = -1;
         }
-        for (mapSaplingNoteData_t::value_type& item : wtxItem.second.mapSaplingNoteData) {
+        for (mapSaplingNoteData_t::value_type& item : pwtx->mapSaplingNoteData) {
             item.second.witnesses.clear();
             item.second.witnessHeight = -1;
         }
@@ -1004,21 +1004,29 @@ void CopyPreviousWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nW
 }
 
 template<typename NoteDataMap>
-void AppendNoteCommitment(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const uint256& note_commitment)
+void AppendNoteCommitments(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const std::vector<uint256>& note_commitments)
 {
+    if (note_commitments.empty())
+        return;
     for (auto& item : noteDataMap) {
         auto* nd = &(item.second);
         if (nd->witnessHeight < indexHeight && nd->witnesses.size() > 0) {
             // Check the validity of the cache
             // See comment in CopyPreviousWitnesses about validity.
             assert(nWitnessCacheSize >= nd->witnesses.size());
-            nd->witnesses.front().append(note_commitment);
+            for (const uint256& note_commitment : note_commitments) {
+                nd->witnesses.front().append(note_commitment);
+            }
         }
     }
 }
 
+/**
+ * Returns the new witness of the note, or nullptr if the note is not ours or
+ * already witnessed at indexHeight.
+ */
 template<typename OutPoint, typename NoteData, typename Witness>
-void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
+Witness* WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
 {
     if (noteDataMap.count(key) && noteDataMap[key].witnessHeight < indexHeight) {
         auto* nd = &(noteDataMap[key]);
@@ -1044,7 +1052,9 @@ void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeigh
         nd->witnessHeight = indexHeight - 1;
         // Check the validity of the cache
         assert(nWitnessCacheSize >= nd->witnesses.size());
+        return &nd->witnesses.front();
     }
+    return nullptr;
 }
 
 
@@ -1062,15 +1072,40 @@ void UpdateWitnessHeights(NoteDataMap& noteDataMap, int indexHeight, int64_t nWi
     }
 }
 
+std::vector<CWalletTx*> CWallet::GetNoteTxs()
+{
+    AssertLockHeld(cs_wallet);
+    std::vector<CWalletTx*> vNoteTxs;
+    vNoteTxs.reserve(setNoteTxs.size());
+    for (const uint256& hash : setNoteTxs) {
+        std::map<uint256, CWalletTx>::iterator it = mapWallet.find(hash);
+        if (it != mapWallet.end()) {
+            vNoteTxs.push_back(&it->second);
+        }
+    }
+    return vNoteTxs;
+}
+
+void CWallet::UpdateNoteTxs(const uint256& hash, const CWalletTx& wtx)
+{
+    if (wtx.mapSproutNoteData.empty() && wtx.mapSaplingNoteData.empty()) {
+        setNoteTxs.erase(hash);
+    } else {
+        setNoteTxs.insert(hash);
+    }
+}
+
 void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                                      const CBlock* pblockIn,
                                      SproutMerkleTree& sproutTree,
                                      SaplingMerkleTree& saplingTree)
 {
     LOCK(cs_wallet);
-    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-       ::CopyPreviousWitnesses(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize);
-       ::CopyPreviousWitnesses(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize);
+    // Only transactions with note data have witnesses to update
+    std::vector<CWalletTx*> vNoteTxs = GetNoteTxs();
+    for (CWalletTx* pwtx : vNoteTxs) {
+       ::CopyPreviousWitnesses(pwtx->mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize);
+       ::CopyPreviousWitnesses(pwtx->mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize);
     }
 
     if (nWitnessCacheSize < WITNESS_CACHE_SIZE) {
@@ -1084,6 +1119,26 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
         pblock = &block;
     }
 
+    // Increment existing witnesses with all the note commitments of the block
+    // in one pass per note
+    std::vector<uint256> sproutCommitments, saplingCommitments;
+    for (const CTransaction& tx : pblock->vtx) {
+        for (const JSDescription& jsdesc : tx.vjoinsplit) {
+            sproutCommitments.insert(sproutCommitments.end(), jsdesc.commitments.begin(), jsdesc.commitments.end());
+        }
+        for (const OutputDescription& output : tx.vShieldedOutput) {
+            saplingCommitments.push_back(output.cm);
+        }
+    }
+    for (CWalletTx* pwtx : vNoteTxs) {
+        ::AppendNoteCommitments(pwtx->mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, sproutCommitments);
+        ::AppendNoteCommitments(pwtx->mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, saplingCommitments);
+    }
+
+    // Witnesses of our notes created in this block are incremented with the
+    // commitments following them
+    std::vector<SproutWitness*> newSproutWitnesses;
+    std::vector<SaplingWitness*> newSaplingWitnesses;
     for (const CTransaction& tx : pblock->vtx) {
         auto hash = tx.GetHash();
         bool txIsOurs = mapWallet.count(hash);
@@ -1094,15 +1149,17 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                 const uint256& note_commitment = jsdesc.commitments[j];
                 sproutTree.append(note_commitment);
 
-                // Increment existing witnesses
-                for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                    ::AppendNoteCommitment(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, note_commitment);
+                for (SproutWitness* witness : newSproutWitnesses) {
+                    witness->append(note_commitment);
                 }
 
                 // If this is our note, witness it
                 if (txIsOurs) {
                     JSOutPoint jsoutpt {hash, i, j};
-                    ::WitnessNoteIfMine(mapWallet[hash].mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, jsoutpt, sproutTree.witness());
+                    SproutWitness* witness = ::WitnessNoteIfMine(mapWallet[hash].mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, jsoutpt, sproutTree.witness());
+                    if (witness != nullptr) {
+                        newSproutWitnesses.push_back(witness);
+                    }
                 }
             }
         }
@@ -1111,23 +1168,25 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
             const uint256& note_commitment = tx.vShieldedOutput[i].cm;
             saplingTree.append(note_commitment);
 
-            // Increment existing witnesses
-            for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                ::AppendNoteCommitment(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, note_commitment);
+            for (SaplingWitness* witness : newSaplingWitnesses) {
+                witness->append(note_commitment);
             }
 
             // If this is our note, witness it
             if (txIsOurs) {
                 SaplingOutPoint outPoint {hash, i};
-                ::WitnessNoteIfMine(mapWallet[hash].mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, outPoint, saplingTree.witness());
+                SaplingWitness* witness = ::WitnessNoteIfMine(mapWallet[hash].mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, outPoint, saplingTree.witness());
+                if (witness != nullptr) {
+                    newSaplingWitnesses.push_back(witness);
+                }
             }
         }
     }
 
     // Update witness heights
-    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-        ::UpdateWitnessHeights(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize);
-        ::UpdateWitnessHeights(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize);
+    for (CWalletTx* pwtx : vNoteTxs) {
+        ::UpdateWitnessHeights(pwtx->mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize);
+        ::UpdateWitnessHeights(pwtx->mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize);
     }
 
     // For performance reasons, we write out the witness cache in
@@ -1187,10 +1246,10 @@ bool DecrementNoteWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t n
 void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
 {
     LOCK(cs_wallet);
-    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-        if (!::DecrementNoteWitnesses(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize))
+    for (CWalletTx* pwtx : GetNoteTxs()) {
+        if (!::DecrementNoteWitnesses(pwtx->mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize))
             needsRescan = true;
-        if (!::DecrementNoteWitnesses(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize))
+        if (!::DecrementNoteWitnesses(pwtx->mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize))
             needsRescan = true;
     }
     if ( WITNESS_CACHE_SIZE == _COINBASE_MATURITY+10 )
@@ -1594,6 +1653,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         mapWallet[hash] = wtxIn;
         mapWallet[hash].BindWallet(this);
         UpdateNullifierNoteMapWithTx(mapWallet[hash]);
+        UpdateNoteTxs(hash, mapWallet[hash]);
         AddToSpends(hash);
     }
     else
@@ -1683,6 +1743,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
             }
         }
 
+        UpdateNoteTxs(hash, wtx);
+
         //// debug print
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
@@ -1880,6 +1942,7 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         return;
     {
         LOCK(cs_wallet);
+        setNoteTxs.erase(hash);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
     }
@@ -784,6 +784,16 @@ private:
     void AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    /**
+     * Hashes of the transactions in mapWallet with Sprout or Sapling note
+     * data. Only their witnesses are maintained when blocks are connected
+     * or disconnected, so purely transparent transactions are never visited.
+     */
+    std::set<uint256> setNoteTxs;
+
+    std::vector<CWalletTx*> GetNoteTxs();
+    void UpdateNoteTxs(const uint256& hash, const CWalletTx& wtx);
+
 public:
     /*
      * Size of the incremental witness cache for the notes in our wallet.
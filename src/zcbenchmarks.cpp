@@ -3,6 +3,10 @@
 #include <map>
 #include <thread>
 #include <unistd.h>
+#ifndef WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#endif
 #include <boost/filesystem.hpp>
 
 #include "coins.h"
@@ -10,18 +14,24 @@
 #include "init.h"
 #include "primitives/transaction.h"
 #include "base58.h"
+#include "blockfilepool.h"
 #include "crypto/equihash.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
+#include "httprpc.h"
 #include "main.h"
 #include "miner.h"
+#include "net.h"
+#include "netbase.h"
 #include "pow.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
 #include "script/sign.h"
 #include "sodium.h"
 #include "streams.h"
+#include "txcache.h"
 #include "txdb.h"
 #include "utiltest.h"
 #include "wallet/wallet.h"
@@ -475,6 +485,263 @@ double benchmark_listunspent()
     return timer_stop(tv_start);
 }
 
+double benchmark_getutxos(size_t nOutPoints, bool fBatch)
+{
+    // Query the outputs of the most recent blocks, spent or not
+    std::vector<COutPoint> vOutPoints;
+    {
+        LOCK(cs_main);
+        for (CBlockIndex *pindex = chainActive.Tip(); pindex != NULL && vOutPoints.size() < nOutPoints; pindex = pindex->pprev) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex, false))
+                throw std::runtime_error("Failed to read block from disk");
+            for (const CTransaction& tx : block.vtx)
+                for (uint32_t n = 0; n < tx.vout.size() && vOutPoints.size() < nOutPoints; n++)
+                    vOutPoints.push_back(COutPoint(tx.GetHash(), n));
+        }
+    }
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    rest_countutxos(vOutPoints, true, fBatch);
+    return timer_stop(tv_start);
+}
+
+bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock); // in main.cpp
+
+double benchmark_gettransaction(size_t nLookups, bool fCache)
+{
+    // Resolve the inputs of the most recent blocks the way cc validation does, funding
+    // transactions spent by many later transactions are looked up many times
+    std::vector<uint256> vTxids;
+    {
+        LOCK(cs_main);
+        for (CBlockIndex *pindex = chainActive.Tip(); pindex != NULL && vTxids.size() < nLookups; pindex = pindex->pprev) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex, false))
+                throw std::runtime_error("Failed to read block from disk");
+            for (const CTransaction& tx : block.vtx)
+                for (const CTxIn& txin : tx.vin)
+                    if (!txin.prevout.IsNull() && vTxids.size() < nLookups)
+                        vTxids.push_back(txin.prevout.hash);
+        }
+    }
+
+    size_t nMaxSize = txcache.GetMaxSize();
+    txcache.Clear();
+    txcache.SetMaxSize(fCache ? std::max(nMaxSize, (size_t)DEFAULT_TXCACHE_SIZE << 20) : 0);
+    struct timeval tv_start;
+    timer_start(tv_start);
+    CTransaction tx; uint256 hashBlock;
+    for (const uint256& txid : vTxids)
+        myGetTransaction(txid, tx, hashBlock);
+    double res = timer_stop(tv_start);
+    txcache.SetMaxSize(nMaxSize);
+    return res;
+}
+
+double benchmark_readblockfiles(size_t nReads, bool fMapped)
+{
+    // Transactions of random blocks, read through the txindex in random order
+    std::vector<uint256> vTxids;
+    {
+        LOCK(cs_main);
+        if (chainActive.Height() <= 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "No blocks to read");
+        for (size_t i = 0; i < nReads; i++) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, chainActive[1 + GetRand(chainActive.Height())], false))
+                throw std::runtime_error("Failed to read block from disk");
+            vTxids.push_back(block.vtx[GetRand(block.vtx.size())].GetHash());
+        }
+    }
+
+    size_t nMaxSize = txcache.GetMaxSize(), nMaxFiles = blockfilepool.GetMaxFiles();
+    txcache.SetMaxSize(0);
+    blockfilepool.Clear();
+    blockfilepool.SetMaxFiles(fMapped ? std::max(nMaxFiles, (size_t)DEFAULT_BLOCKFILE_MAPS) : 0);
+    struct timeval tv_start;
+    timer_start(tv_start);
+    CTransaction tx; uint256 hashBlock;
+    for (const uint256& txid : vTxids)
+        myGetTransaction(txid, tx, hashBlock);
+    double res = timer_stop(tv_start);
+    blockfilepool.SetMaxFiles(nMaxFiles);
+    txcache.SetMaxSize(nMaxSize);
+    return res;
+}
+
+char *bitcoin_address(char *coinaddr,uint8_t addrtype,uint8_t *pubkey_or_rmd160,int32_t len); // in komodo_utils.h
+void vcalc_sha256(char deprecated[(256 >> 3) * 2 + 1],uint8_t hash[256 >> 3],uint8_t *src,int32_t len);
+
+double benchmark_komodohashes(size_t nCalls)
+{
+    // Address derivation the way the cc modules and nSPV do it, a sha256 and rmd160 of the pubkey
+    // and a double sha256 checksum, then a sha256 of a 1 kB record like the state file entries
+    std::vector<uint8_t> vPubkey(33), vRecord(1024);
+    GetRandBytes(vPubkey.data(), vPubkey.size());
+    GetRandBytes(vRecord.data(), vRecord.size());
+    vPubkey[0] = 2;
+    char coinaddr[64];
+    uint8_t hash[32];
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (size_t i = 0; i < nCalls; i++) {
+        vPubkey[1 + i % 32]++;
+        bitcoin_address(coinaddr, 60, vPubkey.data(), vPubkey.size());
+        vcalc_sha256(0, hash, vRecord.data(), vRecord.size());
+    }
+    return timer_stop(tv_start);
+}
+
+extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, const CTxJSONContext& ctx); // in rpc/rawtransaction.cpp
+extern void TxToJSONStream(CJSONWriter& writer, const CTransaction& tx, const uint256 hashBlock, const CTxJSONContext& ctx);
+
+double benchmark_blockjson(size_t nTxs, bool fStream)
+{
+    // The transaction details of a large block, two signed inputs and two pay to pubkey hash outputs each
+    std::vector<CTransaction> vtx;
+    for (size_t i = 0; i < nTxs; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(2);
+        mtx.vout.resize(2);
+        for (size_t j = 0; j < 2; j++) {
+            std::vector<unsigned char> vSig(72), vPubkey(33);
+            GetRandBytes(vSig.data(), vSig.size());
+            GetRandBytes(vPubkey.data(), vPubkey.size());
+            mtx.vin[j].prevout = COutPoint(GetRandHash(), j);
+            mtx.vin[j].scriptSig = CScript() << vSig << vPubkey;
+            mtx.vout[j].nValue = GetRand(100 * COIN);
+            mtx.vout[j].scriptPubKey = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(vPubkey.begin(), vPubkey.begin() + 20))));
+        }
+        vtx.push_back(CTransaction(mtx));
+    }
+
+    CTxJSONContext ctx = CTxJSONContext::Current();
+    std::string strJSON;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    if (fStream) {
+        CJSONWriter writer(strJSON);
+        writer.BeginArray();
+        for (const CTransaction& tx : vtx)
+            TxToJSONStream(writer, tx, uint256(), ctx);
+        writer.EndArray();
+    } else {
+        UniValue txs(UniValue::VARR);
+        for (const CTransaction& tx : vtx) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(tx, uint256(), objTx, ctx);
+            txs.push_back(objTx);
+        }
+        strJSON = txs.write();
+    }
+    return timer_stop(tv_start);
+}
+
+#ifndef WIN32
+static void send_test_message(int fd, const char *pszCommand, const CDataStream &payload)
+{
+    uint256 hash = Hash(payload.begin(), payload.end());
+    CMessageHeader hdr(Params().MessageStart(), pszCommand, payload.size());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr;
+    std::string strPayload = payload.str();
+    ss.write(strPayload.data(), strPayload.size());
+    if (send(fd, &ss[0], ss.size(), MSG_NOSIGNAL) != (ssize_t)ss.size())
+        throw std::runtime_error("Failed to write to test peer");
+}
+#endif
+
+double benchmark_messagelatency(size_t nPeers)
+{
+#ifdef WIN32
+    throw JSONRPCError(RPC_INTERNAL_ERROR, "Benchmark not available on windows");
+#else
+    // Peers connected over socket pairs. The rpc holds cs_main for the whole benchmark, like a long block
+    // validation would, and the first peer asks for headers, which needs cs_main. The other peers ping,
+    // the result is the worst time a ping waited for its pong.
+    static const int64_t nTimeout = 10 * 1000000;
+    std::vector<CNode*> vPeers;
+    std::vector<int> vRemote;
+    for (size_t i = 0; i < nPeers + 1; i++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            break;
+        CNode* pnode = new CNode(fds[0], CAddress(CService(CNetAddr("127.0.0.1"), 1 + i)), "", true);
+        pnode->nVersion = PROTOCOL_VERSION;
+        pnode->fSuccessfullyConnected = true;
+        pnode->AddRef();
+        {
+            LOCK(cs_vNodes);
+            vNodes.push_back(pnode);
+        }
+        vPeers.push_back(pnode);
+        vRemote.push_back(fds[1]);
+    }
+
+    std::vector<int64_t> vSent(vRemote.size()), vLatency(vRemote.size(), nTimeout);
+    std::vector<std::vector<char> > vBuffers(vRemote.size());
+    if (!vRemote.empty()) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << chainActive.GetLocator() << uint256();
+        send_test_message(vRemote[0], "getheaders", ss);
+    }
+    for (size_t i = 1; i < vRemote.size(); i++) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << (uint64_t)i;
+        vSent[i] = GetTimeMicros();
+        send_test_message(vRemote[i], "ping", ss);
+    }
+
+    size_t nPending = vRemote.size() - std::min(vRemote.size(), (size_t)1);
+    int64_t nStart = GetTimeMicros();
+    while (nPending > 0 && GetTimeMicros() - nStart < nTimeout) {
+        std::vector<struct pollfd> vPoll(vRemote.size());
+        for (size_t i = 0; i < vRemote.size(); i++) {
+            vPoll[i].fd = vRemote[i];
+            vPoll[i].events = POLLIN;
+            vPoll[i].revents = 0;
+        }
+        if (poll(&vPoll[0], vPoll.size(), 100) <= 0)
+            continue;
+        for (size_t i = 1; i < vRemote.size(); i++) {
+            if (!(vPoll[i].revents & POLLIN))
+                continue;
+            char pchBuf[0x1000];
+            ssize_t nBytes = recv(vRemote[i], pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+            if (nBytes <= 0)
+                continue;
+            std::vector<char> &buf = vBuffers[i];
+            buf.insert(buf.end(), pchBuf, pchBuf + nBytes);
+            while (buf.size() >= CMessageHeader::HEADER_SIZE) {
+                CDataStream ss(&buf[0], &buf[0] + CMessageHeader::HEADER_SIZE, SER_NETWORK, PROTOCOL_VERSION);
+                CMessageHeader hdr(Params().MessageStart());
+                ss >> hdr;
+                if (buf.size() < CMessageHeader::HEADER_SIZE + hdr.nMessageSize)
+                    break;
+                if (hdr.GetCommand() == "pong" && vLatency[i] == nTimeout) {
+                    vLatency[i] = GetTimeMicros() - vSent[i];
+                    nPending--;
+                }
+                buf.erase(buf.begin(), buf.begin() + CMessageHeader::HEADER_SIZE + hdr.nMessageSize);
+            }
+        }
+    }
+
+    int64_t nMaxLatency = 0;
+    for (size_t i = 1; i < vRemote.size(); i++)
+        nMaxLatency = std::max(nMaxLatency, vLatency[i]);
+    for (size_t i = 0; i < vPeers.size(); i++) {
+        vPeers[i]->fDisconnect = true;
+        vPeers[i]->Release();
+        close(vRemote[i]);
+    }
+    return nMaxLatency / 1000000.0;
+#endif
+}
+
 double benchmark_create_sapling_spend()
 {
     auto sk = libzcash::SaplingSpendingKey::random();
@@ -19,6 +19,12 @@ extern double benchmark_connectblock_slow();
 extern double benchmark_sendtoaddress(CAmount amount);
 extern double benchmark_loadwallet();
 extern double benchmark_listunspent();
+extern double benchmark_getutxos(size_t nOutPoints, bool fBatch);
+extern double benchmark_gettransaction(size_t nLookups, bool fCache);
+extern double benchmark_readblockfiles(size_t nReads, bool fMapped);
+extern double benchmark_messagelatency(size_t nPeers);
+extern double benchmark_komodohashes(size_t nCalls);
+extern double benchmark_blockjson(size_t nTxs, bool fStream);
 extern double benchmark_create_sapling_spend();
 extern double benchmark_create_sapling_output();
 extern double benchmark_verify_sapling_spend();